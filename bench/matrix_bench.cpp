@@ -0,0 +1,433 @@
+#include "Matrix.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * matrix_bench [--sizes 64,256,1024] [--types float,double] [--threads 1,2] [--filter text]
+ *              [--min-time seconds] [--json out.json] [--baseline old.json] [--tolerance 0.10]
+ *              [--trace trace.json]
+ *
+ * Runs every benchmark for every size, element type and thread count, prints a table with
+ * GFLOP/s and GB/s, optionally writes the results as JSON and compares them with a baseline
+ * written by an earlier run. A case slower than baseline * (1 + tolerance) is reported as a
+ * regression and makes the process exit with status 1. --trace records every library call
+ * and writes a Chrome trace-event file (timings are inflated by the tracing itself).
+ */
+
+namespace {
+
+struct Options {
+    std::vector<int> sizes{64, 256, 1024};
+    std::vector<std::string> types{"float", "double"};
+    std::vector<int> threads{1};
+    std::string filter{};
+    double min_time = 0.2;
+    std::string json{};
+    std::string baseline{};
+    double tolerance = 0.10;
+    std::string trace{};
+};
+
+struct Result {
+    std::string name;
+    std::string type;
+    int size;
+    int threads;
+    double seconds;
+    double gflops;
+    double gbytes;
+
+    [[nodiscard]] std::string Key() const{
+        return name + "/" + type + "/" + std::to_string(size) + "/" + std::to_string(threads);
+    }
+};
+
+// One case: setup builds the inputs for a size, and the returned function is timed
+template<typename Type>
+struct Benchmark {
+    std::string name;
+    std::function<double(double)> flops;
+    std::function<double(double)> bytes;
+    std::function<std::function<void()>(int)> setup;
+};
+
+template<typename Type>
+Matrix<Type> RandomMatrix(int rows, int columns, unsigned seed){
+    Matrix<Type> result(rows, columns);
+    unsigned state = seed * 2654435761u + 1;
+    for (int i = 0; i < rows; i++)
+        for (int j = 0; j < columns; j++) {
+            state = state * 1664525u + 1013904223u;
+            result[i][j] = Type(int(state >> 9) % 1000);
+            if constexpr (std::is_floating_point_v<Type>)
+                result[i][j] /= Type(1000);
+        }
+    return result;
+}
+
+// Diagonally dominant, so inverses and solves are well conditioned at every size
+template<typename Type>
+Matrix<Type> SolvableMatrix(int n, unsigned seed){
+    Matrix<Type> result = RandomMatrix<Type>(n, n, seed);
+    for (int i = 0; i < n; i++)
+        result[i][i] += Type(n);
+    return result;
+}
+
+template<typename Type>
+std::vector<Benchmark<Type>> Benchmarks(){
+    using M = Matrix<Type>;
+    const double s = sizeof(Type);
+    std::vector<Benchmark<Type>> list;
+    auto add = [&](std::string name, std::function<double(double)> flops, std::function<double(double)> bytes,
+                   std::function<std::function<void()>(int)> setup) {
+        list.push_back({std::move(name), std::move(flops), std::move(bytes), std::move(setup)});
+    };
+
+    add("multiply", [](double n) { return 2 * n * n * n; }, [s](double n) { return 3 * n * n * s; }, [](int n) {
+        auto a = std::make_shared<M>(RandomMatrix<Type>(n, n, 1));
+        auto b = std::make_shared<M>(RandomMatrix<Type>(n, n, 2));
+        auto c = std::make_shared<M>();
+        return [a, b, c]() { *c = *a * *b; };
+    });
+    add("multiply_assign", [](double n) { return 2 * n * n * n; }, [s](double n) { return 3 * n * n * s; }, [](int n) {
+        auto a = std::make_shared<M>(RandomMatrix<Type>(n, n, 1));
+        auto b = std::make_shared<M>(RandomMatrix<Type>(n, n, 2));
+        auto c = std::make_shared<M>();
+        return [a, b, c]() {
+            *c = *a;
+            *c *= *b;
+        };
+    });
+    add("multiply_transposed", [](double n) { return 2 * n * n * n; }, [s](double n) { return 3 * n * n * s; }, [](int n) {
+        auto a = std::make_shared<M>(RandomMatrix<Type>(n, n, 1));
+        auto b = std::make_shared<M>(RandomMatrix<Type>(n, n, 2));
+        auto c = std::make_shared<M>();
+        return [a, b, c]() { *c = a->Transposed() * *b; };
+    });
+    add("multiply_mixed", [](double n) { return 2 * n * n * n; }, [s](double n) { return 3 * n * n * s; }, [](int n) {
+        auto a = std::make_shared<Matrix<int>>(RandomMatrix<int>(n, n, 1));
+        auto b = std::make_shared<M>(RandomMatrix<Type>(n, n, 2));
+        auto c = std::make_shared<M>();
+        return [a, b, c]() { *c = a->MultiplyMixed(*b); };
+    });
+    add("multiply_half", [](double n) { return 2 * n * n * n; }, [](double n) { return 3 * n * n * sizeof(Float16); }, [](int n) {
+        auto a = std::make_shared<Matrix<Float16>>(RandomMatrix<Type>(n, n, 1).template Cast<Float16>());
+        auto b = std::make_shared<Matrix<Float16>>(RandomMatrix<Type>(n, n, 2).template Cast<Float16>());
+        auto c = std::make_shared<Matrix<Float16>>();
+        return [a, b, c]() { *c = *a * *b; };
+    });
+    add("transpose_square", [](double) { return 0.0; }, [s](double n) { return 2 * n * n * s; }, [](int n) {
+        auto a = std::make_shared<M>(RandomMatrix<Type>(n, n, 1));
+        return [a]() { a->T(); };
+    });
+    add("transpose_rect", [](double) { return 0.0; }, [s](double n) { return 2 * n * (n / 2) * s; }, [](int n) {
+        auto a = std::make_shared<M>(RandomMatrix<Type>(n, std::max(1, n / 2), 1));
+        return [a]() { a->T(); };
+    });
+    add("reshape", [](double) { return 0.0; }, [](double) { return 0.0; }, [](int n) {
+        auto a = std::make_shared<M>(RandomMatrix<Type>(n, n, 1));
+        return [a, n]() {
+            a->Reshape(1, n * n);
+            a->Reshape(n, n);
+        };
+    });
+    add("inverse", [](double n) { return 2 * n * n * n; }, [s](double n) { return 2 * n * n * s; }, [](int n) {
+        auto a = std::make_shared<M>(SolvableMatrix<Type>(n, 1));
+        return [a]() { a->Inverse(); };
+    });
+    add("determinant", [](double n) { return 2.0 / 3.0 * n * n * n; }, [s](double n) { return n * n * s; }, [](int n) {
+        auto a = std::make_shared<M>(SolvableMatrix<Type>(n, 1));
+        return [a]() { volatile float det = a->Determinant(); (void)det; };
+    });
+    add("solve", [](double n) { return 2.0 / 3.0 * n * n * n + 2 * n * n * n; }, [s](double n) { return 3 * n * n * s; }, [](int n) {
+        auto a = std::make_shared<M>(SolvableMatrix<Type>(n, 1));
+        auto b = std::make_shared<M>(RandomMatrix<Type>(n, n, 2));
+        auto x = std::make_shared<M>();
+        return [a, b, x]() { a->Solve(*b, *x); };
+    });
+    add("cholesky_solve", [](double n) { return 1.0 / 3.0 * n * n * n + 2 * n * n * n; }, [s](double n) { return 3 * n * n * s; }, [](int n) {
+        auto r = RandomMatrix<Type>(n, n, 1);
+        auto a = std::make_shared<M>(Matrix<Type>::T(r) * r);
+        for (int i = 0; i < n; i++)
+            (*a)[i][i] += Type(n);
+        auto b = std::make_shared<M>(RandomMatrix<Type>(n, n, 2));
+        auto x = std::make_shared<M>();
+        return [a, b, x]() {
+            *x = *b;
+            Cholesky<Type>(*a).Solve(*x);
+        };
+    });
+    add("least_squares", [](double n) { return 2 * n * n * (4 * n - n / 3) + 8 * n * n; }, [s](double n) { return 9 * n * n * s; }, [](int n) {
+        auto a = std::make_shared<M>(RandomMatrix<Type>(4 * n, n, 1));
+        auto b = std::make_shared<M>(RandomMatrix<Type>(4 * n, 4, 2));
+        auto x = std::make_shared<M>();
+        return [a, b, x]() { a->LeastSquares(*b, *x); };
+    });
+    add("add", [](double n) { return n * n; }, [s](double n) { return 3 * n * n * s; }, [](int n) {
+        auto a = std::make_shared<M>(RandomMatrix<Type>(n, n, 1));
+        auto b = std::make_shared<M>(RandomMatrix<Type>(n, n, 2));
+        auto c = std::make_shared<M>(n, n);
+        return [a, b, c]() { *c = *a + *b; };
+    });
+    add("axpby", [](double n) { return 3 * n * n; }, [s](double n) { return 3 * n * n * s; }, [](int n) {
+        auto a = std::make_shared<M>(RandomMatrix<Type>(n, n, 1));
+        auto b = std::make_shared<M>(RandomMatrix<Type>(n, n, 2));
+        auto c = std::make_shared<M>(n, n);
+        return [a, b, c]() { *c = *a * Type(2) - *b * Type(3); };
+    });
+    add("scale_in_place", [](double n) { return 2 * n * n; }, [s](double n) { return 4 * n * n * s; }, [](int n) {
+        auto a = std::make_shared<M>(RandomMatrix<Type>(n, n, 1));
+        auto scales = std::make_shared<std::vector<Type>>(std::vector<Type>{Type(2), Type(1) / Type(2)});
+        return [a, scales]() {
+            *a *= (*scales)[0];
+            *a *= (*scales)[1];
+        };
+    });
+    add("add_in_place", [](double n) { return n * n; }, [s](double n) { return 3 * n * n * s; }, [](int n) {
+        auto a = std::make_shared<M>(RandomMatrix<Type>(n, n, 1));
+        auto b = std::make_shared<M>(RandomMatrix<Type>(n, n, 2));
+        return [a, b]() { *a += *b; };
+    });
+    add("compare", [](double) { return 0.0; }, [s](double n) { return 2 * n * n * s; }, [](int n) {
+        auto a = std::make_shared<M>(RandomMatrix<Type>(n, n, 1));
+        auto b = std::make_shared<M>(*a);
+        return [a, b]() { volatile bool equal = *a == *b; (void)equal; };
+    });
+    add("structure_checks", [](double) { return 0.0; }, [s](double n) { return n * n * s; }, [](int n) {
+        auto a = std::make_shared<M>(n, n);
+        for (int i = 0; i < n; i++)
+            (*a)[i][i] = Type(1);
+        return [a]() {
+            volatile bool identity = a->IsIdentityMatrix() && a->IsDiagonalMatrix() &&
+                                     a->IsUpperTriangleMatrix() && a->IsLowerTriangleMatrix();
+            (void)identity;
+        };
+    });
+    add("reductions", [](double n) { return 4 * n * n; }, [s](double n) { return 3 * n * n * s; }, [](int n) {
+        auto a = std::make_shared<M>(RandomMatrix<Type>(n, n, 1));
+        return [a]() {
+            volatile auto norms = a->Sum() + a->FrobeniusNorm() + a->InfinityNorm();
+            (void)norms;
+        };
+    });
+    add("sparse_multiply", [](double n) { return 2 * 0.01 * n * n * n; }, [s](double n) { return 2 * n * n * s; }, [](int n) {
+        M dense = RandomMatrix<Type>(n, n, 1);
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < n; j++)
+                if ((i * 131 + j * 71) % 100 != 0)
+                    dense[i][j] = Type(0);
+        auto a = std::make_shared<SparseMatrix<Type>>(dense);
+        auto b = std::make_shared<M>(RandomMatrix<Type>(n, n, 2));
+        auto c = std::make_shared<M>();
+        return [a, b, c]() { *c = *a * *b; };
+    });
+    // 25 CG iterations on the 5-point Laplacian of an n x n grid: one SpMV, two dots and three axpys each
+    add("cg_poisson", [](double n) { return 25 * 20 * n * n; }, [s](double n) { return 25 * (5 * n * n * (s + sizeof(int)) + 8 * n * n * s); }, [](int n) {
+        std::vector<SparseTriplet<Type>> entries;
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < n; j++) {
+                int row = i * n + j;
+                entries.push_back({row, row, Type(4)});
+                if (i > 0) entries.push_back({row, row - n, Type(-1)});
+                if (i < n - 1) entries.push_back({row, row + n, Type(-1)});
+                if (j > 0) entries.push_back({row, row - 1, Type(-1)});
+                if (j < n - 1) entries.push_back({row, row + 1, Type(-1)});
+            }
+        auto a = std::make_shared<SparseMatrix<Type>>(SparseMatrix<Type>::FromTriplets(n * n, n * n, entries));
+        auto b = std::make_shared<Vector<Type>>(n * n, Type(1));
+        auto x = std::make_shared<Vector<Type>>();
+        return [a, b, x]() {
+            IterativeOptions options;
+            options.tolerance = 0;
+            options.max_iterations = 25;
+            x->Resize(0);
+            ConjugateGradient(*a, *b, *x, options);
+        };
+    });
+    add("gemv", [](double n) { return 2 * n * n; }, [s](double n) { return n * n * s; }, [](int n) {
+        auto a = std::make_shared<M>(RandomMatrix<Type>(n, n, 1));
+        auto x = std::make_shared<Vector<Type>>(n, Type(1));
+        auto y = std::make_shared<Vector<Type>>(n);
+        return [a, x, y]() { Gemv(Type(1), a->GetView(), *x, Type(0), *y); };
+    });
+    add("gemv_transposed", [](double n) { return 2 * n * n; }, [s](double n) { return n * n * s; }, [](int n) {
+        auto a = std::make_shared<M>(RandomMatrix<Type>(n, n, 1));
+        auto x = std::make_shared<Vector<Type>>(n, Type(1));
+        auto y = std::make_shared<Vector<Type>>(n);
+        return [a, x, y]() { Gemv(Type(1), a->Transposed(), *x, Type(0), *y); };
+    });
+    // n * n / 16 independent 4x4 matrices, the same footprint as one n x n matrix
+    auto random_batch = [](int n, unsigned seed) {
+        auto batch = std::make_shared<MatrixBatch<Type>>(std::max(1, n * n / 16), 4, 4);
+        for (int b = 0; b < batch->GetCount(); b++)
+            batch->Set(b, RandomMatrix<Type>(4, 4, seed + b % 64));
+        return batch;
+    };
+    add("batch_multiply_4x4", [](double n) { return 8 * n * n; }, [s](double n) { return 3 * n * n * s; }, [random_batch](int n) {
+        auto a = random_batch(n, 1), b = random_batch(n, 100);
+        auto c = std::make_shared<MatrixBatch<Type>>();
+        return [a, b, c]() { BatchMultiply(*a, *b, *c); };
+    });
+    add("batch_inverse_4x4", [](double n) { return 12 * n * n; }, [s](double n) { return 2 * n * n * s; }, [random_batch](int n) {
+        auto a = random_batch(n, 1);
+        auto c = std::make_shared<MatrixBatch<Type>>();
+        return [a, c]() { BatchInverse(*a, *c); };
+    });
+    return list;
+}
+
+// Calls run until min_time has passed and returns the fastest of several timed batches, per call
+double Measure(const std::function<void()> &run, double min_time){
+    using Clock = std::chrono::steady_clock;
+    run();
+    int batch = 1;
+    double best = 1e30;
+    double total = 0;
+    while (total < min_time) {
+        auto start = Clock::now();
+        for (int i = 0; i < batch; i++)
+            run();
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        total += elapsed;
+        best = std::min(best, elapsed / batch);
+        if (elapsed < min_time / 20)
+            batch *= 2;
+    }
+    return best;
+}
+
+template<typename Type>
+void RunType(const std::string &type, const Options &options, std::vector<Result> &results){
+    for (const Benchmark<Type> &benchmark : Benchmarks<Type>()) {
+        if (!options.filter.empty() && benchmark.name.find(options.filter) == std::string::npos)
+            continue;
+        for (int threads : options.threads) {
+            MatrixThreadPool::Instance().Configure(threads);
+            for (int size : options.sizes) {
+                double seconds = Measure(benchmark.setup(size), options.min_time);
+                Result result{benchmark.name, type, size, threads, seconds,
+                              benchmark.flops(size) / seconds * 1e-9, benchmark.bytes(size) / seconds * 1e-9};
+                std::printf("%-20s %-7s n=%-6d threads=%-3d %12.3f us %10.2f GFLOP/s %10.2f GB/s\n",
+                            result.name.c_str(), type.c_str(), size, threads, seconds * 1e6, result.gflops, result.gbytes);
+                std::fflush(stdout);
+                results.push_back(result);
+            }
+        }
+    }
+}
+
+std::vector<int> ParseInts(const std::string &text){
+    std::vector<int> values;
+    std::stringstream stream(text);
+    for (std::string item; std::getline(stream, item, ',');)
+        values.push_back(std::atoi(item.c_str()));
+    return values;
+}
+
+std::vector<std::string> ParseStrings(const std::string &text){
+    std::vector<std::string> values;
+    std::stringstream stream(text);
+    for (std::string item; std::getline(stream, item, ',');)
+        values.push_back(item);
+    return values;
+}
+
+// One result per line, so that a baseline can be read back without a JSON library
+void WriteJson(const std::string &path, const std::vector<Result> &results){
+    std::ofstream out(path);
+    out << "{\n  \"isa\": " << int(MatrixDetail::ActiveGemmIsa()) << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        char line[512];
+        std::snprintf(line, sizeof(line),
+                      "    {\"name\": \"%s\", \"type\": \"%s\", \"size\": %d, \"threads\": %d, "
+                      "\"seconds\": %.9g, \"gflops\": %.6g, \"gbytes_per_s\": %.6g}%s\n",
+                      r.name.c_str(), r.type.c_str(), r.size, r.threads, r.seconds, r.gflops, r.gbytes,
+                      i + 1 < results.size() ? "," : "");
+        out << line;
+    }
+    out << "  ]\n}\n";
+}
+
+std::map<std::string, double> ReadBaseline(const std::string &path){
+    std::map<std::string, double> baseline;
+    std::ifstream in(path);
+    for (std::string line; std::getline(in, line);) {
+        char name[128], type[32];
+        int size, threads;
+        double seconds;
+        if (std::sscanf(line.c_str(), " {\"name\": \"%127[^\"]\", \"type\": \"%31[^\"]\", \"size\": %d, \"threads\": %d, \"seconds\": %lf",
+                        name, type, &size, &threads, &seconds) == 5)
+            baseline[Result{name, type, size, threads, 0, 0, 0}.Key()] = seconds;
+    }
+    return baseline;
+}
+
+}
+
+int main(int argc, char **argv){
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i], value = argv[i + 1];
+        if (flag == "--sizes") options.sizes = ParseInts(value);
+        else if (flag == "--types") options.types = ParseStrings(value);
+        else if (flag == "--threads") options.threads = ParseInts(value);
+        else if (flag == "--filter") options.filter = value;
+        else if (flag == "--min-time") options.min_time = std::atof(value.c_str());
+        else if (flag == "--json") options.json = value;
+        else if (flag == "--baseline") options.baseline = value;
+        else if (flag == "--tolerance") options.tolerance = std::atof(value.c_str());
+        else if (flag == "--trace") options.trace = value;
+        else {
+            std::fprintf(stderr, "Unknown option %s\n", flag.c_str());
+            return 2;
+        }
+    }
+
+    if (!options.trace.empty())
+        MatrixProfiler::EnableTrace(true, size_t(1) << 18);
+
+    std::vector<Result> results;
+    for (const std::string &type : options.types) {
+        if (type == "float")
+            RunType<float>(type, options, results);
+        else if (type == "double")
+            RunType<double>(type, options, results);
+        else
+            std::fprintf(stderr, "Skipping unsupported type %s\n", type.c_str());
+    }
+
+    if (!options.json.empty())
+        WriteJson(options.json, results);
+    if (!options.trace.empty() && !MatrixProfiler::WriteChromeTrace(options.trace))
+        std::fprintf(stderr, "Cannot write %s\n", options.trace.c_str());
+
+    int regressions = 0;
+    if (!options.baseline.empty()) {
+        std::map<std::string, double> baseline = ReadBaseline(options.baseline);
+        for (const Result &result : results) {
+            auto it = baseline.find(result.Key());
+            if (it == baseline.end())
+                continue;
+            double ratio = result.seconds / it->second;
+            if (ratio > 1.0 + options.tolerance) {
+                std::printf("REGRESSION %-40s %.2fx slower than baseline\n", result.Key().c_str(), ratio);
+                regressions++;
+            }
+            else if (ratio < 1.0 - options.tolerance)
+                std::printf("improved   %-40s %.2fx faster than baseline\n", result.Key().c_str(), 1.0 / ratio);
+        }
+        std::printf("%d regression(s) against %s\n", regressions, options.baseline.c_str());
+    }
+    return regressions ? 1 : 0;
+}
@@ -1,39 +1,56 @@
 #pragma once
 
 #include "vector"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include "iostream"
+#include "MatrixFwd.h"
+#include "MatrixProfiler.h"
+#include "MatrixMemory.h"
+#include "MatrixAllocator.h"
+#include "MatrixGemm.h"
+#include "MatrixElementWise.h"
+#include "MatrixTranspose.h"
+#include "MatrixExpression.h"
 
 //#define DEBUG
 
-#ifdef DEBUG
-#include <chrono>
-#include <string>
+template<typename Type>
+class LU;
 
-struct Timer{
-    std::chrono::high_resolution_clock::time_point start, end;
-    std::chrono::duration<float> duration{};
-    std::string function_name;
+template<typename Type>
+class QR;
 
+namespace MatrixDetail {
+    template<typename Type>
+    int LUFactor(int n, Type *A, int lda, int *pivots);
 
-    explicit Timer(const std::string &name)
-    {
-        start = std::chrono::high_resolution_clock::now();
-        function_name = name;
-    }
+    template<typename Type>
+    bool LUIsSingular(int n, const Type *A, int lda);
 
-    ~Timer()
-    {
-        end = std::chrono::high_resolution_clock::now();
-        duration = end - start;
-        float ms = duration.count() * 1000.0f;
-        std::cout << "Execution of " << function_name.c_str() << " took " << ms << "ms\n";
-    }
-};
-#endif
+    template<typename Type>
+    void LUInvert(int n, Type *A, int lda, const int *pivots);
 
-template<typename Type>
-class Matrix;
+    // Below this fraction of non-zeros a sparse product beats dense GEMM despite the conversion
+    constexpr double SparseDensityThreshold = 0.05;
+
+    template<typename Type>
+    bool SparseProductPaysOff(const Matrix<Type> &A, const Matrix<Type> &B);
+
+    template<typename Type>
+    Matrix<Type> SparseProduct(const Matrix<Type> &A, const Matrix<Type> &B);
+
+    template<typename Type>
+    bool SaveMatrix(const MatrixView<Type> &Source, const std::string &path);
+
+    template<typename Type>
+    bool StrassenMultiply(int m, int n, int k, const Type *A, int lda, const Type *B, int ldb, Type *C, int ldc);
+}
 
 template<typename Type>
 class ProxyVector {
@@ -70,7 +87,7 @@ public:
     template<typename T>
     ProxyVector operator-(const T &other) const {
         ProxyVector temp(*this);
-        temp += other;
+        temp -= other;
         return temp;
     }
 
@@ -90,63 +107,51 @@ public:
 
     ProxyVector &operator+=(const ProxyVector &other) {
         assert(size() == other.size());
-        for (int i = 0; i < size(); i++)
-            data[i] += other[i];
+        Apply(other, [](Type &element, Type value) { element += value; });
         return *this;
     }
 
     ProxyVector &operator-=(const ProxyVector &other) {
         assert(size() == other.size());
-        for (int i = 0; i < size(); i++)
-            data[i] -= other[i];
+        Apply(other, [](Type &element, Type value) { element -= value; });
         return *this;
     }
 
     template<typename T>
     ProxyVector &operator+=(const T &value) {
-        for (auto &element : data)
-            element += value;
+        Apply([value](Type &element) { element += value; });
         return *this;
     }
 
     template<typename T>
     ProxyVector &operator-=(const T &value) {
-        for (auto &element : data)
-            element -= value;
+        Apply([value](Type &element) { element -= value; });
         return *this;
     }
 
     template<typename T>
     ProxyVector &operator*=(const T &value) {
-        for (Type &element : data)
-            element *= value;
+        Apply([value](Type &element) { element *= value; });
         return *this;
     }
 
     template<typename T>
     ProxyVector &operator/=(const T &value) {
-        for (auto &element : data)
-            element /= value;
+        Apply([value](Type &element) { element /= value; });
         return *this;
     }
 
     bool operator==(const std::vector<Type> &InVector) const{
-        bool SizeEquality = size() == InVector.size();
-        bool ValuesEquality = true;
-        for (int i = 0; i < size(); i++)
-            if (data[i] != InVector[i]) {
-                ValuesEquality = false;
-                break;
-            }
-        return SizeEquality && ValuesEquality;
+        return size() == InVector.size() &&
+               MatrixDetail::EqualElements(1, int(size()), data.data(), ptrdiff_t(size()), InVector.data(), ptrdiff_t(size()));
     }
 
     bool operator!=(const std::vector<Type> &InVector) const{
-        return !(*this->operator==(InVector));
+        return !(*this == InVector);
     }
 
     bool operator==(const ProxyVector &InVector) const{
-        return *this->operator==(InVector.data);
+        return *this == InVector.data;
     }
 
     bool operator!=(const ProxyVector &InVector) const{
@@ -162,49 +167,248 @@ public:
         assert(idx < data.size());
         return data[idx];
     }
+
+private:
+    template<typename Function>
+    void Apply(Function f){
+        MatrixDetail::TransformElements(1, int(size()), data.data(), ptrdiff_t(size()), f);
+    }
+
+    template<typename Function>
+    void Apply(const ProxyVector &other, Function f){
+        MatrixDetail::TransformElements(1, int(size()), data.data(), ptrdiff_t(size()), other.data.data(), ptrdiff_t(size()), f);
+    }
+};
+
+/*
+ * Non-owning view of one matrix row. Returned by Matrix::operator[] so that
+ * M[i][j] addresses the contiguous matrix buffer directly. Assigning to a view
+ * copies values into the row, it never rebinds the view.
+ */
+template<typename Type>
+class RowView {
+
+private:
+    Type *data = nullptr;
+    int length = 0;
+
+public:
+    RowView(Type *Data, int Size) : data(Data), length(Size) {}
+    RowView(const RowView &other) = default;
+
+    [[nodiscard]] size_t size() const { return length; }
+
+    Type *begin() const { return data; }
+    Type *end() const { return data + length; }
+
+    operator RowView<const Type>() const { return RowView<const Type>(data, length); }
+
+    RowView &operator=(const RowView &other){
+        assert(size() == other.size());
+        std::copy(other.begin(), other.end(), data);
+        return *this;
+    }
+
+    template<typename T>
+    RowView &operator=(const std::vector<T> &new_data){
+        assert(size() == new_data.size());
+        for (int i = 0; i < length; i++)
+            data[i] = new_data[i];
+        return *this;
+    }
+
+    RowView &operator=(const ProxyVector<std::remove_const_t<Type>> &new_data){
+        assert(size() == new_data.size());
+        for (int i = 0; i < length; i++)
+            data[i] = new_data[i];
+        return *this;
+    }
+
+    template<typename T>
+    RowView &operator+=(const RowView<T> &other) {
+        assert(size() == other.size());
+        for (int i = 0; i < length; i++)
+            data[i] += other[i];
+        return *this;
+    }
+
+    template<typename T>
+    RowView &operator-=(const RowView<T> &other) {
+        assert(size() == other.size());
+        for (int i = 0; i < length; i++)
+            data[i] -= other[i];
+        return *this;
+    }
+
+    template<typename T>
+    RowView &operator+=(const T &value) {
+        for (auto &element : *this)
+            element += value;
+        return *this;
+    }
+
+    template<typename T>
+    RowView &operator-=(const T &value) {
+        for (auto &element : *this)
+            element -= value;
+        return *this;
+    }
+
+    template<typename T>
+    RowView &operator*=(const T &value) {
+        for (auto &element : *this)
+            element *= value;
+        return *this;
+    }
+
+    template<typename T>
+    RowView &operator/=(const T &value) {
+        for (auto &element : *this)
+            element /= value;
+        return *this;
+    }
+
+    template<typename T>
+    bool operator==(const RowView<T> &other) const{
+        if (size() != other.size())
+            return false;
+        for (int i = 0; i < length; i++)
+            if (data[i] != other[i])
+                return false;
+        return true;
+    }
+
+    template<typename T>
+    bool operator!=(const RowView<T> &other) const{
+        return !(*this == other);
+    }
+
+    bool operator==(const std::vector<std::remove_const_t<Type>> &InVector) const{
+        return *this == RowView<const std::remove_const_t<Type>>(InVector.data(), InVector.size());
+    }
+
+    bool operator!=(const std::vector<std::remove_const_t<Type>> &InVector) const{
+        return !(*this == InVector);
+    }
+
+    Type &operator[](const int idx) const{
+        assert(idx < length);
+        return data[idx];
+    }
 };
 
 
+/*
+ * Dense row-major matrix. All elements live in one aligned buffer; row i starts
+ * at matrix + i * stride. The stride (leading dimension) may exceed the column
+ * count: wide rows are padded as MatrixLayout decides, and TrimMatrixColumn keeps
+ * the old stride, so kernels must always step rows by stride.
+ */
 template<typename Type>
-class Matrix {
+class Matrix<Type, MatrixDynamic, MatrixDynamic> {
 
 private:
     int rows = 0;
     int columns = 0;
-    std::vector<ProxyVector<Type>> matrix{};
+    int stride = 0;
+    size_t capacity = 0;
+    Type *matrix = nullptr;
+    MatrixMemoryResource *resource = MatrixDetail::CurrentResource();
 
 public:
     Matrix() = default;
-    
+
     explicit Matrix(const std::vector<std::vector<Type>> &Data){
-#ifdef DEBUG
-        auto t = Timer("Matrix::Matrix(const std::vector<std::vector<float>> &Data)");
-#endif
+        MATRIX_PROFILE("Matrix::Matrix(const std::vector<std::vector<float>> &Data)");
         SetData(Data);
     }
-    
+
     explicit Matrix(const std::vector<ProxyVector<Type>> &Data){
-#ifdef DEBUG
-        auto t = Timer("Matrix::Matrix(const std::vector<ProxyVector> &Data)");
-#endif
+        MATRIX_PROFILE("Matrix::Matrix(const std::vector<ProxyVector> &Data)");
         SetData(Data);
     }
-    
+
     Matrix(int num_rows, int num_columns){
-#ifdef DEBUG
-        auto t = Timer("Matrix::Matrix(int num_rows, int num_columns)");
-#endif
+        MATRIX_PROFILE("Matrix::Matrix(int num_rows, int num_columns)");
         AllocMatrixData(num_rows, num_columns);
 #ifdef DEBUG
         std::cout << "Matrix was created. ADDR: " << this << "\n";
         std::cout << "Reserved space: " << rows << " rows, " << columns << " columns\n";
 #endif
     }
-    
+
+    template<typename Derived>
+    Matrix(const MatrixExpression<Derived> &expression){
+        MATRIX_PROFILE("Matrix::Matrix(const MatrixExpression<Derived> &expression)");
+        AllocMatrixData(expression.GetRows(), expression.GetColumns(), false);
+        AssignExpression(expression.Self());
+    }
+
+    // A temporary expression that owns a matrix of the result type is evaluated into that matrix's buffer
+    template<typename Derived>
+    Matrix(MatrixExpression<Derived> &&expression){
+        MATRIX_PROFILE("Matrix::Matrix(MatrixExpression<Derived> &&expression)");
+        auto &self = static_cast<Derived &>(expression);
+        if constexpr (std::is_same_v<typename Derived::ValueType, Type>) {
+            Matrix *storage = self.Storage();
+            if (storage && !storage->IsAliasedBy(self)) {
+                storage->AssignExpression(self);
+                Swap(*storage);
+                return;
+            }
+        }
+        AllocMatrixData(self.GetRows(), self.GetColumns(), false);
+        AssignExpression(self);
+    }
+
+    Matrix(const Matrix &other){
+        MATRIX_PROFILE("Matrix::Matrix(const Matrix &other)");
+        CopyFrom(other);
+    }
+
+    Matrix(Matrix &&other) noexcept{
+        Swap(other);
+    }
+
+    Matrix &operator=(const Matrix &other){
+        if (this != &other)
+            CopyFrom(other);
+        return *this;
+    }
+
+    Matrix &operator=(Matrix &&other) noexcept{
+        if (this != &other) {
+            DeallocMatrixData();
+            Swap(other);
+        }
+        return *this;
+    }
+
+    // Evaluates in place when the shape already matches, so A = A + B needs no allocation; A = A.Transposed() does
+    template<typename Derived>
+    Matrix &operator=(const MatrixExpression<Derived> &expression){
+        if (rows != expression.GetRows() || columns != expression.GetColumns() || IsAliasedBy(expression.Self())) {
+            Matrix temp(expression);
+            *this = std::move(temp);
+        }
+        else
+            AssignExpression(expression.Self());
+        return *this;
+    }
+
+    template<typename Derived>
+    Matrix &operator=(MatrixExpression<Derived> &&expression){
+        if (rows != expression.GetRows() || columns != expression.GetColumns() || IsAliasedBy(expression.Self())) {
+            Matrix temp(std::move(expression));
+            *this = std::move(temp);
+        }
+        else
+            AssignExpression(expression.Self());
+        return *this;
+    }
+
     ~Matrix(){
-#ifdef DEBUG
-        auto t = Timer("Matrix::~Matrix()");
-#endif
+        MATRIX_PROFILE("Matrix::~Matrix()");
         DeallocMatrixData();
 #ifdef DEBUG
         std::cout << "Matrix was deleted. ADDR: " << this << "\n";
@@ -212,9 +416,7 @@ public:
     }
 
     [[nodiscard]] Matrix Copy() const{
-#ifdef DEBUG
-        auto t = Timer("Matrix::Copy()");
-#endif
+        MATRIX_PROFILE("Matrix::Copy()");
         auto temp = Matrix(*this);
 #ifdef DEBUG
         std::cout << "Copied matrix from " << this << " to " << &temp << "\n";
@@ -223,229 +425,304 @@ public:
     }
 
 private:
-    void AllocMatrixData(int num_rows, int num_columns){
-#ifdef DEBUG
-        auto t = Timer("Matrix::AllocMatrixData(int num_rows, int num_columns)");
-#endif
-        DeallocMatrixData();
+    void AllocMatrixData(int num_rows, int num_columns, bool zero_fill = true){
+        int leading = MatrixLayout::LeadingDimension<Type>(num_rows, num_columns);
+        size_t required = size_t(num_rows) * leading;
+        if (required > capacity) {
+            DeallocMatrixData();
+            matrix = static_cast<Type *>(resource->Allocate(required * sizeof(Type)));
+            capacity = required;
+            MatrixProfiler::CountAllocation(required * sizeof(Type));
+        }
         rows = num_rows;
         columns = num_columns;
-        for (int i = 0; i < rows; i++)
-            matrix.emplace_back(columns);
+        stride = leading;
+        // Padding is never read by kernels, but saved files and copies should not carry stale bytes
+        if (zero_fill)
+            std::fill(matrix, matrix + required, Type());
+        else if (leading != num_columns)
+            for (int i = 0; i < num_rows; i++)
+                std::fill(RowPtr(i) + num_columns, RowPtr(i) + leading, Type());
 #ifdef DEBUG
-        std::cout << "Memory for matrix data was allocated. ADDR: " << &matrix << "\n";
+        std::cout << "Memory for matrix data was allocated. ADDR: " << matrix << "\n";
 #endif
     }
-    
+
     void DeallocMatrixData(){
-#ifdef DEBUG
-        auto t = Timer("Matrix::DeallocMatrixData()");
-#endif
-        matrix.clear();
+        if (matrix)
+            resource->Deallocate(matrix, capacity * sizeof(Type));
+        matrix = nullptr;
+        capacity = 0;
         rows = 0;
         columns = 0;
+        stride = 0;
 #ifdef DEBUG
-        std::cout << "Memory for matrix was deallocated. ADDR: " << &matrix << "\n";
+        std::cout << "Memory for matrix was deallocated. ADDR: " << this << "\n";
 #endif
     }
 
+    // True when a view in expression reads this storage through another mapping, so in place evaluation would
+    // overwrite elements before they are read
+    template<typename Expression>
+    bool IsAliasedBy(const Expression &expression) const{
+        return matrix && expression.Aliases(static_cast<const Type *>(matrix), matrix + size_t(rows) * stride, ptrdiff_t(stride));
+    }
+
+    // Single fused pass over the expression tree; the target may be one of its matrix operands, but not under a view
+    // that IsAliasedBy reports
+    template<typename Expression>
+    void AssignExpression(const Expression &expression){
+        MatrixProfiler::CountWork(0, size_t(rows) * columns * sizeof(Type));
+        MatrixDetail::ForEachSpan(rows, columns, false, [&](int i, int begin, int end) {
+            auto row = expression.RowAt(i);
+            Type *out = RowPtr(i);
+            for (int j = begin; j < end; j++)
+                out[j] = Type(row[j]);
+        });
+    }
+
+    void CopyFrom(const Matrix &other){
+        AllocMatrixData(other.rows, other.columns, false);
+        if (other.stride == stride)
+            std::copy(other.matrix, other.matrix + size_t(rows) * stride, matrix);
+        else
+            for (int i = 0; i < rows; i++)
+                std::copy(other.RowPtr(i), other.RowPtr(i) + columns, RowPtr(i));
+    }
+
+    void Swap(Matrix &other) noexcept{
+        std::swap(rows, other.rows);
+        std::swap(columns, other.columns);
+        std::swap(stride, other.stride);
+        std::swap(capacity, other.capacity);
+        std::swap(matrix, other.matrix);
+        std::swap(resource, other.resource);
+    }
+
+    // Moves the rows to a new leading dimension, in place unless the buffer is too small
+    void Restride(int new_stride){
+        if (new_stride == stride || rows == 0)
+            return;
+        size_t required = size_t(rows) * new_stride;
+        if (required > capacity) {
+            Type *buffer = static_cast<Type *>(resource->Allocate(required * sizeof(Type)));
+            MatrixProfiler::CountAllocation(required * sizeof(Type));
+            for (int i = 0; i < rows; i++)
+                std::memcpy(buffer + size_t(i) * new_stride, RowPtr(i), columns * sizeof(Type));
+            resource->Deallocate(matrix, capacity * sizeof(Type));
+            matrix = buffer;
+            capacity = required;
+        }
+        else if (new_stride < stride)
+            for (int i = 1; i < rows; i++)
+                std::memmove(matrix + size_t(i) * new_stride, RowPtr(i), columns * sizeof(Type));
+        else
+            for (int i = rows - 1; i > 0; i--)
+                std::memmove(matrix + size_t(i) * new_stride, RowPtr(i), columns * sizeof(Type));
+        stride = new_stride;
+    }
+
+    Type *RowPtr(int i) { return matrix + size_t(i) * stride; }
+    const Type *RowPtr(int i) const { return matrix + size_t(i) * stride; }
+
+    Type &At(int i, int j) { return matrix[size_t(i) * stride + j]; }
+    const Type &At(int i, int j) const { return matrix[size_t(i) * stride + j]; }
+
 public:
     void SetRow(const std::vector<float> &Data, int n){
-#ifdef DEBUG
-        auto t = Timer("Matrix::SetRow(const std::vector<float> &Data, int n)");
-#endif
+        MATRIX_PROFILE("Matrix::SetRow(const std::vector<float> &Data, int n)");
         assert(n < rows);
-        matrix[n] = Data;
+        (*this)[n] = Data;
     }
-    
+
     void SetRow(const ProxyVector<Type> &Data, int n){
-#ifdef DEBUG
-        auto t = Timer("Matrix::SetRow(const ProxyVector &Data, int n)");
-#endif
+        MATRIX_PROFILE("Matrix::SetRow(const ProxyVector &Data, int n)");
         assert(n < rows);
-        matrix[n] = Data;
+        (*this)[n] = Data;
     }
-    
+
     void SetColumn(const std::vector<float> &Data, int n){
-#ifdef DEBUG
-        auto t = Timer("Matrix::SetColumn(const std::vector<float> &Data, int n)");
-#endif
+        MATRIX_PROFILE("Matrix::SetColumn(const std::vector<float> &Data, int n)");
         assert(n < columns);
-        for(int i = 0; i < columns; i++){
-            matrix[i][n] = Data[i];
+        assert(Data.size() == rows);
+        for(int i = 0; i < rows; i++){
+            At(i, n) = Data[i];
         }
     }
-    
+
     void SetColumn(const ProxyVector<Type> &Data, int n){
-#ifdef DEBUG
-        auto t = Timer("Matrix::SetColumn(const ProxyVector &Data, int n)");
-#endif
+        MATRIX_PROFILE("Matrix::SetColumn(const ProxyVector &Data, int n)");
         assert(n < columns);
-        for(int i = 0; i < columns; i++){
-            matrix[i][n] = Data[i];
+        assert(Data.size() == rows);
+        for(int i = 0; i < rows; i++){
+            At(i, n) = Data[i];
         }
     }
-    
+
     [[nodiscard]] int GetRows() const { return rows; }
     [[nodiscard]] int GetColumns() const { return columns; }
-    
+    [[nodiscard]] int GetStride() const { return stride; }
+    [[nodiscard]] MatrixMemoryResource *GetResource() const { return resource; }
+
+    [[nodiscard]] Type *Data() { return matrix; }
+    [[nodiscard]] const Type *Data() const { return matrix; }
+
+    // O(1) read-only views; they stay valid until this matrix is resized, reshaped or destroyed
+    [[nodiscard]] MatrixView<Type> GetView() const { return MatrixView<Type>(*this); }
+
+    [[nodiscard]] MatrixView<Type> SubMatrix(int row, int column, int num_rows, int num_columns) const{
+        return GetView().SubMatrix(row, column, num_rows, num_columns);
+    }
+
+    [[nodiscard]] MatrixView<Type> Minor(int row, int column) const { return GetView().Minor(row, column); }
+    [[nodiscard]] MatrixView<Type> Column(int column) const { return GetView().Column(column); }
+
     void SetData(const std::vector<std::vector<Type>> &Data){
-#ifdef DEBUG
-        auto t = Timer("Matrix::SetData(const std::vector<std::vector<float>> &Data)");
-#endif
-        DeallocMatrixData();
-        for (int i = 0; i < Data.size(); i++) {
-            matrix.emplace_back();
-            matrix[i] = Data[i];
-            columns = Data[i].size();
-            rows++;
-        }
+        MATRIX_PROFILE("Matrix::SetData(const std::vector<std::vector<float>> &Data)");
+        AllocMatrixData(Data.size(), Data.empty() ? 0 : Data[0].size());
+        for (int i = 0; i < rows; i++)
+            (*this)[i] = Data[i];
 #ifdef DEBUG
         std::cout << "Matrix data was loaded: " << rows << " rows, " << columns << " columns\n";
 #endif
     }
-    
+
     void SetData(const std::vector<ProxyVector<Type>> &Data){
-#ifdef DEBUG
-        auto t = Timer("Matrix::SetData(const std::vector<ProxyVector> &Data)");
-#endif
-        DeallocMatrixData();
-        for (int i = 0; i < Data.size(); i++) {
-            matrix.emplace_back();
-            matrix[i] = Data[i];
-            columns = Data[i].size();
-            rows++;
-        }
+        MATRIX_PROFILE("Matrix::SetData(const std::vector<ProxyVector> &Data)");
+        AllocMatrixData(Data.size(), Data.empty() ? 0 : Data[0].size());
+        for (int i = 0; i < rows; i++)
+            (*this)[i] = Data[i];
 #ifdef DEBUG
         std::cout << "Matrix data was loaded: " << rows << " rows, " << columns << " columns\n";
 #endif
     }
 
     void T(){
-#ifdef DEBUG
-        auto t = Timer("Matrix::T()");
-#endif
-        auto temp = Copy();
-        AllocMatrixData(temp.columns, temp.rows);
-        for (int i = 0; i < columns; i++)
-            for (int j = 0; j < rows; j++)
-                matrix[j][i] = temp.matrix[i][j];
-    }
-    
-    void Inverse(){
-#ifdef DEBUG
-        auto t = Timer("Matrix::Inverse()");
-#endif
-        float det = Determinant();
-        if (abs(det) < 0.00005f) //epsilon
-        {
-#ifdef DEBUG
-            printf("Can't inverse matrix with D = 0\n");
-#endif
+        MATRIX_PROFILE("Matrix::T()");
+        if (rows == columns) {
+            MatrixDetail::TransposeInPlace(rows, matrix, stride);
             return;
         }
+        int leading = MatrixLayout::LeadingDimension<Type>(columns, rows);
+        size_t required = size_t(columns) * leading;
+        if (required > capacity) {
+            // New storage is needed anyway, so the transpose is written straight into it
+            Type *target = static_cast<Type *>(resource->Allocate(required * sizeof(Type)));
+            MatrixDetail::Transpose(rows, columns, matrix, stride, target, leading);
+            resource->Deallocate(matrix, capacity * sizeof(Type));
+            matrix = target;
+            capacity = required;
+            MatrixProfiler::CountAllocation(required * sizeof(Type));
+        }
+        else if (required * sizeof(Type) <= MatrixDetail::TransposeScratchBytes) {
+            MatrixDetail::WorkspaceLease lease(MatrixDetail::TransposeWorkspace());
+            Type *buffer = lease.Get<Type>(required);
+            MatrixDetail::Transpose(rows, columns, matrix, stride, buffer, leading);
+            for (int i = 0; i < columns; i++)
+                std::copy(buffer + size_t(i) * leading, buffer + size_t(i) * leading + rows, matrix + size_t(i) * leading);
+        }
+        else {
+            // Too large to copy: rows are packed densely, permuted in place, then spread out to the new leading dimension
+            for (int i = 1; i < rows && stride != columns; i++)
+                std::copy(RowPtr(i), RowPtr(i) + columns, matrix + size_t(i) * columns);
+            MatrixDetail::TransposeCycles(rows, columns, matrix);
+            for (int i = columns - 1; i > 0 && leading != rows; i--)
+                std::copy_backward(matrix + size_t(i) * rows, matrix + size_t(i + 1) * rows, matrix + size_t(i) * leading + rows);
+        }
+        std::swap(rows, columns);
+        stride = leading;
+    }
 
-        auto minor_m = Copy();
-        auto origin = Copy();
-
-        for (int i = 0; i < rows; i++)
-            for (int j = 0; j < columns; j++) {
-                auto temp = Matrix::TrimMatrix(origin, i, j);
-                minor_m.matrix[i][j] = temp.Determinant();
-            }
+    // Lazy transpose: a view with swapped strides, e.g. A.Transposed() * B never materializes A^T
+    [[nodiscard]] MatrixView<Type> Transposed() const { return GetView().Transposed(); }
 
-        float sign = 1;
-        for (int i = 0; i < minor_m.rows; i++)
-            for (int j = 0; j < minor_m.columns; j++) {
-                minor_m.matrix[i][j] *= sign;
-                sign *= -1;
+    // Inverts in place through LU; a singular matrix is left exactly as it was
+    template<typename Accumulator = MatrixDetail::FactorType<Type>>
+    void Inverse(){
+        MATRIX_PROFILE("Matrix::Inverse()");
+        static_assert(MatrixDetail::IsFloatingV<Type>, "Matrix::Inverse needs a floating point matrix");
+        assert(rows == columns);
+        if constexpr (!std::is_same_v<Accumulator, Type>) {
+            // Narrow storage is inverted in the accumulator type and rounded back once
+            Matrix<Accumulator> wide = Cast<Accumulator>();
+            wide.template Inverse<Accumulator>();
+            *this = wide.template Cast<Type>();
+        }
+        else {
+            // Held across LUFactor and LUInvert, whose Gemm updates may run other kernels on this thread
+            MatrixDetail::WorkspaceLease lease(MatrixDetail::PivotWorkspace());
+            int *pivots = lease.Get<int>(rows);
+            // Rebuilding P^T * L * U would only give the input back up to round-off, so it is kept aside
+            Matrix saved(*this);
+            int sign = MatrixDetail::LUFactor(rows, matrix, stride, pivots);
+            if (sign == 0 || MatrixDetail::LUIsSingular(rows, matrix, stride))
+            {
+#ifdef DEBUG
+                printf("Can't inverse matrix with D = 0\n");
+#endif
+                for (int i = 0; i < rows; i++)
+                    std::copy(saved.RowPtr(i), saved.RowPtr(i) + columns, RowPtr(i));
+                return;
             }
-
-        minor_m.T();
-        minor_m /= det;
-        matrix = minor_m.matrix;
+            MatrixDetail::LUInvert(rows, matrix, stride, pivots);
+        }
     }
-    
+
     void TrimMatrixRow(int row){
-#ifdef DEBUG
-        auto t = Timer("Matrix::TrimMatrixRow(int row)");
-#endif
-        if (row >= matrix.size()) {
+        MATRIX_PROFILE("Matrix::TrimMatrixRow(int row)");
+        if (row >= rows) {
             std::cout << "Row " << row << " doesn't exist\n";
             return;
         }
-        matrix.erase(matrix.begin() + row);
+        std::memmove(RowPtr(row), RowPtr(row + 1), size_t(rows - row - 1) * stride * sizeof(Type));
         rows--;
     }
-    
+
     void TrimMatrixColumn(int column){
-#ifdef DEBUG
-        auto t = Timer("Matrix::TrimMatrixColumn(int column)");
-#endif
-        for (auto &row: matrix) {
-            if (column >= row.size()) {
-                std::cout << "Row " << column << " doesn't exist\n";
-                return;
-            }
-            row.erase(column);
+        MATRIX_PROFILE("Matrix::TrimMatrixColumn(int column)");
+        if (column >= columns) {
+            std::cout << "Row " << column << " doesn't exist\n";
+            return;
         }
+        for (int i = 0; i < rows; i++)
+            std::memmove(RowPtr(i) + column, RowPtr(i) + column + 1, (columns - column - 1) * sizeof(Type));
         columns--;
     }
-    
+
     void TrimMatrix(int row, int column){
-#ifdef DEBUG
-        auto t = Timer("Matrix::TrimMatrix(int row, int column)");
-#endif
+        MATRIX_PROFILE("Matrix::TrimMatrix(int row, int column)");
         TrimMatrixRow(row);
         TrimMatrixColumn(column);
     }
-    
+
+    // Repacks the rows: the elements are packed in row-major order, then spread to the new leading dimension
     void Reshape(int num_rows, int num_columns){
-#ifdef DEBUG
-        auto t = Timer("Matrix::Reshape(int num_rows, int num_columns)");
-#endif
+        MATRIX_PROFILE("Matrix::Reshape(int num_rows, int num_columns)");
         assert(rows * columns == num_rows * num_columns);
-        Matrix temp = Copy();
-        AllocMatrixData(num_rows, num_columns);
-        int CurrentRow = 0;
-        int CurrentColumn = 0;
-        for (int i = 0; i < temp.rows; i++) {
-            for (int j = 0; j < temp.columns; j++) {
-                matrix[CurrentRow][CurrentColumn] = temp.matrix[i][j];
-                CurrentColumn++;
-                if (CurrentColumn == num_columns) {
-                    CurrentColumn = 0;
-                    CurrentRow++;
-                }
-            }
-        }
+        Restride(columns);
+        rows = num_rows;
+        columns = num_columns;
+        stride = num_columns;
+        Restride(MatrixLayout::LeadingDimension<Type>(num_rows, num_columns));
     }
-    
+
     void ReplaceRow(int num_row, const std::vector<Type> &new_row){
-#ifdef DEBUG
-        auto t = Timer("Matrix::ReplaceRow(const int num_row, const std::vector<Type> &new_row)");
-#endif
+        MATRIX_PROFILE("Matrix::ReplaceRow(const int num_row, const std::vector<Type> &new_row)");
         assert(new_row.size() == columns);
-        assert(num_row <= rows);
-        matrix[num_row] = new_row;
+        assert(num_row < rows);
+        (*this)[num_row] = new_row;
     }
-    
+
     void ReplaceColumn(int num_column, std::vector<Type> &new_column){
-#ifdef DEBUG
-        auto t = Timer("Matrix::ReplaceColumn(int num_column, std::vector<float> &new_column)");
-#endif
+        MATRIX_PROFILE("Matrix::ReplaceColumn(int num_column, std::vector<float> &new_column)");
         assert(new_column.size() == rows);
-        assert(num_column <= columns);
+        assert(num_column < columns);
         for (int i = 0; i < rows; i++)
-            for (int j = 0; j < columns; j++)
-                if (j == num_column)
-                    matrix[i][j] = new_column[i];
+            At(i, num_column) = new_column[i];
     }
 
     [[nodiscard]] bool IsDiagonalMatrix() const{
-#ifdef DEBUG
-        auto t = Timer("Matrix::IsDiagonalMatrix()");
-#endif
+        MATRIX_PROFILE("Matrix::IsDiagonalMatrix()");
         if (rows != columns)
         {
 #ifdef DEBUG
@@ -453,19 +730,11 @@ public:
 #endif
             return false;
         }
-        for (int i = 0; i < rows; i++)
-            for (int j = 0; j < columns; j++)
-            {
-                if ((i == j && matrix[i][j] == 0) || (i != j && matrix[i][j] != 0))
-                    return false;
-            }
-        return true;
+        return GetView().IsDiagonalMatrix();
     }
-    
+
     [[nodiscard]] bool IsUpperTriangleMatrix() const{
-#ifdef DEBUG
-        auto t = Timer("Matrix::IsUpperTriangleMatrix()");
-#endif
+        MATRIX_PROFILE("Matrix::IsUpperTriangleMatrix()");
         if (rows != columns)
         {
 #ifdef DEBUG
@@ -473,19 +742,11 @@ public:
 #endif
             return false;
         }
-        for (int i = 0; i < rows; i++)
-            for (int j = 0; j < columns; j++)
-            {
-                if (i > j && matrix[i][j] != 0)
-                    return false;
-            }
-        return true;
+        return GetView().IsUpperTriangleMatrix();
     }
-    
+
     [[nodiscard]] bool IsLowerTriangleMatrix() const{
-#ifdef DEBUG
-        auto t = Timer("Matrix::IsLowerTriangleMatrix()");
-#endif
+        MATRIX_PROFILE("Matrix::IsLowerTriangleMatrix()");
         if (rows != columns)
         {
 #ifdef DEBUG
@@ -493,19 +754,11 @@ public:
 #endif
             return false;
         }
-        for (int i = 0; i < rows; i++)
-            for (int j = 0; j < columns; j++)
-            {
-                if (i < j && matrix[i][j] != 0)
-                    return false;
-            }
-        return true;
+        return GetView().IsLowerTriangleMatrix();
     }
-    
+
     [[nodiscard]] bool IsIdentityMatrix() const{
-#ifdef DEBUG
-        auto t = Timer("Matrix::IsIdentityMatrix()");
-#endif
+        MATRIX_PROFILE("Matrix::IsIdentityMatrix()");
         if (rows != columns)
         {
 #ifdef DEBUG
@@ -513,13 +766,48 @@ public:
 #endif
             return false;
         }
+        return GetView().IsIdentityMatrix();
+    }
+
+    [[nodiscard]] MatrixAccumulatorT<Type> Sum() const{
+        MATRIX_PROFILE("Matrix::Sum()");
+        return MatrixDetail::SumElements(rows, columns, matrix, stride);
+    }
+
+    [[nodiscard]] Type Min() const{
+        MATRIX_PROFILE("Matrix::Min()");
+        return MatrixDetail::MinElement(rows, columns, matrix, stride);
+    }
+
+    [[nodiscard]] Type Max() const{
+        MATRIX_PROFILE("Matrix::Max()");
+        return MatrixDetail::MaxElement(rows, columns, matrix, stride);
+    }
+
+    [[nodiscard]] MatrixDetail::FactorType<Type> FrobeniusNorm() const{
+        MATRIX_PROFILE("Matrix::FrobeniusNorm()");
+        return std::sqrt(MatrixDetail::SquareSumElements(rows, columns, matrix, stride));
+    }
+
+    // Largest absolute row sum
+    [[nodiscard]] MatrixDetail::FactorType<Type> InfinityNorm() const{
+        MATRIX_PROFILE("Matrix::InfinityNorm()");
+        return MatrixDetail::MaxRowAbsSum(rows, columns, matrix, stride);
+    }
+
+    [[nodiscard]] MatrixAccumulatorT<Type> Trace() const{
+        MATRIX_PROFILE("Matrix::Trace()");
+        assert(rows == columns);
+        MatrixAccumulatorT<Type> sum = MatrixAccumulatorT<Type>(0);
         for (int i = 0; i < rows; i++)
-            for (int j = 0; j < columns; j++)
-            {
-                if ((i == j && matrix[i][j] != 1) || (i != j && matrix[i][j] != 0))
-                    return false;
-            }
-        return true;
+            sum += MatrixAccumulatorT<Type>(matrix[size_t(i) * stride + i]);
+        return sum;
+    }
+
+    // At most max_density of the entries are non-zero, i.e. a SparseMatrix would pay off
+    [[nodiscard]] bool IsSparseMatrix(double max_density = MatrixDetail::SparseDensityThreshold) const{
+        MATRIX_PROFILE("Matrix::IsSparseMatrix(double max_density)");
+        return GetView().IsSparseMatrix(max_density);
     }
 
     static Matrix T(Matrix matrix) {
@@ -562,197 +850,265 @@ public:
         return matrix;
     }
 
+    // Writes the binary matrix file format of MatrixFile.h; MatrixMapping opens it without copying
+    bool Save(const std::string &path) const{
+        MATRIX_PROFILE("Matrix::Save(const std::string &path)");
+        return MatrixDetail::SaveMatrix(GetView(), path);
+    }
+
+    // Reads a matrix file into this matrix (one copy out of the mapping); false leaves the matrix unchanged
+    bool Load(const std::string &path){
+        MATRIX_PROFILE("Matrix::Load(const std::string &path)");
+        MatrixMapping<Type> mapping;
+        if (!mapping.Open(path))
+            return false;
+        *this = mapping.GetView();
+        return true;
+    }
+
     void PrintMatrix(){
         std::cout << "\nPrinting matrix. Rows: " << rows << " Columns: " << columns <<"\n";
         for (int i = 0; i < rows; i++) {
             for (int j = 0; j < columns; j++)
-                std::cout << matrix[i][j];
+                std::cout << At(i, j);
             std::cout << "\n";
         }
         std::cout << "\n";
     }
-    
-    [[nodiscard]] float Determinant() const{
-#ifdef DEBUG
-        auto t = Timer("Matrix::Determinant()");
-#endif
-        assert(rows == columns);
-        if (rows == 1)
-            return matrix[0][0];
-        if (rows == 2)
-            return matrix[0][0] * matrix[1][1] - matrix[0][1] * matrix[1][0];
-
-        float det = 0;
-        int sign = 1;
-
-        for (int f = 0; f < rows; f++) {
-            auto temp = Copy();
-            temp.TrimMatrix(0, f);
-            det += sign * matrix[0][f] * temp.Determinant();
-            sign = -sign;
-        }
-        return det;
-    }
-    
-    bool Solve(std::vector<float> &solution, std::vector<float> &out_roots) const{
-#ifdef DEBUG
-        auto t = Timer("Matrix::Solve(std::vector<float> &solution, std::vector<float> &out_roots)");
-#endif
-        assert(solution.size() == rows);
-        float D = Determinant();
-        std::vector<float> Ds{};
 
-        if (D * D < 0.001) return false;
+    // Factored in Accumulator: double for integer matrices, float for 16 bit storage
+    template<typename Accumulator = MatrixDetail::FactorType<Type>>
+    [[nodiscard]] Accumulator Determinant() const{
+        MATRIX_PROFILE("Matrix::Determinant()");
+        return GetView().template Determinant<Accumulator>();
+    }
 
-        out_roots.clear();
-        for (int j = 0; j < columns; j++) {
-            auto temp = Copy();
-            temp.ReplaceColumn(j, solution);
-            Ds.emplace_back(temp.Determinant());
-        }
-        for (auto &Det: Ds)
-            out_roots.emplace_back(Det / D);
+    template<typename Accumulator = MatrixDetail::FactorType<Type>, typename T>
+    bool Solve(const std::vector<T> &solution, std::vector<T> &out_roots) const{
+        MATRIX_PROFILE("Matrix::Solve(const std::vector<T> &solution, std::vector<T> &out_roots)");
+        assert(solution.size() == rows);
+        LU<Accumulator> lu(*this);
+        if (lu.ReciprocalCondition() < std::numeric_limits<Accumulator>::epsilon())
+            return false;
 
+        std::vector<Accumulator> roots(solution.begin(), solution.end());
+        lu.Solve(roots);
+        out_roots.assign(roots.begin(), roots.end());
         return true;
     }
 
-    template<typename T>
-    Matrix operator+(const T &other) const {
-        Matrix temp(*this);
-        temp += other;
-        return temp;
+    // Solves A * X = RHS for every column of RHS with a single factorization
+    template<typename Accumulator = MatrixDetail::FactorType<Type>>
+    bool Solve(const Matrix &RHS, Matrix &out_roots) const{
+        MATRIX_PROFILE("Matrix::Solve(const Matrix &RHS, Matrix &out_roots)");
+        assert(RHS.rows == rows);
+        static_assert(MatrixDetail::IsFloatingV<Type>, "Matrix::Solve(Matrix) needs a floating point matrix");
+        LU<Accumulator> lu(*this);
+        if (lu.ReciprocalCondition() < std::numeric_limits<Accumulator>::epsilon())
+            return false;
+
+        if constexpr (std::is_same_v<Accumulator, Type>) {
+            out_roots = RHS;
+            return lu.Solve(out_roots);
+        }
+        else {
+            Matrix<Accumulator> roots = RHS.template Cast<Accumulator>();
+            if (!lu.Solve(roots))
+                return false;
+            out_roots = roots.template Cast<Type>();
+            return true;
+        }
     }
 
-    template<typename T>
-    Matrix operator-(const T &other) const {
-        Matrix temp(*this);
-        temp -= other;
-        return temp;
+    // Least-squares X minimizing ||A * X - RHS|| for a tall matrix of full column rank, through Householder QR.
+    // Returns false for a rank deficient matrix; keep a QR object to reuse the factorization
+    template<typename Accumulator = MatrixDetail::FactorType<Type>>
+    bool LeastSquares(const Matrix &RHS, Matrix &out_solution) const{
+        MATRIX_PROFILE("Matrix::LeastSquares(const Matrix &RHS, Matrix &out_solution)");
+        assert(RHS.rows == rows && rows >= columns);
+        static_assert(MatrixDetail::IsFloatingV<Type>, "Matrix::LeastSquares(Matrix) needs a floating point matrix");
+        QR<Accumulator> qr(*this);
+        if constexpr (std::is_same_v<Accumulator, Type>)
+            return qr.LeastSquares(RHS, out_solution);
+        else {
+            Matrix<Accumulator> solution;
+            if (!qr.LeastSquares(RHS.template Cast<Accumulator>(), solution))
+                return false;
+            out_solution = solution.template Cast<Type>();
+            return true;
+        }
     }
 
-    Matrix operator-() const {
-        Matrix temp(*this);
-        temp *= -1;
-        return temp;
+    template<typename Accumulator = MatrixDetail::FactorType<Type>, typename T>
+    bool LeastSquares(const std::vector<T> &RHS, std::vector<T> &out_solution) const{
+        MATRIX_PROFILE("Matrix::LeastSquares(const std::vector<T> &RHS, std::vector<T> &out_solution)");
+        assert(RHS.size() == rows && rows >= columns);
+        QR<Accumulator> qr(*this);
+        std::vector<Accumulator> solution;
+        if (!qr.LeastSquares(std::vector<Accumulator>(RHS.begin(), RHS.end()), solution))
+            return false;
+        out_solution.assign(solution.begin(), solution.end());
+        return true;
     }
 
-    template<typename T>
-    Matrix operator*(const T &other) const {
-        Matrix temp(*this);
-        temp *= other;
-        return temp;
+    Matrix operator*(const Matrix &other) const {
+        MATRIX_PROFILE("Matrix::operator*(const Matrix &other)");
+        assert(columns == other.rows);
+        if constexpr (!std::is_same_v<MatrixAccumulatorT<Type>, Type>) {
+            // Storage narrower than the accumulator, e.g. Float16: widened while packing, rounded once at the end
+            Matrix temp(rows, other.columns);
+            MatrixDetail::GemmMixed<MatrixAccumulatorT<Type>>(rows, other.columns, columns, matrix, stride, 1,
+                                                             other.matrix, other.stride, 1, temp.matrix, temp.stride);
+            return temp;
+        }
+        else {
+            if (MatrixDetail::SparseProductPaysOff(*this, other))
+                return MatrixDetail::SparseProduct(*this, other);
+            Matrix temp(rows, other.columns);
+            if (!MatrixDetail::StrassenMultiply(rows, other.columns, columns, matrix, stride, other.matrix, other.stride, temp.matrix, temp.stride))
+                MatrixDetail::Gemm(rows, other.columns, columns, matrix, stride, other.matrix, other.stride, temp.matrix, temp.stride);
+            return temp;
+        }
     }
 
-    template<typename T>
-    Matrix operator/(const T &other) const {
-        Matrix temp(*this);
-        temp /= other;
-        return temp;
+    Matrix operator/(const Matrix &other) const {
+        return *this * Inverse(other);
     }
 
     Matrix &operator+=(const Matrix &other) {
         assert(columns == other.columns && rows == other.rows);
-        for (int i = 0; i < rows; i++)
-            matrix[i] += other.matrix[i];
+        MatrixDetail::TransformElements(rows, columns, matrix, stride, other.matrix, other.stride,
+                                        [](Type &element, Type value) { element += value; });
         return *this;
     }
 
     Matrix &operator-=(const Matrix &other) {
         assert(columns == other.columns && rows == other.rows);
-        for (int i = 0; i < rows; i++)
-            matrix[i] -= other.matrix[i];
+        MatrixDetail::TransformElements(rows, columns, matrix, stride, other.matrix, other.stride,
+                                        [](Type &element, Type value) { element -= value; });
         return *this;
     }
 
+    template<typename Derived>
+    Matrix &operator+=(const MatrixExpression<Derived> &expression) {
+        return *this = *this + expression.Self();
+    }
+
+    template<typename Derived>
+    Matrix &operator-=(const MatrixExpression<Derived> &expression) {
+        return *this = *this - expression.Self();
+    }
+
     Matrix &operator*=(const Matrix &other) {
-        auto temp = Matrix(rows, other.columns);
-        for (int i = 0; i < rows; i++)
-            for (int j = 0; j < other.columns; j++) {
-                temp.matrix[i][j] = Type();
-                for (int k = 0; k < other.rows; k++)
-                    temp.matrix[i][j] += matrix[i][k] * other.matrix[k][j];
-            }
-        AllocMatrixData(temp.rows, temp.columns);
-        matrix = temp.matrix;
+        MATRIX_PROFILE("Matrix::operator*=(const Matrix &other)");
+        *this = *this * other;
         return *this;
     }
 
     Matrix &operator/=(const Matrix &other) {
-        Matrix temp = other.Copy();
-        temp.Inverse();
-        Matrix origin(*this);
-        origin *= temp;
-        return origin;
+        *this *= Inverse(other);
+        return *this;
     }
 
-    template<typename T>
+    template<typename T, std::enable_if_t<MatrixDetail::IsScalarV<T>, int> = 0>
     Matrix &operator+=(const T value) {
-        for (auto &line : matrix)
-            line += value;
+        MatrixDetail::TransformElements(rows, columns, matrix, stride, [value](Type &element) { element += value; });
         return *this;
     }
 
-    template<typename T>
+    template<typename T, std::enable_if_t<MatrixDetail::IsScalarV<T>, int> = 0>
     Matrix &operator-=(const T value) {
-        for (auto &line : matrix)
-            line -= value;
+        MatrixDetail::TransformElements(rows, columns, matrix, stride, [value](Type &element) { element -= value; });
         return *this;
     }
 
-    template<typename T>
+    template<typename T, std::enable_if_t<MatrixDetail::IsScalarV<T>, int> = 0>
     Matrix &operator*=(const T value) {
-        for (ProxyVector<Type> &line : matrix)
-            line *= value;
+        MatrixDetail::TransformElements(rows, columns, matrix, stride, [value](Type &element) { element *= value; });
         return *this;
     }
 
-    template<typename T>
+    template<typename T, std::enable_if_t<MatrixDetail::IsScalarV<T>, int> = 0>
     Matrix &operator/=(const T value) {
-        for (auto &line : matrix)
-            line /= value;
+        MatrixDetail::TransformElements(rows, columns, matrix, stride, [value](Type &element) { element /= value; });
         return *this;
     }
 
-    bool operator==(Matrix &other) const {
-        bool SizeEquality = columns == other.columns && rows == other.rows;
-        bool ValuesEquality = true;
-        for (int i = 0; i < rows; i++)
-            if (matrix[i] != other[i]) {
-                ValuesEquality = false;
-                break;
-            }
-        return SizeEquality && ValuesEquality;
+    bool operator==(const Matrix &other) const {
+        MATRIX_PROFILE("Matrix::operator==(const Matrix &other)");
+        if (columns != other.columns || rows != other.rows)
+            return false;
+        return MatrixDetail::EqualElements(rows, columns, matrix, stride, other.matrix, other.stride);
+    }
+
+    bool operator!=(const Matrix &other) const {
+        return !(*this == other);
     }
 
-    bool operator!=(Matrix &other) const {
-        return !(*this->operator==(other));
+    // Element-wise |a - b| <= epsilon * max(1, |a|, |b|), i.e. relative for large values and absolute near zero
+    [[nodiscard]] bool IsApprox(const Matrix &other, MatrixDetail::FactorType<Type> epsilon = MatrixDetail::ApproxEpsilon<Type>()) const{
+        MATRIX_PROFILE("Matrix::IsApprox(const Matrix &other, FactorType<Type> epsilon)");
+        if (columns != other.columns || rows != other.rows)
+            return false;
+        return MatrixDetail::ApproxElements(rows, columns, matrix, stride, other.matrix, other.stride, epsilon);
+    }
+
+    // Element-wise at most max_ulps representable values apart (plain difference for integers)
+    [[nodiscard]] bool IsApproxUlps(const Matrix &other, int max_ulps = 4) const{
+        MATRIX_PROFILE("Matrix::IsApproxUlps(const Matrix &other, int max_ulps)");
+        if (columns != other.columns || rows != other.rows)
+            return false;
+        return MatrixDetail::UlpElements(rows, columns, matrix, stride, other.matrix, other.stride, max_ulps);
     }
 
-    template<typename NewType>
-    Matrix<NewType> MultiplyMixed(const Matrix<NewType> &right)
+    /*
+     * Product with a matrix of another element type. The result type defaults to MatrixPromote of the
+     * two and the sums are carried in Accumulator, e.g. A.MultiplyMixed<Float16, double>(B).
+     */
+    template<typename Result = void, typename Accumulator = void, typename Right>
+    auto MultiplyMixed(const Matrix<Right> &right) const
     {
-        Matrix<NewType> temp(GetRows(), right.GetColumns());
-        for (int i = 0; i < GetRows(); i++)
-            for (int j = 0; j < right.GetColumns(); j++) {
-                for (int k = 0; k < right.GetRows(); k++)
-                    temp[i][j] += matrix[i][k] * right[k][j];
-            }
+        MATRIX_PROFILE("Matrix::MultiplyMixed(const Matrix<Right> &right)");
+        using ResultType = std::conditional_t<std::is_void_v<Result>, MatrixPromoteT<Type, Right>, Result>;
+        using AccumulatorType = std::conditional_t<std::is_void_v<Accumulator>, MatrixAccumulatorT<ResultType>, Accumulator>;
+        assert(columns == right.GetRows());
+        Matrix<ResultType> temp(GetRows(), right.GetColumns());
+        MatrixDetail::GemmMixed<AccumulatorType>(rows, right.GetColumns(), columns, matrix, stride, 1,
+                                                 right.Data(), right.GetStride(), 1, temp.Data(), temp.GetStride());
         return temp;
     }
 
-    ProxyVector<Type> &operator[](const int idx) {
-        assert(idx < matrix.size());
-        return matrix[idx];
+    // Element-wise conversion, e.g. A.Cast<Float16>() halves the storage of a float matrix
+    template<typename To>
+    [[nodiscard]] Matrix<To> Cast() const{
+        MATRIX_PROFILE("Matrix::Cast()");
+        Matrix<To> temp(rows, columns);
+        for (int i = 0; i < rows; i++)
+            MatrixDetail::ConvertElements(RowPtr(i), temp.Data() + size_t(i) * temp.GetStride(), size_t(columns));
+        return temp;
+    }
+
+    RowView<Type> operator[](const int idx) {
+        assert(idx < rows);
+        return RowView<Type>(RowPtr(idx), columns);
     }
 
-    ProxyVector<Type> operator[](const int idx) const {
-        assert(idx < matrix.size());
-        return matrix[idx];
+    RowView<const Type> operator[](const int idx) const {
+        assert(idx < rows);
+        return RowView<const Type>(RowPtr(idx), columns);
     }
 };
 
-template<typename Type>
-inline Matrix<Type> operator*(const float Value, const Matrix<Type> &other)
-{
-    return other * Value;
-}
+#include "MatrixView.h"
+#include "MatrixSparse.h"
+#include "MatrixFile.h"
+#include "MatrixOutOfCore.h"
+#include "MatrixLU.h"
+#include "MatrixCholesky.h"
+#include "MatrixQR.h"
+#include "MatrixBatch.h"
+#include "MatrixVector.h"
+#include "MatrixStrassen.h"
+#include "MatrixIterative.h"
+#include "MatrixAsync.h"
+#include "MatrixFixed.h"
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include "MatrixMemory.h"
+
+/*
+ * Where matrix buffers come from. Every Matrix remembers the resource it was created with and
+ * returns its buffer there; moves carry the resource along with the buffer. New matrices use the
+ * calling thread's current resource, which is the aligned heap unless a MatrixResourceScope is active.
+ * All blocks are MatrixDetail::Alignment aligned.
+ */
+class MatrixMemoryResource {
+
+public:
+    virtual ~MatrixMemoryResource() = default;
+    virtual void *Allocate(size_t bytes) = 0;
+    virtual void Deallocate(void *ptr, size_t bytes) = 0;
+};
+
+class MatrixHeapResource : public MatrixMemoryResource {
+
+public:
+    void *Allocate(size_t bytes) override { return MatrixDetail::AllocAligned<unsigned char>(bytes); }
+    void Deallocate(void *ptr, size_t) override { MatrixDetail::FreeAligned(static_cast<unsigned char *>(ptr)); }
+};
+
+namespace MatrixDetail {
+    inline MatrixMemoryResource *HeapResource(){
+        static MatrixHeapResource resource;
+        return &resource;
+    }
+
+    inline MatrixMemoryResource *&CurrentResource(){
+        thread_local MatrixMemoryResource *resource = HeapResource();
+        return resource;
+    }
+
+    inline size_t AlignUp(size_t bytes){
+        return (bytes + Alignment - 1) / Alignment * Alignment;
+    }
+}
+
+// Makes resource the current one of this thread until the scope ends
+class MatrixResourceScope {
+
+private:
+    MatrixMemoryResource *previous;
+
+public:
+    explicit MatrixResourceScope(MatrixMemoryResource &resource) : previous(MatrixDetail::CurrentResource()){
+        MatrixDetail::CurrentResource() = &resource;
+    }
+
+    MatrixResourceScope(const MatrixResourceScope &) = delete;
+    MatrixResourceScope &operator=(const MatrixResourceScope &) = delete;
+
+    ~MatrixResourceScope(){
+        MatrixDetail::CurrentResource() = previous;
+    }
+};
+
+/*
+ * Bump-pointer arena: allocation is a pointer increment and deallocation does nothing; memory comes
+ * back all at once with Reset(). After a Reset() the arena keeps one chunk large enough for everything
+ * the previous cycle used, so a repeating workload stops calling the upstream resource.
+ * Not thread-safe, and matrices must not outlive the Reset() or the arena.
+ */
+class MatrixArena : public MatrixMemoryResource {
+
+private:
+    struct Chunk {
+        Chunk *next;
+        size_t bytes;
+    };
+
+    static constexpr size_t HeaderBytes = MatrixDetail::Alignment;
+    static_assert(sizeof(Chunk) <= HeaderBytes);
+
+    MatrixMemoryResource *upstream;
+    size_t chunk_bytes;
+    Chunk *chunks = nullptr;
+    unsigned char *cursor = nullptr;
+    unsigned char *end = nullptr;
+    size_t used = 0;
+    size_t peak = 0;
+
+    void AddChunk(size_t bytes){
+        bytes = MatrixDetail::AlignUp(bytes) + HeaderBytes;
+        auto *chunk = static_cast<Chunk *>(upstream->Allocate(bytes));
+        chunk->next = chunks;
+        chunk->bytes = bytes;
+        chunks = chunk;
+        cursor = reinterpret_cast<unsigned char *>(chunk) + HeaderBytes;
+        end = reinterpret_cast<unsigned char *>(chunk) + bytes;
+    }
+
+    void FreeChunks(){
+        while (chunks) {
+            Chunk *next = chunks->next;
+            upstream->Deallocate(chunks, chunks->bytes);
+            chunks = next;
+        }
+        cursor = end = nullptr;
+    }
+
+public:
+    explicit MatrixArena(size_t ChunkBytes = size_t(1) << 20, MatrixMemoryResource *Upstream = MatrixDetail::HeapResource())
+        : upstream(Upstream), chunk_bytes(ChunkBytes) {}
+
+    MatrixArena(const MatrixArena &) = delete;
+    MatrixArena &operator=(const MatrixArena &) = delete;
+
+    ~MatrixArena() override{
+        FreeChunks();
+    }
+
+    void *Allocate(size_t bytes) override{
+        bytes = MatrixDetail::AlignUp(bytes);
+        if (size_t(end - cursor) < bytes)
+            AddChunk(std::max(chunk_bytes, bytes));
+        void *ptr = cursor;
+        cursor += bytes;
+        used += bytes;
+        peak = std::max(peak, used);
+        return ptr;
+    }
+
+    void Deallocate(void *, size_t) override {}
+
+    // Releases every allocation at once
+    void Reset(){
+        if (chunks && chunks->next) {
+            FreeChunks();
+            AddChunk(std::max(chunk_bytes, peak));
+        }
+        else if (chunks)
+            cursor = reinterpret_cast<unsigned char *>(chunks) + HeaderBytes;
+        used = 0;
+    }
+
+    [[nodiscard]] size_t GetUsedBytes() const { return used; }
+};
+
+/*
+ * Size-class pool: requests are rounded up to a power of two and freed blocks are kept on a free
+ * list per class, so a steady stream of same-sized matrices is served without touching the upstream
+ * resource. Blocks above MaxPooledBytes go straight to the upstream resource. Thread-safe.
+ */
+class MatrixPool : public MatrixMemoryResource {
+
+private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    static constexpr int MinClass = 6;
+    static constexpr int MaxClass = 28;
+
+    MatrixMemoryResource *upstream;
+    FreeBlock *free_lists[MaxClass + 1] = {};
+    std::mutex mutex;
+
+    static int SizeClass(size_t bytes){
+        int size_class = MinClass;
+        while ((size_t(1) << size_class) < bytes)
+            size_class++;
+        return size_class;
+    }
+
+public:
+    static constexpr size_t MaxPooledBytes = size_t(1) << MaxClass;
+
+    explicit MatrixPool(MatrixMemoryResource *Upstream = MatrixDetail::HeapResource()) : upstream(Upstream) {}
+
+    MatrixPool(const MatrixPool &) = delete;
+    MatrixPool &operator=(const MatrixPool &) = delete;
+
+    ~MatrixPool() override{
+        Release();
+    }
+
+    void *Allocate(size_t bytes) override{
+        if (bytes > MaxPooledBytes)
+            return upstream->Allocate(bytes);
+        int size_class = SizeClass(bytes);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (FreeBlock *block = free_lists[size_class]) {
+                free_lists[size_class] = block->next;
+                return block;
+            }
+        }
+        return upstream->Allocate(size_t(1) << size_class);
+    }
+
+    void Deallocate(void *ptr, size_t bytes) override{
+        if (!ptr)
+            return;
+        if (bytes > MaxPooledBytes) {
+            upstream->Deallocate(ptr, bytes);
+            return;
+        }
+        int size_class = SizeClass(bytes);
+        auto *block = static_cast<FreeBlock *>(ptr);
+        std::lock_guard<std::mutex> lock(mutex);
+        block->next = free_lists[size_class];
+        free_lists[size_class] = block;
+    }
+
+    // Hands every cached block back to the upstream resource
+    void Release(){
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int size_class = MinClass; size_class <= MaxClass; size_class++)
+            while (FreeBlock *block = free_lists[size_class]) {
+                free_lists[size_class] = block->next;
+                upstream->Deallocate(block, size_t(1) << size_class);
+            }
+    }
+};
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Matrix.h"
+
+/*
+ * Asynchronous Matrix pipelines. Every operation recorded through MatrixAsync (or on MatrixFutures)
+ * becomes a node of a DAG and returns a MatrixFuture at once. A node goes to the thread pool as soon
+ * as its last input finishes, so independent branches - A * B and C * D - overlap, and only Get()
+ * blocks. The blocked thread keeps running queued pool work, which also makes a single-threaded pool
+ * work: everything then runs inside Get().
+ *
+ * Results are allocated from a MatrixPool owned by the graph. A finished node drops its inputs, so an
+ * intermediate that no future refers to any more is freed the moment its last consumer is done and
+ * its buffer is handed to the next node of a similar size instead of going back to the heap.
+ */
+namespace MatrixDetail {
+    struct AsyncState {
+        MatrixPool pool;
+    };
+
+    class AsyncNodeBase : public std::enable_shared_from_this<AsyncNodeBase> {
+
+    private:
+        std::mutex mutex;
+        std::vector<std::shared_ptr<AsyncNodeBase>> dependents{};
+        // Unfinished inputs, plus one held by the recorder until all inputs are linked
+        std::atomic<int> pending{1};
+        std::atomic<bool> done{false};
+
+        virtual void Execute() = 0;
+
+    public:
+        virtual ~AsyncNodeBase() = default;
+
+        [[nodiscard]] bool IsDone() const { return done.load(std::memory_order_acquire); }
+
+        // Makes this node wait for input; nothing to wait for if input has already finished
+        void DependOn(AsyncNodeBase &input){
+            pending.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(input.mutex);
+            if (input.IsDone())
+                pending.fetch_sub(1, std::memory_order_relaxed);
+            else
+                input.dependents.push_back(shared_from_this());
+        }
+
+        // One call per finished input and one by the recorder; the last queues the node
+        void Release(){
+            if (pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+            std::shared_ptr<AsyncNodeBase> self = shared_from_this();
+            MatrixThreadPool::Instance().Submit([self] { self->Run(); });
+        }
+
+        void Run(){
+            Execute();
+            Finish();
+        }
+
+        void Finish(){
+            std::vector<std::shared_ptr<AsyncNodeBase>> ready;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                done.store(true, std::memory_order_release);
+                ready.swap(dependents);
+            }
+            for (auto &node : ready)
+                node->Release();
+        }
+    };
+
+    template<typename Type>
+    struct AsyncNode : AsyncNodeBase {
+        // Declared before result, so the pool outlives the buffer it holds
+        std::shared_ptr<AsyncState> state;
+        Matrix<Type> result{};
+        std::function<Matrix<Type>()> body{};
+
+        explicit AsyncNode(std::shared_ptr<AsyncState> State) : state(std::move(State)) {}
+
+        void Execute() override{
+            MatrixResourceScope scope(state->pool);
+            result = body();
+            body = nullptr;
+        }
+    };
+
+    // Element type of what a node function returns: a Matrix or an unevaluated expression
+    template<typename Result>
+    struct AsyncValue { using type = typename Result::ValueType; };
+
+    template<typename Type>
+    struct AsyncValue<Matrix<Type>> { using type = Type; };
+
+    template<typename Function, typename... Inputs>
+    using AsyncResultType = typename AsyncValue<std::decay_t<std::invoke_result_t<Function, const Matrix<Inputs> &...>>>::type;
+
+    template<typename Function, typename... Inputs>
+    MatrixFuture<AsyncResultType<Function, Inputs...>> Record(const std::shared_ptr<AsyncState> &state, Function function,
+                                                              const MatrixFuture<Inputs> &...inputs){
+        using Type = AsyncResultType<Function, Inputs...>;
+        auto node = std::make_shared<AsyncNode<Type>>(state);
+        node->body = [function = std::move(function), sources = std::make_tuple(inputs.node...)]() -> Matrix<Type> {
+            return std::apply([&function](const auto &...source) { return Matrix<Type>(function(source->result...)); }, sources);
+        };
+        (node->DependOn(*inputs.node), ...);
+        node->Release();
+        return MatrixFuture<Type>(std::move(node));
+    }
+}
+
+// Handle to the result of a recorded operation; copies share the same node
+template<typename Type>
+class MatrixFuture {
+
+    friend class MatrixAsync;
+
+    template<typename Function, typename... Inputs>
+    friend MatrixFuture<MatrixDetail::AsyncResultType<Function, Inputs...>> MatrixDetail::Record(
+        const std::shared_ptr<MatrixDetail::AsyncState> &, Function, const MatrixFuture<Inputs> &...);
+
+    template<typename OtherType>
+    friend class MatrixFuture;
+
+private:
+    std::shared_ptr<MatrixDetail::AsyncNode<Type>> node{};
+
+    explicit MatrixFuture(std::shared_ptr<MatrixDetail::AsyncNode<Type>> Node) : node(std::move(Node)) {}
+
+public:
+    MatrixFuture() = default;
+
+    [[nodiscard]] bool IsValid() const { return node != nullptr; }
+    [[nodiscard]] bool IsReady() const { return node && node->IsDone(); }
+
+    // Blocks until the result exists, running queued pool work meanwhile
+    void Wait() const{
+        assert(node);
+        if (!node->IsDone()) {
+            MATRIX_PROFILE("MatrixFuture::Wait()");
+            MatrixThreadPool::Instance().WaitUntil([this] { return node->IsDone(); });
+        }
+    }
+
+    // The result stays owned by the graph; copy it to keep it past the last future
+    const Matrix<Type> &Get() const{
+        Wait();
+        return node->result;
+    }
+
+    // Records function(result, others.Get()...) in this future's graph, e.g. F.Then([](const Matrix<float> &m) { return m * 2.0f; })
+    template<typename Function, typename... Others>
+    auto Then(Function function, const MatrixFuture<Others> &...others) const{
+        assert(node && ((others.node && others.node->state == node->state) && ...));
+        return MatrixDetail::Record(node->state, std::move(function), *this, others...);
+    }
+};
+
+/*
+ * Records operations into one graph. Inputs are copied or moved into ready nodes, so the caller may
+ * change or destroy its matrices right after recording. Futures keep the graph alive.
+ */
+class MatrixAsync {
+
+private:
+    std::shared_ptr<MatrixDetail::AsyncState> state = std::make_shared<MatrixDetail::AsyncState>();
+
+public:
+    template<typename Type>
+    MatrixFuture<Type> Input(Matrix<Type> matrix){
+        auto node = std::make_shared<MatrixDetail::AsyncNode<Type>>(state);
+        node->result = std::move(matrix);
+        node->Finish();
+        return MatrixFuture<Type>(std::move(node));
+    }
+
+    // A node computing function(inputs.Get()...), which may return a Matrix or an expression
+    template<typename Function, typename... Inputs>
+    auto Then(Function function, const MatrixFuture<Inputs> &...inputs){
+        return MatrixDetail::Record(state, std::move(function), inputs...);
+    }
+};
+
+// Arithmetic on futures records a node in the graph of the left operand; both must belong to one graph
+template<typename Type>
+MatrixFuture<Type> operator*(const MatrixFuture<Type> &lhs, const MatrixFuture<Type> &rhs){
+    return lhs.Then([](const Matrix<Type> &a, const Matrix<Type> &b) { return a * b; }, rhs);
+}
+
+template<typename Type>
+MatrixFuture<Type> operator+(const MatrixFuture<Type> &lhs, const MatrixFuture<Type> &rhs){
+    return lhs.Then([](const Matrix<Type> &a, const Matrix<Type> &b) { return a + b; }, rhs);
+}
+
+template<typename Type>
+MatrixFuture<Type> operator-(const MatrixFuture<Type> &lhs, const MatrixFuture<Type> &rhs){
+    return lhs.Then([](const Matrix<Type> &a, const Matrix<Type> &b) { return a - b; }, rhs);
+}
+
+template<typename Type, typename Scalar, std::enable_if_t<MatrixDetail::IsScalarV<Scalar>, int> = 0>
+MatrixFuture<Type> operator*(const MatrixFuture<Type> &lhs, const Scalar &rhs){
+    return lhs.Then([scalar = rhs](const Matrix<Type> &a) { return a * scalar; });
+}
+
+template<typename Scalar, typename Type, std::enable_if_t<MatrixDetail::IsScalarV<Scalar>, int> = 0>
+MatrixFuture<Type> operator*(const Scalar &lhs, const MatrixFuture<Type> &rhs){
+    return rhs * lhs;
+}
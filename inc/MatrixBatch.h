@@ -0,0 +1,457 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include "Matrix.h"
+
+/*
+ * Many independent matrices of one shape, stored structure-of-arrays. Matrices are interleaved in
+ * groups of Lanes (16 float / 8 double, one cache line per element): element (i, j) of the Lanes
+ * matrices of a group is a contiguous, aligned run, so every batched kernel works on a whole group
+ * with full-width SIMD instructions and no shuffles.
+ *
+ *   group g: [ (0,0) of matrices g*L .. g*L+L-1 | (0,1) of the same matrices | ... | (R-1,C-1) ]
+ *
+ * 2x2, 3x3 and 4x4 inverse, determinant and solve use closed-form cofactor expansions evaluated
+ * lane-wise; larger shapes fall back to a pivoted LU per matrix. Kernels are compiled for the
+ * widest ISA found at runtime and split over the thread pool for large batches.
+ */
+namespace MatrixDetail {
+    template<typename Type>
+    constexpr int BatchLanes = int(Alignment / sizeof(Type)) > 0 ? int(Alignment / sizeof(Type)) : 1;
+
+    constexpr long long BatchParallelThreshold = 1 << 16;
+
+    // Per-thread scratch for the inverses BatchSolve applies group by group
+    inline Workspace &BatchWorkspace(){
+        thread_local Workspace workspace;
+        return workspace;
+    }
+
+    template<typename Function>
+    void BatchRunGeneric(int begin, int end, Function &body){
+        for (int g = begin; g < end; g++)
+            body(g);
+    }
+
+#ifdef MATRIX_X86_DISPATCH
+    // flatten pulls the group kernel into these bodies, so it is vectorized for the wider ISA
+    template<typename Function>
+    __attribute__((target("avx2,fma"), flatten))
+    void BatchRunAVX2(int begin, int end, Function &body){
+        for (int g = begin; g < end; g++)
+            body(g);
+    }
+
+    template<typename Function>
+    __attribute__((target("avx512f,prefer-vector-width=512"), flatten))
+    void BatchRunAVX512(int begin, int end, Function &body){
+        for (int g = begin; g < end; g++)
+            body(g);
+    }
+#endif
+
+    // Runs body(group) for every group with the widest available ISA, in parallel once the work is worth it
+    template<typename Function>
+    void BatchForGroups(int groups, long long work_per_group, Function &&body){
+        auto run = [&body](int begin, int end) {
+#ifdef MATRIX_X86_DISPATCH
+            switch (ActiveGemmIsa()) {
+                case GemmIsa::AVX512: BatchRunAVX512(begin, end, body); return;
+                case GemmIsa::AVX2: BatchRunAVX2(begin, end, body); return;
+                default: break;
+            }
+#endif
+            BatchRunGeneric(begin, end, body);
+        };
+        MatrixThreadPool &pool = MatrixThreadPool::Instance();
+        long long work = (long long)groups * work_per_group;
+        if (work < BatchParallelThreshold || pool.GetThreadCount() == 1) {
+            run(0, groups);
+            return;
+        }
+        int grain = int(std::max(1LL, BatchParallelThreshold / std::max(1LL, work_per_group)));
+        pool.ParallelFor(0, groups, grain, run);
+    }
+
+    // C = A * B for one group; M, K, N are compile-time shapes when non-zero, runtime m, k, n otherwise
+    template<typename Type, int L, int M, int K, int N>
+    void BatchMultiplyGroup(const Type *A, const Type *B, Type *C, int m, int k, int n){
+        const int mm = M ? M : m, kk = K ? K : k, nn = N ? N : n;
+        for (int i = 0; i < mm; i++)
+            for (int j = 0; j < nn; j++) {
+                alignas(64) Type acc[L] = {};
+                for (int p = 0; p < kk; p++) {
+                    const Type *a = A + (i * kk + p) * L;
+                    const Type *b = B + (p * nn + j) * L;
+                    for (int l = 0; l < L; l++)
+                        acc[l] += a[l] * b[l];
+                }
+                Type *c = C + (i * nn + j) * L;
+                for (int l = 0; l < L; l++)
+                    c[l] = acc[l];
+            }
+    }
+
+    template<typename Type>
+    Type BatchSingularThreshold(Type largest, int n){
+        Type scale = Type(1);
+        for (int i = 0; i < n; i++)
+            scale *= largest;
+        return scale * Type(n) * std::numeric_limits<Type>::epsilon();
+    }
+
+    /*
+     * Determinant and adjugate of N x N (N <= 4) for every lane of a group. Lanes whose determinant
+     * is negligible against the largest entry are flagged singular. With Inverse == nullptr only
+     * the determinants are computed.
+     */
+    template<typename Type, int L, int N>
+    void BatchInverseGroup(const Type *A, Type *Inverse, Type *Determinant, bool *Singular){
+        static_assert(N >= 1 && N <= 4, "Closed-form batch kernels cover 1x1 to 4x4");
+        // The lane loop stays branch-free so it vectorizes; results are written out afterwards
+        alignas(64) Type adjugate[N * N][L];
+        alignas(64) Type determinant[L];
+        alignas(64) Type scale[L];
+        for (int l = 0; l < L; l++) {
+            Type a[N * N];
+            Type largest = Type(0);
+            for (int e = 0; e < N * N; e++) {
+                a[e] = A[e * L + l];
+                largest = std::max(largest, std::abs(a[e]));
+            }
+            Type det;
+            Type b[N * N];
+            if constexpr (N == 1) {
+                det = a[0];
+                b[0] = Type(1);
+            }
+            else if constexpr (N == 2) {
+                det = a[0] * a[3] - a[1] * a[2];
+                b[0] = a[3]; b[1] = -a[1];
+                b[2] = -a[2]; b[3] = a[0];
+            }
+            else if constexpr (N == 3) {
+                b[0] = a[4] * a[8] - a[5] * a[7];
+                b[1] = a[2] * a[7] - a[1] * a[8];
+                b[2] = a[1] * a[5] - a[2] * a[4];
+                b[3] = a[5] * a[6] - a[3] * a[8];
+                b[4] = a[0] * a[8] - a[2] * a[6];
+                b[5] = a[2] * a[3] - a[0] * a[5];
+                b[6] = a[3] * a[7] - a[4] * a[6];
+                b[7] = a[1] * a[6] - a[0] * a[7];
+                b[8] = a[0] * a[4] - a[1] * a[3];
+                det = a[0] * b[0] + a[1] * b[3] + a[2] * b[6];
+            }
+            else {
+                // 2x2 minors of the top two rows (s) and the bottom two rows (c)
+                Type s0 = a[0] * a[5] - a[4] * a[1], s1 = a[0] * a[6] - a[4] * a[2];
+                Type s2 = a[0] * a[7] - a[4] * a[3], s3 = a[1] * a[6] - a[5] * a[2];
+                Type s4 = a[1] * a[7] - a[5] * a[3], s5 = a[2] * a[7] - a[6] * a[3];
+                Type c5 = a[10] * a[15] - a[14] * a[11], c4 = a[9] * a[15] - a[13] * a[11];
+                Type c3 = a[9] * a[14] - a[13] * a[10], c2 = a[8] * a[15] - a[12] * a[11];
+                Type c1 = a[8] * a[14] - a[12] * a[10], c0 = a[8] * a[13] - a[12] * a[9];
+                det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+                b[0] = a[5] * c5 - a[6] * c4 + a[7] * c3;
+                b[1] = -a[1] * c5 + a[2] * c4 - a[3] * c3;
+                b[2] = a[13] * s5 - a[14] * s4 + a[15] * s3;
+                b[3] = -a[9] * s5 + a[10] * s4 - a[11] * s3;
+                b[4] = -a[4] * c5 + a[6] * c2 - a[7] * c1;
+                b[5] = a[0] * c5 - a[2] * c2 + a[3] * c1;
+                b[6] = -a[12] * s5 + a[14] * s2 - a[15] * s1;
+                b[7] = a[8] * s5 - a[10] * s2 + a[11] * s1;
+                b[8] = a[4] * c4 - a[5] * c2 + a[7] * c0;
+                b[9] = -a[0] * c4 + a[1] * c2 - a[3] * c0;
+                b[10] = a[12] * s4 - a[13] * s2 + a[15] * s0;
+                b[11] = -a[8] * s4 + a[9] * s2 - a[11] * s0;
+                b[12] = -a[4] * c3 + a[5] * c1 - a[6] * c0;
+                b[13] = a[0] * c3 - a[1] * c1 + a[2] * c0;
+                b[14] = -a[12] * s3 + a[13] * s1 - a[14] * s0;
+                b[15] = a[8] * s3 - a[9] * s1 + a[10] * s0;
+            }
+            for (int e = 0; e < N * N; e++)
+                adjugate[e][l] = b[e];
+            determinant[l] = det;
+            scale[l] = std::abs(det) <= BatchSingularThreshold(largest, N) ? Type(0) : Type(1) / det;
+        }
+        if (Determinant)
+            std::copy(determinant, determinant + L, Determinant);
+        if (Singular)
+            for (int l = 0; l < L; l++)
+                Singular[l] = scale[l] == Type(0);
+        if (Inverse)
+            for (int e = 0; e < N * N; e++)
+                for (int l = 0; l < L; l++)
+                    Inverse[e * L + l] = adjugate[e][l] * scale[l];
+    }
+
+    // Copies matrix `lane` of a group into / out of a dense row-major n x m buffer
+    template<typename Type, int L>
+    void BatchGather(const Type *group, int lane, int elements, Type *out){
+        for (int e = 0; e < elements; e++)
+            out[e] = group[e * L + lane];
+    }
+
+    template<typename Type, int L>
+    void BatchScatter(const Type *in, int elements, int lane, Type *group){
+        for (int e = 0; e < elements; e++)
+            group[e * L + lane] = in[e];
+    }
+
+    // Pivoted LU per lane for shapes without a closed form; same outputs as BatchInverseGroup
+    template<typename Type, int L>
+    void BatchInverseGroupLU(int n, const Type *A, Type *Inverse, Type *Determinant, bool *Singular){
+        WorkspaceLease lease(PivotWorkspace());
+        Type *buffer = lease.Get<Type>(size_t(n) * n + n);
+        int *pivots = reinterpret_cast<int *>(buffer + size_t(n) * n);
+        for (int l = 0; l < L; l++) {
+            BatchGather<Type, L>(A, l, n * n, buffer);
+            int sign = LUFactor(n, buffer, n, pivots);
+            bool singular = sign == 0 || LUIsSingular(n, buffer, n);
+            Type det = Type(sign);
+            for (int i = 0; i < n; i++)
+                det *= buffer[size_t(i) * n + i];
+            if (Determinant)
+                Determinant[l] = det;
+            if (Singular)
+                Singular[l] = singular;
+            if (Inverse) {
+                if (singular)
+                    std::fill(buffer, buffer + size_t(n) * n, Type(0));
+                else
+                    LUInvert(n, buffer, n, pivots);
+                BatchScatter<Type, L>(buffer, n * n, l, Inverse);
+            }
+        }
+    }
+
+    template<typename Type, int L>
+    void BatchInverseAny(int n, const Type *A, Type *Inverse, Type *Determinant, bool *Singular){
+        switch (n) {
+            case 1: BatchInverseGroup<Type, L, 1>(A, Inverse, Determinant, Singular); break;
+            case 2: BatchInverseGroup<Type, L, 2>(A, Inverse, Determinant, Singular); break;
+            case 3: BatchInverseGroup<Type, L, 3>(A, Inverse, Determinant, Singular); break;
+            case 4: BatchInverseGroup<Type, L, 4>(A, Inverse, Determinant, Singular); break;
+            default: BatchInverseGroupLU<Type, L>(n, A, Inverse, Determinant, Singular); break;
+        }
+    }
+}
+
+template<typename Type>
+class MatrixBatch {
+
+public:
+    static constexpr int Lanes = MatrixDetail::BatchLanes<Type>;
+
+private:
+    int count = 0;
+    int rows = 0;
+    int columns = 0;
+    size_t capacity = 0;
+    Type *data = nullptr;
+    MatrixMemoryResource *resource = MatrixDetail::CurrentResource();
+
+    [[nodiscard]] size_t Index(int b, int i, int j) const{
+        return (size_t(b / Lanes) * rows * columns + size_t(i) * columns + j) * Lanes + b % Lanes;
+    }
+
+    void Free(){
+        if (data)
+            resource->Deallocate(data, capacity * sizeof(Type));
+        data = nullptr;
+        capacity = 0;
+    }
+
+public:
+    MatrixBatch() = default;
+
+    MatrixBatch(int num_matrices, int num_rows, int num_columns){
+        Resize(num_matrices, num_rows, num_columns);
+    }
+
+    MatrixBatch(const MatrixBatch &other){
+        Resize(other.count, other.rows, other.columns);
+        std::copy(other.data, other.data + GetElements(), data);
+    }
+
+    MatrixBatch(MatrixBatch &&other) noexcept{
+        Swap(other);
+    }
+
+    MatrixBatch &operator=(const MatrixBatch &other){
+        if (this != &other) {
+            Resize(other.count, other.rows, other.columns);
+            std::copy(other.data, other.data + GetElements(), data);
+        }
+        return *this;
+    }
+
+    MatrixBatch &operator=(MatrixBatch &&other) noexcept{
+        Swap(other);
+        return *this;
+    }
+
+    ~MatrixBatch(){
+        Free();
+    }
+
+    void Swap(MatrixBatch &other) noexcept{
+        std::swap(count, other.count);
+        std::swap(rows, other.rows);
+        std::swap(columns, other.columns);
+        std::swap(capacity, other.capacity);
+        std::swap(data, other.data);
+        std::swap(resource, other.resource);
+    }
+
+    // The buffer is only reallocated when it has to grow; kernels that overwrite everything skip the fill
+    void Resize(int num_matrices, int num_rows, int num_columns, bool zero_fill = true){
+        MATRIX_PROFILE("MatrixBatch::Resize(int num_matrices, int num_rows, int num_columns)");
+        assert(num_matrices >= 0 && num_rows >= 0 && num_columns >= 0);
+        count = num_matrices;
+        rows = num_rows;
+        columns = num_columns;
+        size_t required = GetElements();
+        if (required > capacity) {
+            Free();
+            data = static_cast<Type *>(resource->Allocate(required * sizeof(Type)));
+            capacity = required;
+            MatrixProfiler::CountAllocation(required * sizeof(Type));
+        }
+        if (zero_fill)
+            std::fill(data, data + required, Type());
+    }
+
+    [[nodiscard]] int GetCount() const { return count; }
+    [[nodiscard]] int GetRows() const { return rows; }
+    [[nodiscard]] int GetColumns() const { return columns; }
+    [[nodiscard]] int GetGroups() const { return (count + Lanes - 1) / Lanes; }
+    [[nodiscard]] size_t GetElements() const { return size_t(GetGroups()) * rows * columns * Lanes; }
+
+    // Interleaved storage of group g, rows * columns runs of Lanes values
+    [[nodiscard]] Type *Group(int g) { return data + size_t(g) * rows * columns * Lanes; }
+    [[nodiscard]] const Type *Group(int g) const { return data + size_t(g) * rows * columns * Lanes; }
+
+    Type &operator()(int b, int i, int j){
+        assert(b < count && i < rows && j < columns);
+        return data[Index(b, i, j)];
+    }
+
+    const Type &operator()(int b, int i, int j) const{
+        assert(b < count && i < rows && j < columns);
+        return data[Index(b, i, j)];
+    }
+
+    [[nodiscard]] Matrix<Type> Get(int b) const{
+        Matrix<Type> result(rows, columns);
+        for (int i = 0; i < rows; i++)
+            for (int j = 0; j < columns; j++)
+                result[i][j] = data[Index(b, i, j)];
+        return result;
+    }
+
+    void Set(int b, const MatrixView<Type> &Source){
+        assert(Source.GetRows() == rows && Source.GetColumns() == columns);
+        for (int i = 0; i < rows; i++)
+            for (int j = 0; j < columns; j++)
+                data[Index(b, i, j)] = Source(i, j);
+    }
+
+    void Set(int b, const Matrix<Type> &Source) { Set(b, Source.GetView()); }
+};
+
+// C[b] = A[b] * B[b] for every matrix of the batch
+template<typename Type>
+void BatchMultiply(const MatrixBatch<Type> &A, const MatrixBatch<Type> &B, MatrixBatch<Type> &C){
+    MATRIX_PROFILE("BatchMultiply(const MatrixBatch<Type> &A, const MatrixBatch<Type> &B, MatrixBatch<Type> &C)");
+    assert(A.GetCount() == B.GetCount() && A.GetColumns() == B.GetRows());
+    assert(&C != &A && &C != &B);
+    constexpr int L = MatrixBatch<Type>::Lanes;
+    int m = A.GetRows(), k = A.GetColumns(), n = B.GetColumns();
+    C.Resize(A.GetCount(), m, n, false);
+    MatrixProfiler::CountWork(2.0 * m * n * k * A.GetCount(), (A.GetElements() + B.GetElements() + C.GetElements()) * sizeof(Type));
+    auto body = [&](int g) {
+        const Type *a = A.Group(g), *b = B.Group(g);
+        Type *c = C.Group(g);
+        if (m == 2 && k == 2 && n == 2) MatrixDetail::BatchMultiplyGroup<Type, L, 2, 2, 2>(a, b, c, m, k, n);
+        else if (m == 3 && k == 3 && n == 3) MatrixDetail::BatchMultiplyGroup<Type, L, 3, 3, 3>(a, b, c, m, k, n);
+        else if (m == 4 && k == 4 && n == 4) MatrixDetail::BatchMultiplyGroup<Type, L, 4, 4, 4>(a, b, c, m, k, n);
+        else if (m == 3 && k == 3 && n == 1) MatrixDetail::BatchMultiplyGroup<Type, L, 3, 3, 1>(a, b, c, m, k, n);
+        else if (m == 4 && k == 4 && n == 1) MatrixDetail::BatchMultiplyGroup<Type, L, 4, 4, 1>(a, b, c, m, k, n);
+        else MatrixDetail::BatchMultiplyGroup<Type, L, 0, 0, 0>(a, b, c, m, k, n);
+    };
+    MatrixDetail::BatchForGroups(A.GetGroups(), 2LL * m * n * k * L, body);
+}
+
+// Determinants of every matrix of the batch
+template<typename Type>
+std::vector<Type> BatchDeterminant(const MatrixBatch<Type> &A){
+    MATRIX_PROFILE("BatchDeterminant(const MatrixBatch<Type> &A)");
+    static_assert(std::is_floating_point_v<Type>, "BatchDeterminant needs a floating point batch");
+    assert(A.GetRows() == A.GetColumns());
+    constexpr int L = MatrixBatch<Type>::Lanes;
+    int n = A.GetRows();
+    std::vector<Type> result(size_t(A.GetGroups()) * L);
+    MatrixProfiler::CountWork(2.0 * n * n * n * A.GetCount(), A.GetElements() * sizeof(Type));
+    MatrixDetail::BatchForGroups(A.GetGroups(), 2LL * n * n * n * L, [&](int g) {
+        MatrixDetail::BatchInverseAny<Type, L>(n, A.Group(g), nullptr, result.data() + size_t(g) * L, nullptr);
+    });
+    result.resize(A.GetCount());
+    return result;
+}
+
+/*
+ * Out[b] = A[b]^-1. Singular matrices (determinant negligible against their largest entry) come
+ * out as zero; returns how many there were. Out may be A itself.
+ */
+template<typename Type>
+int BatchInverse(const MatrixBatch<Type> &A, MatrixBatch<Type> &Out){
+    MATRIX_PROFILE("BatchInverse(const MatrixBatch<Type> &A, MatrixBatch<Type> &Out)");
+    static_assert(std::is_floating_point_v<Type>, "BatchInverse needs a floating point batch");
+    assert(A.GetRows() == A.GetColumns());
+    constexpr int L = MatrixBatch<Type>::Lanes;
+    int n = A.GetRows();
+    if (&Out != &A)
+        Out.Resize(A.GetCount(), n, n, false);
+    std::vector<char> singular(size_t(A.GetGroups()) * L);
+    MatrixProfiler::CountWork(3.0 * n * n * n * A.GetCount(), 2 * A.GetElements() * sizeof(Type));
+    MatrixDetail::BatchForGroups(A.GetGroups(), 3LL * n * n * n * L, [&](int g) {
+        bool flags[L];
+        MatrixDetail::BatchInverseAny<Type, L>(n, A.Group(g), Out.Group(g), nullptr, flags);
+        std::copy(flags, flags + L, singular.begin() + size_t(g) * L);
+    });
+    return int(std::count(singular.begin(), singular.begin() + A.GetCount(), 1));
+}
+
+/*
+ * Solves A[b] * X[b] = RHS[b] for every matrix of the batch (RHS may have several columns).
+ * Systems with a singular A get a zero X; returns how many there were.
+ */
+template<typename Type>
+int BatchSolve(const MatrixBatch<Type> &A, const MatrixBatch<Type> &RHS, MatrixBatch<Type> &X){
+    MATRIX_PROFILE("BatchSolve(const MatrixBatch<Type> &A, const MatrixBatch<Type> &RHS, MatrixBatch<Type> &X)");
+    static_assert(std::is_floating_point_v<Type>, "BatchSolve needs a floating point batch");
+    assert(A.GetRows() == A.GetColumns() && A.GetCount() == RHS.GetCount() && A.GetRows() == RHS.GetRows());
+    assert(&X != &A && &X != &RHS);
+    constexpr int L = MatrixBatch<Type>::Lanes;
+    int n = A.GetRows(), k = RHS.GetColumns();
+    X.Resize(A.GetCount(), n, k, false);
+    std::vector<char> singular(size_t(A.GetGroups()) * L);
+    MatrixProfiler::CountWork((3.0 * n + 2.0 * k) * n * n * A.GetCount(),
+                              (A.GetElements() + RHS.GetElements() + X.GetElements()) * sizeof(Type));
+    MatrixDetail::BatchForGroups(A.GetGroups(), (3LL * n + 2LL * k) * n * n * L, [&](int g) {
+        MatrixDetail::WorkspaceLease lease(MatrixDetail::BatchWorkspace());
+        Type *inverse = lease.Get<Type>(size_t(n) * n * L);
+        bool flags[L];
+        MatrixDetail::BatchInverseAny<Type, L>(n, A.Group(g), inverse, nullptr, flags);
+        if (n == 3 && k == 1) MatrixDetail::BatchMultiplyGroup<Type, L, 3, 3, 1>(inverse, RHS.Group(g), X.Group(g), n, n, k);
+        else if (n == 4 && k == 1) MatrixDetail::BatchMultiplyGroup<Type, L, 4, 4, 1>(inverse, RHS.Group(g), X.Group(g), n, n, k);
+        else MatrixDetail::BatchMultiplyGroup<Type, L, 0, 0, 0>(inverse, RHS.Group(g), X.Group(g), n, n, k);
+        std::copy(flags, flags + L, singular.begin() + size_t(g) * L);
+    });
+    return int(std::count(singular.begin(), singular.begin() + A.GetCount(), 1));
+}
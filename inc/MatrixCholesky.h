@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "MatrixLU.h"
+
+/*
+ * Cholesky factorization A = L * L^T of a symmetric positive definite matrix.
+ * Only the lower triangle of the source is read. L^T is mirrored into the upper
+ * triangle of the factors so that both substitutions walk contiguous rows.
+ */
+template<typename Type>
+class Cholesky {
+
+private:
+    Matrix<Type> factors{};
+    bool positive_definite = true;
+    double norm = 0;
+
+    void SolveInPlace(Type *B, int ldb, int nrhs) const{
+        int n = GetSize();
+        MatrixDetail::TrsmLower(n, nrhs, factors.Data(), factors.GetStride(), false, B, ldb);
+        MatrixDetail::TrsmUpper(n, nrhs, factors.Data(), factors.GetStride(), false, B, ldb);
+    }
+
+public:
+    template<typename SourceType>
+    explicit Cholesky(const MatrixView<SourceType> &Source){
+        MATRIX_PROFILE("Cholesky::Cholesky(const MatrixView<SourceType> &Source)");
+        assert(Source.GetRows() == Source.GetColumns());
+        int n = Source.GetRows();
+        factors = Matrix<Type>(n, n);
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j <= i; j++)
+                factors[i][j] = Type(Source(i, j));
+
+        // 1-norm of the symmetric matrix from the lower triangle alone: a_ij below the diagonal counts for columns i and j
+        std::vector<double> sums(n, 0.0);
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j <= i; j++) {
+                double value = std::abs(double(factors[i][j]));
+                sums[j] += value;
+                if (j < i)
+                    sums[i] += value;
+            }
+        norm = sums.empty() ? 0.0 : *std::max_element(sums.begin(), sums.end());
+
+        // Row-oriented Cholesky-Crout: every inner product runs over two contiguous row prefixes
+        for (int i = 0; i < n && positive_definite; i++) {
+            Type *li = factors.Data() + size_t(i) * factors.GetStride();
+            for (int j = 0; j <= i; j++) {
+                const Type *lj = factors.Data() + size_t(j) * factors.GetStride();
+                Type sum = li[j];
+                for (int k = 0; k < j; k++)
+                    sum -= li[k] * lj[k];
+                if (j < i)
+                    li[j] = sum / lj[j];
+                else if (sum > Type(0))
+                    li[i] = std::sqrt(sum);
+                else
+                    positive_definite = false;
+            }
+        }
+
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < i; j++)
+                factors[j][i] = factors[i][j];
+    }
+
+    template<typename SourceType>
+    explicit Cholesky(const Matrix<SourceType> &Source) : Cholesky(MatrixView<SourceType>(Source)) {}
+
+    [[nodiscard]] int GetSize() const { return factors.GetRows(); }
+    [[nodiscard]] bool IsPositiveDefinite() const { return positive_definite; }
+    [[nodiscard]] const Matrix<Type> &GetFactors() const { return factors; }
+
+    [[nodiscard]] Type Determinant() const{
+        if (!positive_definite)
+            return Type(0);
+        Type det = Type(1);
+        for (int i = 0; i < GetSize(); i++)
+            det *= factors[i][i] * factors[i][i];
+        return det;
+    }
+
+    // Overwrites the n x k right-hand side matrix with the solution of A * X = RHS
+    bool Solve(Matrix<Type> &RHS) const{
+        MATRIX_PROFILE("Cholesky::Solve(Matrix<Type> &RHS)");
+        assert(RHS.GetRows() == GetSize());
+        if (!positive_definite)
+            return false;
+        SolveInPlace(RHS.Data(), RHS.GetStride(), RHS.GetColumns());
+        return true;
+    }
+
+    bool Solve(std::vector<Type> &RHS) const{
+        assert(RHS.size() == GetSize());
+        if (!positive_definite)
+            return false;
+        SolveInPlace(RHS.data(), 1, 1);
+        return true;
+    }
+
+    // A is symmetric, so the transposed solve needed by the estimator is the same solve
+    [[nodiscard]] double ReciprocalCondition() const{
+        if (!positive_definite)
+            return 0.0;
+        auto solve = [this](Type *x) { SolveInPlace(x, 1, 1); };
+        double inverse_norm = MatrixDetail::EstimateInverseNorm1<Type>(GetSize(), solve, solve);
+        return MatrixDetail::ReciprocalCondition(norm, inverse_norm);
+    }
+};
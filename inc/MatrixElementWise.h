@@ -0,0 +1,314 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include "MatrixGemm.h"
+#include "MatrixHalf.h"
+#include "MatrixMemory.h"
+#include "MatrixThreadPool.h"
+
+/*
+ * Element-wise kernel layer shared by Matrix, Vector and ProxyVector. Kernels are plain loops over
+ * fixed-width lane arrays that the compiler vectorizes; VectorRun compiles them for the widest ISA
+ * found at runtime and VectorFor splits a call over the thread pool once it moves enough data.
+ *
+ * Reductions are summed in fixed spans combined in order, so results do not depend on the thread
+ * count. Predicates test branch-free blocks and stop after the first failing one; parallel tasks
+ * also stop as soon as any task has found a failure.
+ */
+namespace MatrixDetail {
+    template<typename Type>
+    constexpr int VectorLanes = int(Alignment / sizeof(Type)) > 0 ? int(Alignment / sizeof(Type)) : 1;
+
+    // Elements per parallel chunk; smaller calls stay on the calling thread
+    constexpr int VectorChunk = 1 << 15;
+
+    template<typename Function>
+    void VectorRunGeneric(Function &body) { body(); }
+
+#ifdef MATRIX_X86_DISPATCH
+    template<typename Function>
+    __attribute__((target("avx2,fma"), flatten))
+    void VectorRunAVX2(Function &body) { body(); }
+
+    template<typename Function>
+    __attribute__((target("avx512f,prefer-vector-width=512"), flatten))
+    void VectorRunAVX512(Function &body) { body(); }
+#endif
+
+    // Runs body() compiled for the widest available ISA
+    template<typename Function>
+    void VectorRun(Function &&body){
+#ifdef MATRIX_X86_DISPATCH
+        switch (ActiveGemmIsa()) {
+            case GemmIsa::AVX512: VectorRunAVX512(body); return;
+            case GemmIsa::AVX2: VectorRunAVX2(body); return;
+            default: break;
+        }
+#endif
+        VectorRunGeneric(body);
+    }
+
+    // Runs body(begin, end) over [0, count) in chunks of at least grain, in parallel when there is more than one
+    template<typename Function>
+    void VectorFor(int count, int grain, Function &&body){
+        auto run = [&body](int begin, int end) { VectorRun([&] { body(begin, end); }); };
+        MatrixThreadPool &pool = MatrixThreadPool::Instance();
+        if (count <= grain || pool.GetThreadCount() == 1)
+            run(0, count);
+        else
+            pool.ParallelFor(0, count, grain, run);
+    }
+
+    // Rows of the given width per parallel chunk
+    inline int RowGrain(int columns) { return std::max(1, VectorChunk / std::max(columns, 1)); }
+
+    // A block without gaps between rows is handled as one long row, so narrow matrices still fill the lanes
+    inline bool IsFlat(int m, int n, ptrdiff_t ld) { return (ld == n || m == 1) && size_t(m) * n <= size_t(INT_MAX); }
+
+    // Runs span(i, begin, end) over row spans covering an m x n block; a flat block is a single row 0 of m * n
+    template<typename Function>
+    void ForEachSpan(int m, int n, bool flat, Function &&span){
+        if (m <= 0 || n <= 0)
+            return;
+        if (flat)
+            VectorFor(m * n, VectorChunk, [&](int begin, int end) { span(0, begin, end); });
+        else
+            VectorFor(m, RowGrain(n), [&](int begin, int end) {
+                for (int i = begin; i < end; i++)
+                    span(i, 0, n);
+            });
+    }
+
+    // f(y) on every element of an m x n block, e.g. [value](float &y) { y *= value; }
+    template<typename Type, typename Function>
+    void TransformElements(int m, int n, Type *Y, ptrdiff_t ldy, Function f){
+        ForEachSpan(m, n, IsFlat(m, n, ldy), [&](int i, int begin, int end) {
+            Type *y = Y + i * ldy;
+            for (int j = begin; j < end; j++)
+                f(y[j]);
+        });
+    }
+
+    // f(y, x) on every pair of elements of two m x n blocks
+    template<typename Type, typename Source, typename Function>
+    void TransformElements(int m, int n, Type *Y, ptrdiff_t ldy, const Source *X, ptrdiff_t ldx, Function f){
+        ForEachSpan(m, n, IsFlat(m, n, ldy) && IsFlat(m, n, ldx), [&](int i, int begin, int end) {
+            Type *y = Y + i * ldy;
+            const Source *x = X + i * ldx;
+            for (int j = begin; j < end; j++)
+                f(y[j], x[j]);
+        });
+    }
+
+    // combine(..., load(x[i])) over x[0, n) in 4 * lanes independent accumulators
+    template<typename Accumulator, typename Type, typename Load, typename Combine>
+    Accumulator ReduceKernel(int n, const Type *x, Accumulator init, Load load, Combine combine){
+        constexpr int L = 4 * VectorLanes<Accumulator>;
+        Accumulator acc[L];
+        for (int l = 0; l < L; l++)
+            acc[l] = init;
+        int i = 0;
+        for (; i + L <= n; i += L)
+            for (int l = 0; l < L; l++)
+                acc[l] = combine(acc[l], load(x[i + l]));
+        for (; i < n; i++)
+            acc[i % L] = combine(acc[i % L], load(x[i]));
+        for (int width = L / 2; width > 0; width /= 2)
+            for (int l = 0; l < width; l++)
+                acc[l] = combine(acc[l], acc[l + width]);
+        return acc[0];
+    }
+
+    // Combines chunk(c) for c in [0, chunks) in order; the chunks themselves may run in parallel
+    template<typename Accumulator, typename Chunk, typename Combine>
+    Accumulator ReduceChunks(int chunks, Accumulator init, Chunk chunk, Combine combine){
+        if (chunks <= 1) {
+            Accumulator result = init;
+            if (chunks == 1)
+                VectorRun([&] { result = chunk(0); });
+            return result;
+        }
+        std::vector<Accumulator> partial(chunks, init);
+        VectorFor(chunks, 1, [&](int begin, int end) {
+            for (int c = begin; c < end; c++)
+                partial[c] = chunk(c);
+        });
+        Accumulator result = init;
+        for (const Accumulator &value : partial)
+            result = combine(result, value);
+        return result;
+    }
+
+    template<typename Accumulator, typename Type, typename Load, typename Combine>
+    Accumulator ReduceElements(int m, int n, const Type *A, ptrdiff_t lda, Accumulator init, Load load, Combine combine){
+        if (m <= 0 || n <= 0)
+            return init;
+        if (IsFlat(m, n, lda)) {
+            int count = m * n;
+            return ReduceChunks((count + VectorChunk - 1) / VectorChunk, init, [&](int c) {
+                int offset = c * VectorChunk;
+                return ReduceKernel(std::min(VectorChunk, count - offset), A + offset, init, load, combine);
+            }, combine);
+        }
+        int grain = RowGrain(n);
+        return ReduceChunks((m + grain - 1) / grain, init, [&](int c) {
+            Accumulator result = init;
+            for (int i = c * grain; i < std::min(m, (c + 1) * grain); i++)
+                result = combine(result, ReduceKernel(n, A + i * lda, init, load, combine));
+            return result;
+        }, combine);
+    }
+
+    template<typename Type>
+    Type AbsoluteValue(Type value) { return value < Type(0) ? -value : value; }
+
+    template<typename Type>
+    MatrixAccumulatorT<Type> SumElements(int m, int n, const Type *A, ptrdiff_t lda){
+        using Accumulator = MatrixAccumulatorT<Type>;
+        return ReduceElements(m, n, A, lda, Accumulator(0), [](Type x) { return Accumulator(x); },
+                              [](Accumulator a, Accumulator b) { return a + b; });
+    }
+
+    template<typename Type>
+    Type MinElement(int m, int n, const Type *A, ptrdiff_t lda){
+        assert(m > 0 && n > 0);
+        return ReduceElements(m, n, A, lda, A[0], [](Type x) { return x; }, [](Type a, Type b) { return b < a ? b : a; });
+    }
+
+    template<typename Type>
+    Type MaxElement(int m, int n, const Type *A, ptrdiff_t lda){
+        assert(m > 0 && n > 0);
+        return ReduceElements(m, n, A, lda, A[0], [](Type x) { return x; }, [](Type a, Type b) { return a < b ? b : a; });
+    }
+
+    template<typename Type>
+    FactorType<Type> SquareSumElements(int m, int n, const Type *A, ptrdiff_t lda){
+        using Accumulator = FactorType<Type>;
+        return ReduceElements(m, n, A, lda, Accumulator(0), [](Type x) { return Accumulator(x) * Accumulator(x); },
+                              [](Accumulator a, Accumulator b) { return a + b; });
+    }
+
+    // Largest absolute row sum
+    template<typename Type>
+    FactorType<Type> MaxRowAbsSum(int m, int n, const Type *A, ptrdiff_t lda){
+        using Accumulator = FactorType<Type>;
+        auto load = [](Type x) { return AbsoluteValue(Accumulator(x)); };
+        auto add = [](Accumulator a, Accumulator b) { return a + b; };
+        auto max = [](Accumulator a, Accumulator b) { return a < b ? b : a; };
+        int grain = RowGrain(n);
+        return ReduceChunks((m + grain - 1) / grain, Accumulator(0), [&](int c) {
+            Accumulator result = Accumulator(0);
+            for (int i = c * grain; i < std::min(m, (c + 1) * grain); i++)
+                result = max(result, ReduceKernel(n, A + i * lda, Accumulator(0), load, add));
+            return result;
+        }, max);
+    }
+
+    // Block tested branch-free before the early-exit check
+    constexpr int PredicateBlock = 256;
+
+    // True when bad(j) holds for no j in [begin, end)
+    template<typename Function>
+    bool NoneInRange(int begin, int end, Function bad){
+        for (int j = begin; j < end; j += PredicateBlock) {
+            int stop = std::min(end, j + PredicateBlock);
+            unsigned hit = 0;
+            for (int t = j; t < stop; t++)
+                hit |= unsigned(bad(t));
+            if (hit)
+                return false;
+        }
+        return true;
+    }
+
+    // True when test(i, begin, end) holds for every row span of an m x n block
+    template<typename Function>
+    bool AllSpans(int m, int n, bool flat, Function test){
+        std::atomic<bool> failed{false};
+        ForEachSpan(m, n, flat, [&](int i, int begin, int end) {
+            if (!failed.load(std::memory_order_relaxed) && !test(i, begin, end))
+                failed.store(true, std::memory_order_relaxed);
+        });
+        return !failed.load(std::memory_order_relaxed);
+    }
+
+    // bad(y, x) for pairs of elements of two m x n blocks, stopping at the first block that has one
+    template<typename Type, typename Function>
+    bool NoPairs(int m, int n, const Type *A, ptrdiff_t lda, const Type *B, ptrdiff_t ldb, Function bad){
+        return AllSpans(m, n, IsFlat(m, n, lda) && IsFlat(m, n, ldb), [&](int i, int begin, int end) {
+            const Type *a = A + i * lda;
+            const Type *b = B + i * ldb;
+            return NoneInRange(begin, end, [&](int j) { return bad(a[j], b[j]); });
+        });
+    }
+
+    template<typename Type>
+    bool EqualElements(int m, int n, const Type *A, ptrdiff_t lda, const Type *B, ptrdiff_t ldb){
+        return NoPairs(m, n, A, lda, B, ldb, [](Type a, Type b) { return !(a == b); });
+    }
+
+    // Default IsApprox tolerance: a few hundred roundings for float and double, a few for the 16 bit types
+    template<typename Type>
+    FactorType<Type> ApproxEpsilon(){
+        if constexpr (std::is_integral_v<Type>)
+            return FactorType<Type>(0);
+        else if constexpr (std::is_same_v<Type, BFloat16>)
+            return FactorType<Type>(5e-2);
+        else if constexpr (IsHalfV<Type>)
+            return FactorType<Type>(1e-2);
+        else if constexpr (std::is_same_v<Type, float>)
+            return 1e-5f;
+        else
+            return FactorType<Type>(1e-12);
+    }
+
+    // |a - b| <= epsilon * max(1, |a|, |b|): relative for large values, absolute near zero; NaN never matches
+    template<typename Type>
+    bool ApproxElements(int m, int n, const Type *A, ptrdiff_t lda, const Type *B, ptrdiff_t ldb, FactorType<Type> epsilon){
+        using Accumulator = FactorType<Type>;
+        return NoPairs(m, n, A, lda, B, ldb, [epsilon](Type a, Type b) {
+            Accumulator x = Accumulator(a), y = Accumulator(b);
+            Accumulator scale = std::max(Accumulator(1), std::max(AbsoluteValue(x), AbsoluteValue(y)));
+            return !(AbsoluteValue(x - y) <= epsilon * scale);
+        });
+    }
+
+    template<size_t Bytes>
+    struct UlpInteger;
+
+    template<> struct UlpInteger<2> { using type = int16_t; };
+    template<> struct UlpInteger<4> { using type = int32_t; };
+    template<> struct UlpInteger<8> { using type = int64_t; };
+
+    // Maps the bits of a floating value onto integers ordered like the values, with -0 and +0 both at 0
+    template<typename Type>
+    int64_t OrderedBits(Type value){
+        typename UlpInteger<sizeof(Type)>::type bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        using Bits = decltype(bits);
+        return bits < 0 ? int64_t(std::numeric_limits<Bits>::min()) - int64_t(bits) : int64_t(bits);
+    }
+
+    // At most max_ulps representable values apart; integers compare by difference, NaN never matches
+    template<typename Type>
+    bool UlpElements(int m, int n, const Type *A, ptrdiff_t lda, const Type *B, ptrdiff_t ldb, int max_ulps){
+        if constexpr (std::is_integral_v<Type>)
+            return NoPairs(m, n, A, lda, B, ldb, [max_ulps](Type a, Type b) {
+                return (a < b ? int64_t(b) - int64_t(a) : int64_t(a) - int64_t(b)) > max_ulps;
+            });
+        else
+            return NoPairs(m, n, A, lda, B, ldb, [max_ulps](Type a, Type b) {
+                int64_t distance = OrderedBits(a) - OrderedBits(b);
+                return !(a == a && b == b) || (distance < 0 ? -distance : distance) > max_ulps;
+            });
+    }
+}
@@ -0,0 +1,362 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include "MatrixFwd.h"
+
+/*
+ * Lazy element-wise arithmetic. Operators on matrices, scalars and other expressions build
+ * a small tree of nodes instead of temporary matrices; the tree is evaluated in one pass,
+ * row by row, when it is assigned to (or used to construct) a Matrix. Matrix products are
+ * not element-wise and stay eager: an expression used as a GEMM operand is evaluated first.
+ *
+ * Nodes keep lvalue matrices by reference and take ownership of temporary ones, so an
+ * expression stored with auto stays valid as long as the named matrices it uses do.
+ * Aliases(begin, end, stride) tells whether evaluating in place into the storage
+ * [begin, end) would overwrite elements still to be read; only views can do that.
+ */
+struct MatrixExpressionBase {};
+
+template<typename Derived>
+class MatrixExpression : public MatrixExpressionBase {
+
+public:
+    [[nodiscard]] const Derived &Self() const { return static_cast<const Derived &>(*this); }
+    [[nodiscard]] int GetRows() const { return Self().GetRows(); }
+    [[nodiscard]] int GetColumns() const { return Self().GetColumns(); }
+
+    [[nodiscard]] auto Eval() const { return Matrix<typename Derived::ValueType>(*this); }
+};
+
+namespace MatrixDetail {
+    template<typename T>
+    struct IsMatrixOperand : std::is_base_of<MatrixExpressionBase, T> {};
+
+    template<typename Type>
+    struct IsMatrixOperand<Matrix<Type>> : std::true_type {};
+
+    template<typename T>
+    constexpr bool IsMatrixOperandV = IsMatrixOperand<std::decay_t<T>>::value;
+
+    template<typename T>
+    struct IsMatrixType : std::false_type {};
+
+    template<typename Type, int Rows, int Columns>
+    struct IsMatrixType<Matrix<Type, Rows, Columns>> : std::true_type {};
+
+    template<typename Type>
+    struct IsMatrixType<SparseMatrix<Type>> : std::true_type {};
+
+    template<typename Type>
+    struct IsMatrixType<Vector<Type>> : std::true_type {};
+
+    template<typename Type>
+    struct IsMatrixType<MatrixFuture<Type>> : std::true_type {};
+
+    // Anything that is not a matrix (of any size or storage) or an expression is applied as a scalar
+    template<typename T>
+    constexpr bool IsScalarV = !IsMatrixOperandV<T> && !IsMatrixType<std::decay_t<T>>::value;
+
+    struct AddOp { template<typename A, typename B> static auto Apply(A a, B b) { return a + b; } };
+    struct SubtractOp { template<typename A, typename B> static auto Apply(A a, B b) { return a - b; } };
+    struct MultiplyOp { template<typename A, typename B> static auto Apply(A a, B b) { return a * b; } };
+    struct DivideOp { template<typename A, typename B> static auto Apply(A a, B b) { return a / b; } };
+    struct NegateOp { template<typename A> static auto Apply(A a) { return -a; } };
+
+    // Type a scalar is applied in: wide enough for both sides, as in element *= value, so Matrix<int> * 0.5
+    // halves every element instead of multiplying by int(0.5); 16 bit storage keeps its own type
+    template<typename Value, typename Scalar, typename = void>
+    struct ScalarOperand { using type = Value; };
+
+    template<typename Value, typename Scalar>
+    struct ScalarOperand<Value, Scalar, std::enable_if_t<std::is_arithmetic_v<Value> && std::is_arithmetic_v<Scalar>>> {
+        using type = std::common_type_t<Value, Scalar>;
+    };
+
+    template<typename Value, typename Scalar>
+    using ScalarOperandT = typename ScalarOperand<Value, Scalar>::type;
+}
+
+// Leaf over a Matrix; Holder is const Matrix & for named matrices and Matrix for temporaries
+template<typename Type, typename Holder>
+class MatrixLeaf : public MatrixExpression<MatrixLeaf<Type, Holder>> {
+
+private:
+    Holder matrix;
+
+public:
+    using ValueType = Type;
+
+    explicit MatrixLeaf(Holder Source) : matrix(std::forward<Holder>(Source)) {}
+
+    [[nodiscard]] int GetRows() const { return matrix.GetRows(); }
+    [[nodiscard]] int GetColumns() const { return matrix.GetColumns(); }
+    [[nodiscard]] const Type *RowAt(int i) const { return matrix.Data() + size_t(i) * matrix.GetStride(); }
+
+    // The matrix a temporary expression owns and may evaluate into, if any
+    Matrix<Type> *Storage(){
+        if constexpr (std::is_reference_v<Holder>)
+            return nullptr;
+        else
+            return &matrix;
+    }
+
+    // A matrix is only ever read at the (i, j) being written, even when it is the target itself
+    template<typename Target>
+    bool Aliases(const Target *, const Target *, ptrdiff_t) const { return false; }
+};
+
+template<typename Op, typename Left, typename Right>
+class MatrixBinary : public MatrixExpression<MatrixBinary<Op, Left, Right>> {
+
+private:
+    Left left;
+    Right right;
+
+    template<typename LeftRow, typename RightRow>
+    struct Row {
+        LeftRow l;
+        RightRow r;
+        auto operator[](int j) const { return Op::Apply(l[j], r[j]); }
+    };
+
+public:
+    using ValueType = typename Left::ValueType;
+
+    MatrixBinary(Left Lhs, Right Rhs) : left(std::move(Lhs)), right(std::move(Rhs)){
+        assert(left.GetRows() == right.GetRows() && left.GetColumns() == right.GetColumns());
+    }
+
+    [[nodiscard]] int GetRows() const { return left.GetRows(); }
+    [[nodiscard]] int GetColumns() const { return left.GetColumns(); }
+
+    auto RowAt(int i) const{
+        using LeftRow = decltype(left.RowAt(i));
+        using RightRow = decltype(right.RowAt(i));
+        return Row<LeftRow, RightRow>{left.RowAt(i), right.RowAt(i)};
+    }
+
+    Matrix<ValueType> *Storage(){
+        if (auto *storage = left.Storage())
+            return storage;
+        if constexpr (std::is_same_v<typename Right::ValueType, ValueType>)
+            return right.Storage();
+        else
+            return nullptr;
+    }
+
+    template<typename Target>
+    bool Aliases(const Target *begin, const Target *end, ptrdiff_t stride) const{
+        return left.Aliases(begin, end, stride) || right.Aliases(begin, end, stride);
+    }
+};
+
+// The scalar keeps the type it is applied in (see ScalarOperandT); only the written element is converted to ValueType
+template<typename Op, typename Expression, bool ScalarOnLeft, typename Scalar>
+class MatrixScalarBinary : public MatrixExpression<MatrixScalarBinary<Op, Expression, ScalarOnLeft, Scalar>> {
+
+public:
+    using ValueType = typename Expression::ValueType;
+
+private:
+    Expression expression;
+    Scalar scalar;
+
+    template<typename ExpressionRow>
+    struct Row {
+        ExpressionRow e;
+        Scalar s;
+        auto operator[](int j) const{
+            if constexpr (ScalarOnLeft)
+                return Op::Apply(s, e[j]);
+            else
+                return Op::Apply(e[j], s);
+        }
+    };
+
+public:
+    MatrixScalarBinary(Expression Source, Scalar Value) : expression(std::move(Source)), scalar(Value) {}
+
+    [[nodiscard]] int GetRows() const { return expression.GetRows(); }
+    [[nodiscard]] int GetColumns() const { return expression.GetColumns(); }
+
+    auto RowAt(int i) const{
+        using ExpressionRow = decltype(expression.RowAt(i));
+        return Row<ExpressionRow>{expression.RowAt(i), scalar};
+    }
+
+    Matrix<ValueType> *Storage() { return expression.Storage(); }
+
+    template<typename Target>
+    bool Aliases(const Target *begin, const Target *end, ptrdiff_t stride) const{
+        return expression.Aliases(begin, end, stride);
+    }
+};
+
+template<typename Op, typename Expression>
+class MatrixUnary : public MatrixExpression<MatrixUnary<Op, Expression>> {
+
+private:
+    Expression expression;
+
+    template<typename ExpressionRow>
+    struct Row {
+        ExpressionRow e;
+        auto operator[](int j) const { return Op::Apply(e[j]); }
+    };
+
+public:
+    using ValueType = typename Expression::ValueType;
+
+    explicit MatrixUnary(Expression Source) : expression(std::move(Source)) {}
+
+    [[nodiscard]] int GetRows() const { return expression.GetRows(); }
+    [[nodiscard]] int GetColumns() const { return expression.GetColumns(); }
+
+    auto RowAt(int i) const{
+        using ExpressionRow = decltype(expression.RowAt(i));
+        return Row<ExpressionRow>{expression.RowAt(i)};
+    }
+
+    Matrix<ValueType> *Storage() { return expression.Storage(); }
+
+    template<typename Target>
+    bool Aliases(const Target *begin, const Target *end, ptrdiff_t stride) const{
+        return expression.Aliases(begin, end, stride);
+    }
+};
+
+namespace MatrixDetail {
+    template<typename Type>
+    MatrixLeaf<Type, const Matrix<Type> &> AsExpression(const Matrix<Type> &Source){
+        return MatrixLeaf<Type, const Matrix<Type> &>(Source);
+    }
+
+    template<typename Type>
+    MatrixLeaf<Type, Matrix<Type>> AsExpression(Matrix<Type> &&Source){
+        return MatrixLeaf<Type, Matrix<Type>>(std::move(Source));
+    }
+
+    template<typename Derived>
+    Derived AsExpression(const MatrixExpression<Derived> &Source){
+        return Source.Self();
+    }
+
+    template<typename Derived>
+    Derived AsExpression(MatrixExpression<Derived> &&Source){
+        return static_cast<Derived &&>(Source);
+    }
+
+    template<typename Type>
+    const Matrix<Type> &Evaluated(const Matrix<Type> &Source){
+        return Source;
+    }
+
+    template<typename Type>
+    const MatrixView<Type> &Evaluated(const MatrixView<Type> &Source){
+        return Source;
+    }
+
+    template<typename Derived>
+    auto Evaluated(const MatrixExpression<Derived> &Source){
+        return Source.Eval();
+    }
+
+    // Defined in MatrixView.h: GEMM straight from (possibly transposed) views
+    template<typename Type>
+    MatrixView<Type> AsView(const Matrix<Type> &Source);
+
+    template<typename Type>
+    const MatrixView<Type> &AsView(const MatrixView<Type> &Source){
+        return Source;
+    }
+
+    template<typename Type>
+    Matrix<Type> Product(const MatrixView<Type> &Left, const MatrixView<Type> &Right);
+
+    template<typename T>
+    using ExpressionOf = decltype(AsExpression(std::declval<T>()));
+
+    // Matrix * Matrix is a product, so element-wise * and / only exist between a matrix operand and a scalar
+    template<typename Left, typename Right>
+    using EnableElementWise = std::enable_if_t<IsMatrixOperandV<Left> && IsMatrixOperandV<Right>, int>;
+
+    template<typename Operand, typename Scalar>
+    using EnableScalar = std::enable_if_t<IsMatrixOperandV<Operand> && IsScalarV<Scalar>, int>;
+
+    template<typename Left, typename Right>
+    using EnableExpressionProduct = std::enable_if_t<IsMatrixOperandV<Left> && IsMatrixOperandV<Right> &&
+        (std::is_base_of_v<MatrixExpressionBase, std::decay_t<Left>> ||
+         std::is_base_of_v<MatrixExpressionBase, std::decay_t<Right>>), int>;
+}
+
+template<typename Left, typename Right, MatrixDetail::EnableElementWise<Left, Right> = 0>
+auto operator+(Left &&lhs, Right &&rhs){
+    using namespace MatrixDetail;
+    return MatrixBinary<AddOp, ExpressionOf<Left>, ExpressionOf<Right>>(
+        AsExpression(std::forward<Left>(lhs)), AsExpression(std::forward<Right>(rhs)));
+}
+
+template<typename Left, typename Right, MatrixDetail::EnableElementWise<Left, Right> = 0>
+auto operator-(Left &&lhs, Right &&rhs){
+    using namespace MatrixDetail;
+    return MatrixBinary<SubtractOp, ExpressionOf<Left>, ExpressionOf<Right>>(
+        AsExpression(std::forward<Left>(lhs)), AsExpression(std::forward<Right>(rhs)));
+}
+
+template<typename Operand, typename Scalar, MatrixDetail::EnableScalar<Operand, Scalar> = 0>
+auto operator+(Operand &&lhs, const Scalar &rhs){
+    using namespace MatrixDetail;
+    using Expression = ExpressionOf<Operand>;
+    using Applied = ScalarOperandT<typename Expression::ValueType, Scalar>;
+    return MatrixScalarBinary<AddOp, Expression, false, Applied>(AsExpression(std::forward<Operand>(lhs)), Applied(rhs));
+}
+
+template<typename Operand, typename Scalar, MatrixDetail::EnableScalar<Operand, Scalar> = 0>
+auto operator-(Operand &&lhs, const Scalar &rhs){
+    using namespace MatrixDetail;
+    using Expression = ExpressionOf<Operand>;
+    using Applied = ScalarOperandT<typename Expression::ValueType, Scalar>;
+    return MatrixScalarBinary<SubtractOp, Expression, false, Applied>(AsExpression(std::forward<Operand>(lhs)), Applied(rhs));
+}
+
+template<typename Operand, typename Scalar, MatrixDetail::EnableScalar<Operand, Scalar> = 0>
+auto operator*(Operand &&lhs, const Scalar &rhs){
+    using namespace MatrixDetail;
+    using Expression = ExpressionOf<Operand>;
+    using Applied = ScalarOperandT<typename Expression::ValueType, Scalar>;
+    return MatrixScalarBinary<MultiplyOp, Expression, false, Applied>(AsExpression(std::forward<Operand>(lhs)), Applied(rhs));
+}
+
+template<typename Scalar, typename Operand, MatrixDetail::EnableScalar<Operand, Scalar> = 0>
+auto operator*(const Scalar &lhs, Operand &&rhs){
+    using namespace MatrixDetail;
+    using Expression = ExpressionOf<Operand>;
+    using Applied = ScalarOperandT<typename Expression::ValueType, Scalar>;
+    return MatrixScalarBinary<MultiplyOp, Expression, true, Applied>(AsExpression(std::forward<Operand>(rhs)), Applied(lhs));
+}
+
+template<typename Operand, typename Scalar, MatrixDetail::EnableScalar<Operand, Scalar> = 0>
+auto operator/(Operand &&lhs, const Scalar &rhs){
+    using namespace MatrixDetail;
+    using Expression = ExpressionOf<Operand>;
+    using Applied = ScalarOperandT<typename Expression::ValueType, Scalar>;
+    return MatrixScalarBinary<DivideOp, Expression, false, Applied>(AsExpression(std::forward<Operand>(lhs)), Applied(rhs));
+}
+
+template<typename Operand, std::enable_if_t<MatrixDetail::IsMatrixOperandV<Operand>, int> = 0>
+auto operator-(Operand &&operand){
+    using namespace MatrixDetail;
+    return MatrixUnary<NegateOp, ExpressionOf<Operand>>(AsExpression(std::forward<Operand>(operand)));
+}
+
+// Products involving an unevaluated expression evaluate it first; views are multiplied in place by strided GEMM
+template<typename Left, typename Right, MatrixDetail::EnableExpressionProduct<Left, Right> = 0>
+auto operator*(Left &&lhs, Right &&rhs){
+    using namespace MatrixDetail;
+    const auto &left = Evaluated(lhs);
+    const auto &right = Evaluated(rhs);
+    return Product(AsView(left), AsView(right));
+}
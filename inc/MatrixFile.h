@@ -0,0 +1,306 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include "Matrix.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MATRIX_POSIX_IO
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Binary matrix files. A fixed 64 byte header is followed, at the next page boundary, by the raw
+ * row-major payload exactly as it sits in memory (stride included), so a file can be mapped
+ * and used in place. Saving writes header and payload with one gathered write.
+ *
+ *   magic "CPPMATRX" | version | byte order mark | dtype | element size | payload alignment |
+ *   reserved | rows | columns | stride | payload offset
+ *
+ * The payload ends with the last element of the last row, so it holds (rows - 1) * stride + columns elements.
+ */
+enum class MatrixDType : uint32_t { Unknown = 0, Float32 = 1, Float64 = 2, Int32 = 3, Int64 = 4, UInt8 = 5, Float16 = 6, BFloat16 = 7 };
+
+struct MatrixFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t dtype;
+    uint32_t element_size;
+    uint32_t alignment;
+    uint32_t reserved;
+    int64_t rows;
+    int64_t columns;
+    int64_t stride;
+    uint64_t payload_offset;
+};
+
+static_assert(sizeof(MatrixFileHeader) == 64, "MatrixFileHeader must stay 64 bytes");
+
+namespace MatrixDetail {
+    constexpr char FileMagic[8] = {'C', 'P', 'P', 'M', 'A', 'T', 'R', 'X'};
+    constexpr uint32_t FileVersion = 1;
+    constexpr uint32_t FileByteOrder = 0x01020304;
+
+    template<typename Type>
+    constexpr MatrixDType DTypeOf(){
+        if constexpr (std::is_same_v<Type, float>) return MatrixDType::Float32;
+        else if constexpr (std::is_same_v<Type, double>) return MatrixDType::Float64;
+        else if constexpr (std::is_same_v<Type, int32_t>) return MatrixDType::Int32;
+        else if constexpr (std::is_same_v<Type, int64_t>) return MatrixDType::Int64;
+        else if constexpr (std::is_same_v<Type, uint8_t>) return MatrixDType::UInt8;
+        else if constexpr (std::is_same_v<Type, Float16>) return MatrixDType::Float16;
+        else if constexpr (std::is_same_v<Type, BFloat16>) return MatrixDType::BFloat16;
+        else return MatrixDType::Unknown;
+    }
+
+    inline size_t PageSize(){
+#ifdef MATRIX_POSIX_IO
+        static const size_t page = size_t(sysconf(_SC_PAGESIZE));
+        return page;
+#else
+        return 4096;
+#endif
+    }
+
+    inline uint64_t PayloadElements(int64_t rows, int64_t columns, int64_t stride){
+        return rows == 0 ? 0 : uint64_t(rows - 1) * uint64_t(stride) + uint64_t(columns);
+    }
+
+    /*
+     * Checks a header against the element type and the size of the file it came from. The shape must fit
+     * the int sizes of Matrix and MatrixView, and the payload bound is tested without any sum or product
+     * that could wrap: with rows and stride at most INT_MAX the element count stays below 2^63, and it is
+     * compared with the bytes left after the offset instead of being scaled and added to it.
+     */
+    template<typename Type>
+    bool ValidateHeader(const MatrixFileHeader &header, uint64_t file_bytes){
+        if (std::memcmp(header.magic, FileMagic, sizeof(FileMagic)) != 0 ||
+            header.version != FileVersion ||
+            header.byte_order != FileByteOrder ||
+            header.dtype != uint32_t(DTypeOf<Type>()) ||
+            header.element_size != sizeof(Type))
+            return false;
+        if (header.rows < 0 || header.columns < 0 || header.stride < header.columns ||
+            header.rows > INT_MAX || header.columns > INT_MAX || header.stride > INT_MAX)
+            return false;
+        if (header.payload_offset < sizeof(MatrixFileHeader) || header.payload_offset % Alignment != 0 ||
+            header.payload_offset > file_bytes)
+            return false;
+        return PayloadElements(header.rows, header.columns, header.stride) <= (file_bytes - header.payload_offset) / sizeof(Type);
+    }
+
+    template<typename Type>
+    MatrixFileHeader MakeFileHeader(int64_t rows, int64_t columns, int64_t stride){
+        static_assert(DTypeOf<Type>() != MatrixDType::Unknown, "Matrix files only hold float, double, int32, int64, uint8, Float16 and BFloat16");
+        MatrixFileHeader header{};
+        std::memcpy(header.magic, FileMagic, sizeof(FileMagic));
+        header.version = FileVersion;
+        header.byte_order = FileByteOrder;
+        header.dtype = uint32_t(DTypeOf<Type>());
+        header.element_size = sizeof(Type);
+        header.alignment = uint32_t(PageSize());
+        header.rows = rows;
+        header.columns = columns;
+        header.stride = stride;
+        header.payload_offset = PageSize();
+        return header;
+    }
+
+    template<typename Type>
+    bool SaveMatrix(const MatrixView<Type> &Source, const std::string &path){
+        MATRIX_PROFILE("MatrixDetail::SaveMatrix(const MatrixView<Type> &Source, const std::string &path)");
+        // Sub-views carry their parent's stride; anything wider than a fresh matrix would pad to is repacked
+        if (!Source.IsRowContiguous() || (Source.GetRows() > 1 &&
+            (Source.GetRowStride() < Source.GetColumns() ||
+             Source.GetRowStride() > MatrixLayout::LeadingDimension<Type>(Source.GetRows(), Source.GetColumns()))))
+            return SaveMatrix(Matrix<Type>(Source).GetView(), path);
+
+        std::string page(PageSize(), '\0');
+        MatrixFileHeader header = MakeFileHeader<Type>(Source.GetRows(), Source.GetColumns(),
+                                                       Source.GetRows() > 1 ? Source.GetRowStride() : Source.GetColumns());
+        std::memcpy(&page[0], &header, sizeof(header));
+
+        size_t payload = PayloadElements(header.rows, header.columns, header.stride) * sizeof(Type);
+        const char *data = reinterpret_cast<const char *>(Source.Data());
+
+        // Written next to path and renamed over it, so a MatrixMapping of the old file never sees it truncated
+#ifdef MATRIX_POSIX_IO
+        std::string temp_path = path + ".XXXXXX";
+        int fd = ::mkstemp(&temp_path[0]);
+        if (fd < 0)
+            return false;
+        iovec parts[2] = {{&page[0], page.size()}, {const_cast<char *>(data), payload}};
+        size_t total = page.size() + payload;
+        size_t written = 0;
+        bool ok = true;
+        // A single writev; the loop only resumes after a short write
+        while (ok && written < total) {
+            int first = written < parts[0].iov_len ? 0 : 1;
+            iovec pending[2] = {parts[0], parts[1]};
+            size_t skip = written - (first ? parts[0].iov_len : 0);
+            pending[first].iov_base = static_cast<char *>(pending[first].iov_base) + skip;
+            pending[first].iov_len -= skip;
+            ssize_t result = ::writev(fd, pending + first, 2 - first);
+            if (result <= 0)
+                ok = false;
+            else
+                written += size_t(result);
+        }
+        ok = ::fchmod(fd, 0644) == 0 && ok;
+        ok = ::close(fd) == 0 && ok;
+        if (!(ok && ::rename(temp_path.c_str(), path.c_str()) == 0)) {
+            ::unlink(temp_path.c_str());
+            return false;
+        }
+        return true;
+#else
+        std::string temp_path = path + ".tmp";
+        FILE *file = std::fopen(temp_path.c_str(), "wb");
+        if (!file)
+            return false;
+        bool ok = std::fwrite(page.data(), 1, page.size(), file) == page.size() &&
+                  std::fwrite(data, 1, payload, file) == payload;
+        ok = std::fclose(file) == 0 && ok;
+        // rename does not replace an existing file everywhere
+        if (ok && std::rename(temp_path.c_str(), path.c_str()) != 0)
+            ok = std::remove(path.c_str()) == 0 && std::rename(temp_path.c_str(), path.c_str()) == 0;
+        if (!ok)
+            std::remove(temp_path.c_str());
+        return ok;
+#endif
+    }
+}
+
+/*
+ * Read-only, zero-copy access to a matrix file: the file is mapped and GetView() points straight
+ * into the mapping, so opening costs O(1) regardless of size and pages are read on first touch.
+ * Views handed out stay valid while this object lives. Without POSIX the payload is read into memory.
+ */
+template<typename Type>
+class MatrixMapping {
+
+private:
+    MatrixFileHeader header{};
+    void *mapping = nullptr;
+    size_t mapped_bytes = 0;
+    const Type *payload = nullptr;
+
+    void Close(){
+#ifdef MATRIX_POSIX_IO
+        if (mapping)
+            ::munmap(mapping, mapped_bytes);
+#else
+        MatrixDetail::FreeAligned(static_cast<unsigned char *>(mapping));
+#endif
+        mapping = nullptr;
+        mapped_bytes = 0;
+        payload = nullptr;
+        header = MatrixFileHeader{};
+    }
+
+public:
+    MatrixMapping() = default;
+
+    explicit MatrixMapping(const std::string &path){
+        Open(path);
+    }
+
+    MatrixMapping(const MatrixMapping &) = delete;
+    MatrixMapping &operator=(const MatrixMapping &) = delete;
+
+    MatrixMapping(MatrixMapping &&other) noexcept{
+        *this = std::move(other);
+    }
+
+    MatrixMapping &operator=(MatrixMapping &&other) noexcept{
+        if (this != &other) {
+            Close();
+            std::swap(header, other.header);
+            std::swap(mapping, other.mapping);
+            std::swap(mapped_bytes, other.mapped_bytes);
+            std::swap(payload, other.payload);
+        }
+        return *this;
+    }
+
+    ~MatrixMapping(){
+        Close();
+    }
+
+    bool Open(const std::string &path){
+        MATRIX_PROFILE("MatrixMapping::Open(const std::string &path)");
+        Close();
+#ifdef MATRIX_POSIX_IO
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info{};
+        if (::fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(MatrixFileHeader)) {
+            ::close(fd);
+            return false;
+        }
+        mapped_bytes = size_t(info.st_size);
+        mapping = ::mmap(nullptr, mapped_bytes, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            mapping = nullptr;
+            mapped_bytes = 0;
+            return false;
+        }
+#else
+        FILE *file = std::fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+        std::fseek(file, 0, SEEK_END);
+        mapped_bytes = size_t(std::ftell(file));
+        std::fseek(file, 0, SEEK_SET);
+        mapping = MatrixDetail::AllocAligned<unsigned char>(mapped_bytes);
+        bool read = mapping && std::fread(mapping, 1, mapped_bytes, file) == mapped_bytes;
+        std::fclose(file);
+        if (!read || mapped_bytes < sizeof(MatrixFileHeader)) {
+            Close();
+            return false;
+        }
+#endif
+        std::memcpy(&header, mapping, sizeof(header));
+        if (!MatrixDetail::ValidateHeader<Type>(header, mapped_bytes)) {
+#ifdef DEBUG
+            std::cout << "Not a matrix file of this element type: " << path << "\n";
+#endif
+            Close();
+            return false;
+        }
+        payload = reinterpret_cast<const Type *>(static_cast<const char *>(mapping) + header.payload_offset);
+        return true;
+    }
+
+    [[nodiscard]] bool IsOpen() const { return payload != nullptr || mapping != nullptr; }
+    // ValidateHeader bounds the shape by INT_MAX, so these never narrow
+    [[nodiscard]] int GetRows() const { return int(header.rows); }
+    [[nodiscard]] int GetColumns() const { return int(header.columns); }
+    [[nodiscard]] int GetStride() const { return int(header.stride); }
+    [[nodiscard]] const MatrixFileHeader &GetHeader() const { return header; }
+
+    [[nodiscard]] MatrixView<Type> GetView() const{
+        assert(IsOpen());
+        return MatrixView<Type>(payload, GetRows(), GetColumns(), GetStride());
+    }
+
+    // Hints the kernel to read the whole payload ahead, e.g. right before a full pass over it
+    void Prefetch() const{
+#ifdef MATRIX_POSIX_IO
+        if (mapping)
+            ::madvise(mapping, mapped_bytes, MADV_WILLNEED);
+#endif
+    }
+};
@@ -0,0 +1,374 @@
+#pragma once
+
+#include <array>
+#include <initializer_list>
+#include <type_traits>
+#include <utility>
+#include "Matrix.h"
+
+/*
+ * Statically sized matrix, e.g. Matrix<float, 3, 3>. Elements live inline in a row-major
+ * std::array, so there is no heap traffic and small matrices stay in registers. Every
+ * operation is constexpr; products are unrolled through index sequences and 2x2, 3x3 and
+ * 4x4 determinants and inverses use closed forms. Shape mismatches fail to compile.
+ * Converts explicitly from and implicitly to the dynamic Matrix<Type>.
+ */
+template<typename Type, int Rows, int Columns>
+class Matrix {
+
+    static_assert(Rows > 0 && Columns > 0, "Fixed matrix dimensions must be positive");
+
+    template<typename, int, int>
+    friend class Matrix;
+
+private:
+    std::array<Type, size_t(Rows) * Columns> data{};
+
+    // Unrolled dot product of a row with a column read at stride K
+    template<int K, size_t... P>
+    static constexpr Type Dot(const Type *row, const Type *column, std::index_sequence<P...>){
+        return ((row[P] * column[P * K]) + ... + Type());
+    }
+
+    static constexpr Type Abs(Type value) { return value < Type(0) ? -value : value; }
+
+    // std::swap is not constexpr before C++20
+    static constexpr void Swap(Type &a, Type &b){
+        Type temp = a;
+        a = b;
+        b = temp;
+    }
+
+    constexpr const Type &At(int i, int j) const { return data[size_t(i) * Columns + j]; }
+    constexpr Type &At(int i, int j) { return data[size_t(i) * Columns + j]; }
+
+    // Gauss-Jordan with partial pivoting for sizes without a closed form, eliminated in the
+    // factor type as the dynamic Inverse is
+    constexpr bool InverseGeneral(){
+        using Factor = MatrixDetail::FactorType<Type>;
+        using Work = Matrix<Factor, Rows, Columns>;
+        Work identity = Work::Identity();
+        Work work;
+        for (size_t i = 0; i < data.size(); i++)
+            work.data[i] = Factor(data[i]);
+        for (int j = 0; j < Rows; j++) {
+            int p = j;
+            for (int i = j + 1; i < Rows; i++)
+                if (Work::Abs(work.At(i, j)) > Work::Abs(work.At(p, j)))
+                    p = i;
+            if (work.At(p, j) == Factor(0))
+                return false;
+            for (int c = 0; c < Columns; c++) {
+                Work::Swap(work.At(j, c), work.At(p, c));
+                Work::Swap(identity.At(j, c), identity.At(p, c));
+            }
+            Factor inv = Factor(1) / work.At(j, j);
+            for (int c = 0; c < Columns; c++) {
+                work.At(j, c) *= inv;
+                identity.At(j, c) *= inv;
+            }
+            for (int i = 0; i < Rows; i++) {
+                if (i == j)
+                    continue;
+                Factor l = work.At(i, j);
+                for (int c = 0; c < Columns; c++) {
+                    work.At(i, c) -= l * work.At(j, c);
+                    identity.At(i, c) -= l * identity.At(j, c);
+                }
+            }
+        }
+        for (size_t i = 0; i < data.size(); i++)
+            data[i] = Type(identity.data[i]);
+        return true;
+    }
+
+public:
+    constexpr Matrix() = default;
+
+    constexpr Matrix(std::initializer_list<std::initializer_list<Type>> Data){
+        assert(Data.size() == size_t(Rows));
+        int i = 0;
+        for (const auto &row : Data) {
+            assert(row.size() == size_t(Columns));
+            int j = 0;
+            for (const auto &value : row)
+                At(i, j++) = value;
+            i++;
+        }
+    }
+
+    explicit Matrix(const Matrix<Type> &Dynamic){
+        assert(Dynamic.GetRows() == Rows && Dynamic.GetColumns() == Columns);
+        for (int i = 0; i < Rows; i++)
+            for (int j = 0; j < Columns; j++)
+                At(i, j) = Dynamic[i][j];
+    }
+
+    operator Matrix<Type>() const{
+        Matrix<Type> result(Rows, Columns);
+        for (int i = 0; i < Rows; i++)
+            for (int j = 0; j < Columns; j++)
+                result[i][j] = At(i, j);
+        return result;
+    }
+
+    static constexpr Matrix Identity(){
+        static_assert(Rows == Columns, "Identity is only defined for square matrices");
+        Matrix result;
+        for (int i = 0; i < Rows; i++)
+            result.At(i, i) = Type(1);
+        return result;
+    }
+
+    [[nodiscard]] static constexpr int GetRows() { return Rows; }
+    [[nodiscard]] static constexpr int GetColumns() { return Columns; }
+
+    [[nodiscard]] constexpr Type *Data() { return data.data(); }
+    [[nodiscard]] constexpr const Type *Data() const { return data.data(); }
+
+    constexpr Type *operator[](const int idx) { return data.data() + size_t(idx) * Columns; }
+    constexpr const Type *operator[](const int idx) const { return data.data() + size_t(idx) * Columns; }
+
+    constexpr Type &operator()(int i, int j) { return At(i, j); }
+    constexpr const Type &operator()(int i, int j) const { return At(i, j); }
+
+    constexpr Matrix<Type, Columns, Rows> Transposed() const{
+        Matrix<Type, Columns, Rows> result;
+        for (int i = 0; i < Rows; i++)
+            for (int j = 0; j < Columns; j++)
+                result.At(j, i) = At(i, j);
+        return result;
+    }
+
+    constexpr void T(){
+        static_assert(Rows == Columns, "In-place transpose needs a square matrix, use Matrix::T(matrix)");
+        for (int i = 0; i < Rows; i++)
+            for (int j = i + 1; j < Columns; j++)
+                Swap(At(i, j), At(j, i));
+    }
+
+    static constexpr Matrix<Type, Columns, Rows> T(const Matrix &matrix) {
+        return matrix.Transposed();
+    }
+
+    [[nodiscard]] constexpr Type Determinant() const{
+        static_assert(Rows == Columns, "Determinant is only defined for square matrices");
+        const auto &m = data;
+        if constexpr (Rows == 1)
+            return m[0];
+        else if constexpr (Rows == 2)
+            return m[0] * m[3] - m[1] * m[2];
+        else if constexpr (Rows == 3)
+            return m[0] * (m[4] * m[8] - m[5] * m[7])
+                 - m[1] * (m[3] * m[8] - m[5] * m[6])
+                 + m[2] * (m[3] * m[7] - m[4] * m[6]);
+        else if constexpr (Rows == 4) {
+            Type s0 = m[0] * m[5] - m[4] * m[1], s1 = m[0] * m[6] - m[4] * m[2];
+            Type s2 = m[0] * m[7] - m[4] * m[3], s3 = m[1] * m[6] - m[5] * m[2];
+            Type s4 = m[1] * m[7] - m[5] * m[3], s5 = m[2] * m[7] - m[6] * m[3];
+            Type c5 = m[10] * m[15] - m[14] * m[11], c4 = m[9] * m[15] - m[13] * m[11];
+            Type c3 = m[9] * m[14] - m[13] * m[10], c2 = m[8] * m[15] - m[12] * m[11];
+            Type c1 = m[8] * m[14] - m[12] * m[10], c0 = m[8] * m[13] - m[12] * m[9];
+            return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+        }
+        else {
+            // Eliminated in the factor type: integer division would zero the multipliers
+            using Factor = MatrixDetail::FactorType<Type>;
+            using Work = Matrix<Factor, Rows, Columns>;
+            Work work;
+            for (size_t i = 0; i < data.size(); i++)
+                work.data[i] = Factor(data[i]);
+            Factor det = Factor(1);
+            for (int j = 0; j < Rows; j++) {
+                int p = j;
+                for (int i = j + 1; i < Rows; i++)
+                    if (Work::Abs(work.At(i, j)) > Work::Abs(work.At(p, j)))
+                        p = i;
+                if (work.At(p, j) == Factor(0))
+                    return Type(0);
+                if (p != j) {
+                    for (int c = 0; c < Columns; c++)
+                        Work::Swap(work.At(j, c), work.At(p, c));
+                    det = -det;
+                }
+                det *= work.At(j, j);
+                for (int i = j + 1; i < Rows; i++) {
+                    Factor l = work.At(i, j) / work.At(j, j);
+                    for (int c = j + 1; c < Columns; c++)
+                        work.At(i, c) -= l * work.At(j, c);
+                }
+            }
+            if constexpr (std::is_integral_v<Type>)
+                return Type(det < Factor(0) ? det - Factor(0.5) : det + Factor(0.5));
+            else
+                return Type(det);
+        }
+    }
+
+    // Inverts in place; a singular matrix is left unchanged
+    constexpr void Inverse(){
+        static_assert(Rows == Columns, "Inverse is only defined for square matrices");
+        static_assert(std::is_floating_point_v<Type>, "Matrix::Inverse needs a floating point matrix");
+        const auto m = data;
+        if constexpr (Rows == 1) {
+            if (m[0] != Type(0))
+                data[0] = Type(1) / m[0];
+        }
+        else if constexpr (Rows == 2) {
+            Type det = Determinant();
+            if (det == Type(0))
+                return;
+            Type inv = Type(1) / det;
+            data = {m[3] * inv, -m[1] * inv, -m[2] * inv, m[0] * inv};
+        }
+        else if constexpr (Rows == 3) {
+            Type det = Determinant();
+            if (det == Type(0))
+                return;
+            Type inv = Type(1) / det;
+            data = {(m[4] * m[8] - m[5] * m[7]) * inv, (m[2] * m[7] - m[1] * m[8]) * inv, (m[1] * m[5] - m[2] * m[4]) * inv,
+                    (m[5] * m[6] - m[3] * m[8]) * inv, (m[0] * m[8] - m[2] * m[6]) * inv, (m[2] * m[3] - m[0] * m[5]) * inv,
+                    (m[3] * m[7] - m[4] * m[6]) * inv, (m[1] * m[6] - m[0] * m[7]) * inv, (m[0] * m[4] - m[1] * m[3]) * inv};
+        }
+        else if constexpr (Rows == 4) {
+            Type s0 = m[0] * m[5] - m[4] * m[1], s1 = m[0] * m[6] - m[4] * m[2];
+            Type s2 = m[0] * m[7] - m[4] * m[3], s3 = m[1] * m[6] - m[5] * m[2];
+            Type s4 = m[1] * m[7] - m[5] * m[3], s5 = m[2] * m[7] - m[6] * m[3];
+            Type c5 = m[10] * m[15] - m[14] * m[11], c4 = m[9] * m[15] - m[13] * m[11];
+            Type c3 = m[9] * m[14] - m[13] * m[10], c2 = m[8] * m[15] - m[12] * m[11];
+            Type c1 = m[8] * m[14] - m[12] * m[10], c0 = m[8] * m[13] - m[12] * m[9];
+            Type det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+            if (det == Type(0))
+                return;
+            Type inv = Type(1) / det;
+            data = {( m[5] * c5 - m[6] * c4 + m[7] * c3) * inv, (-m[1] * c5 + m[2] * c4 - m[3] * c3) * inv,
+                    ( m[13] * s5 - m[14] * s4 + m[15] * s3) * inv, (-m[9] * s5 + m[10] * s4 - m[11] * s3) * inv,
+                    (-m[4] * c5 + m[6] * c2 - m[7] * c1) * inv, ( m[0] * c5 - m[2] * c2 + m[3] * c1) * inv,
+                    (-m[12] * s5 + m[14] * s2 - m[15] * s1) * inv, ( m[8] * s5 - m[10] * s2 + m[11] * s1) * inv,
+                    ( m[4] * c4 - m[5] * c2 + m[7] * c0) * inv, (-m[0] * c4 + m[1] * c2 - m[3] * c0) * inv,
+                    ( m[12] * s4 - m[13] * s2 + m[15] * s0) * inv, (-m[8] * s4 + m[9] * s2 - m[11] * s0) * inv,
+                    (-m[4] * c3 + m[5] * c1 - m[6] * c0) * inv, ( m[0] * c3 - m[1] * c1 + m[2] * c0) * inv,
+                    (-m[12] * s3 + m[13] * s1 - m[14] * s0) * inv, ( m[8] * s3 - m[9] * s1 + m[10] * s0) * inv};
+        }
+        else
+            InverseGeneral();
+    }
+
+    static constexpr Matrix Inverse(Matrix matrix) {
+        matrix.Inverse();
+        return matrix;
+    }
+
+    template<int K>
+    constexpr Matrix<Type, Rows, K> operator*(const Matrix<Type, Columns, K> &other) const {
+        Matrix<Type, Rows, K> result;
+        for (int i = 0; i < Rows; i++)
+            for (int j = 0; j < K; j++)
+                result.At(i, j) = Dot<K>(&At(i, 0), &other.At(0, j), std::make_index_sequence<Columns>());
+        return result;
+    }
+
+    constexpr Matrix &operator*=(const Matrix<Type, Columns, Columns> &other) {
+        *this = *this * other;
+        return *this;
+    }
+
+    constexpr Matrix &operator+=(const Matrix &other) {
+        for (size_t i = 0; i < data.size(); i++)
+            data[i] += other.data[i];
+        return *this;
+    }
+
+    constexpr Matrix &operator-=(const Matrix &other) {
+        for (size_t i = 0; i < data.size(); i++)
+            data[i] -= other.data[i];
+        return *this;
+    }
+
+    template<typename T, std::enable_if_t<MatrixDetail::IsScalarV<T>, int> = 0>
+    constexpr Matrix &operator*=(const T value) {
+        for (auto &element : data)
+            element *= value;
+        return *this;
+    }
+
+    template<typename T, std::enable_if_t<MatrixDetail::IsScalarV<T>, int> = 0>
+    constexpr Matrix &operator/=(const T value) {
+        for (auto &element : data)
+            element /= value;
+        return *this;
+    }
+
+    constexpr Matrix operator+(const Matrix &other) const {
+        Matrix temp(*this);
+        temp += other;
+        return temp;
+    }
+
+    constexpr Matrix operator-(const Matrix &other) const {
+        Matrix temp(*this);
+        temp -= other;
+        return temp;
+    }
+
+    constexpr Matrix operator-() const {
+        Matrix temp(*this);
+        temp *= -1;
+        return temp;
+    }
+
+    template<typename T, std::enable_if_t<MatrixDetail::IsScalarV<T>, int> = 0>
+    constexpr Matrix operator*(const T value) const {
+        Matrix temp(*this);
+        temp *= value;
+        return temp;
+    }
+
+    template<typename T, std::enable_if_t<MatrixDetail::IsScalarV<T>, int> = 0>
+    constexpr Matrix operator/(const T value) const {
+        Matrix temp(*this);
+        temp /= value;
+        return temp;
+    }
+
+    constexpr bool operator==(const Matrix &other) const {
+        for (size_t i = 0; i < data.size(); i++)
+            if (data[i] != other.data[i])
+                return false;
+        return true;
+    }
+
+    constexpr bool operator!=(const Matrix &other) const {
+        return !(*this == other);
+    }
+
+    void PrintMatrix() const{
+        std::cout << "\nPrinting matrix. Rows: " << Rows << " Columns: " << Columns <<"\n";
+        for (int i = 0; i < Rows; i++) {
+            for (int j = 0; j < Columns; j++)
+                std::cout << At(i, j);
+            std::cout << "\n";
+        }
+        std::cout << "\n";
+    }
+};
+
+template<typename T, typename Type, int Rows, int Columns,
+         std::enable_if_t<MatrixDetail::IsScalarV<T> && Rows != MatrixDynamic, int> = 0>
+constexpr Matrix<Type, Rows, Columns> operator*(const T value, const Matrix<Type, Rows, Columns> &other)
+{
+    return other * value;
+}
+
+// Mixing fixed and dynamic operands goes through the dynamic path
+template<typename Type, int Rows, int Columns, std::enable_if_t<Rows != MatrixDynamic, int> = 0>
+Matrix<Type> operator*(const Matrix<Type, Rows, Columns> &left, const Matrix<Type> &right)
+{
+    return Matrix<Type>(left) * right;
+}
+
+template<typename Type, int Rows, int Columns, std::enable_if_t<Rows != MatrixDynamic, int> = 0>
+Matrix<Type> operator*(const Matrix<Type> &left, const Matrix<Type, Rows, Columns> &right)
+{
+    return left * Matrix<Type>(right);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// Marks a dimension that is only known at runtime; Matrix<Type> is Matrix<Type, MatrixDynamic, MatrixDynamic>
+constexpr int MatrixDynamic = -1;
+
+template<typename Type, int Rows = MatrixDynamic, int Columns = MatrixDynamic>
+class Matrix;
+
+template<typename Type>
+class MatrixView;
+
+template<typename Type>
+class SparseMatrix;
+
+template<typename Type>
+class Vector;
+
+template<typename Type>
+class MatrixMapping;
+
+template<typename Type>
+class MatrixFuture;
@@ -0,0 +1,437 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include "MatrixHalf.h"
+#include "MatrixMemory.h"
+#include "MatrixProfiler.h"
+#include "MatrixThreadPool.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MATRIX_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/*
+ * Blocked GEMM engine (Goto/BLIS layout):
+ *   jc loop - NC columns of B, kept in L3
+ *   pc loop - KC deep slice, B slice packed into NR wide micro-panels
+ *   ic loop - MC rows of A packed into MR high micro-panels, kept in L2
+ *   jr/ir   - MR x NR register tile computed by the micro-kernel, B micro-panel stays in L1
+ * Micro-kernels for float/double are selected once at runtime from CPUID;
+ * any other element type goes through the portable kernel. Operands stored in
+ * another type (e.g. Float16) are widened to the kernel type while being packed.
+ */
+enum class GemmIsa { Generic, SSE, AVX2, AVX512 };
+
+namespace MatrixDetail {
+
+    inline GemmIsa DetectGemmIsa(){
+#ifdef MATRIX_X86_DISPATCH
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return GemmIsa::AVX512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return GemmIsa::AVX2;
+        if (__builtin_cpu_supports("sse2"))
+            return GemmIsa::SSE;
+#endif
+        return GemmIsa::Generic;
+    }
+
+    // Writable so that a narrower ISA can be forced, e.g. to compare kernels
+    inline GemmIsa &ActiveGemmIsa(){
+        static GemmIsa isa = DetectGemmIsa();
+        return isa;
+    }
+
+    // Micro-kernels compute an MR x NR tile over kc packed steps and store it to a dense MR x NR buffer
+    template<typename Type>
+    using MicroKernel = void (*)(int kc, const Type *A, const Type *B, Type *Tile);
+
+    template<typename Type>
+    struct GemmKernel {
+        int mr;
+        int nr;
+        MicroKernel<Type> kernel;
+    };
+
+    template<typename Type, int MR, int NR>
+    void KernelGeneric(int kc, const Type *A, const Type *B, Type *Tile){
+        Type acc[MR][NR] = {};
+        for (int p = 0; p < kc; p++, A += MR, B += NR)
+            for (int i = 0; i < MR; i++)
+                for (int j = 0; j < NR; j++)
+                    acc[i][j] += A[i] * B[j];
+        for (int i = 0; i < MR; i++)
+            for (int j = 0; j < NR; j++)
+                Tile[i * NR + j] = acc[i][j];
+    }
+
+#ifdef MATRIX_X86_DISPATCH
+    __attribute__((target("sse2")))
+    inline void KernelSSE(int kc, const float *A, const float *B, float *Tile){
+        __m128 c[4][2];
+        for (auto &row : c)
+            row[0] = row[1] = _mm_setzero_ps();
+        for (int p = 0; p < kc; p++, A += 4, B += 8) {
+            __m128 b0 = _mm_load_ps(B);
+            __m128 b1 = _mm_load_ps(B + 4);
+            for (int i = 0; i < 4; i++) {
+                __m128 a = _mm_set1_ps(A[i]);
+                c[i][0] = _mm_add_ps(c[i][0], _mm_mul_ps(a, b0));
+                c[i][1] = _mm_add_ps(c[i][1], _mm_mul_ps(a, b1));
+            }
+        }
+        for (int i = 0; i < 4; i++) {
+            _mm_store_ps(Tile + i * 8, c[i][0]);
+            _mm_store_ps(Tile + i * 8 + 4, c[i][1]);
+        }
+    }
+
+    __attribute__((target("sse2")))
+    inline void KernelSSE(int kc, const double *A, const double *B, double *Tile){
+        __m128d c[4][2];
+        for (auto &row : c)
+            row[0] = row[1] = _mm_setzero_pd();
+        for (int p = 0; p < kc; p++, A += 4, B += 4) {
+            __m128d b0 = _mm_load_pd(B);
+            __m128d b1 = _mm_load_pd(B + 2);
+            for (int i = 0; i < 4; i++) {
+                __m128d a = _mm_set1_pd(A[i]);
+                c[i][0] = _mm_add_pd(c[i][0], _mm_mul_pd(a, b0));
+                c[i][1] = _mm_add_pd(c[i][1], _mm_mul_pd(a, b1));
+            }
+        }
+        for (int i = 0; i < 4; i++) {
+            _mm_store_pd(Tile + i * 4, c[i][0]);
+            _mm_store_pd(Tile + i * 4 + 2, c[i][1]);
+        }
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline void KernelAVX2(int kc, const float *A, const float *B, float *Tile){
+        __m256 c[6][2];
+        for (auto &row : c)
+            row[0] = row[1] = _mm256_setzero_ps();
+        for (int p = 0; p < kc; p++, A += 6, B += 16) {
+            __m256 b0 = _mm256_load_ps(B);
+            __m256 b1 = _mm256_load_ps(B + 8);
+            for (int i = 0; i < 6; i++) {
+                __m256 a = _mm256_broadcast_ss(A + i);
+                c[i][0] = _mm256_fmadd_ps(a, b0, c[i][0]);
+                c[i][1] = _mm256_fmadd_ps(a, b1, c[i][1]);
+            }
+        }
+        for (int i = 0; i < 6; i++) {
+            _mm256_store_ps(Tile + i * 16, c[i][0]);
+            _mm256_store_ps(Tile + i * 16 + 8, c[i][1]);
+        }
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline void KernelAVX2(int kc, const double *A, const double *B, double *Tile){
+        __m256d c[6][2];
+        for (auto &row : c)
+            row[0] = row[1] = _mm256_setzero_pd();
+        for (int p = 0; p < kc; p++, A += 6, B += 8) {
+            __m256d b0 = _mm256_load_pd(B);
+            __m256d b1 = _mm256_load_pd(B + 4);
+            for (int i = 0; i < 6; i++) {
+                __m256d a = _mm256_broadcast_sd(A + i);
+                c[i][0] = _mm256_fmadd_pd(a, b0, c[i][0]);
+                c[i][1] = _mm256_fmadd_pd(a, b1, c[i][1]);
+            }
+        }
+        for (int i = 0; i < 6; i++) {
+            _mm256_store_pd(Tile + i * 8, c[i][0]);
+            _mm256_store_pd(Tile + i * 8 + 4, c[i][1]);
+        }
+    }
+
+    __attribute__((target("avx512f")))
+    inline void KernelAVX512(int kc, const float *A, const float *B, float *Tile){
+        __m512 c[12][2];
+        for (auto &row : c)
+            row[0] = row[1] = _mm512_setzero_ps();
+        for (int p = 0; p < kc; p++, A += 12, B += 32) {
+            __m512 b0 = _mm512_load_ps(B);
+            __m512 b1 = _mm512_load_ps(B + 16);
+            for (int i = 0; i < 12; i++) {
+                __m512 a = _mm512_set1_ps(A[i]);
+                c[i][0] = _mm512_fmadd_ps(a, b0, c[i][0]);
+                c[i][1] = _mm512_fmadd_ps(a, b1, c[i][1]);
+            }
+        }
+        for (int i = 0; i < 12; i++) {
+            _mm512_store_ps(Tile + i * 32, c[i][0]);
+            _mm512_store_ps(Tile + i * 32 + 16, c[i][1]);
+        }
+    }
+
+    __attribute__((target("avx512f")))
+    inline void KernelAVX512(int kc, const double *A, const double *B, double *Tile){
+        __m512d c[12][2];
+        for (auto &row : c)
+            row[0] = row[1] = _mm512_setzero_pd();
+        for (int p = 0; p < kc; p++, A += 12, B += 16) {
+            __m512d b0 = _mm512_load_pd(B);
+            __m512d b1 = _mm512_load_pd(B + 8);
+            for (int i = 0; i < 12; i++) {
+                __m512d a = _mm512_set1_pd(A[i]);
+                c[i][0] = _mm512_fmadd_pd(a, b0, c[i][0]);
+                c[i][1] = _mm512_fmadd_pd(a, b1, c[i][1]);
+            }
+        }
+        for (int i = 0; i < 12; i++) {
+            _mm512_store_pd(Tile + i * 16, c[i][0]);
+            _mm512_store_pd(Tile + i * 16 + 8, c[i][1]);
+        }
+    }
+#endif
+
+    template<typename Type>
+    GemmKernel<Type> SelectGemmKernel(){
+#ifdef MATRIX_X86_DISPATCH
+        if constexpr (std::is_same_v<Type, float>) {
+            switch (ActiveGemmIsa()) {
+                case GemmIsa::AVX512: return {12, 32, &KernelAVX512};
+                case GemmIsa::AVX2: return {6, 16, &KernelAVX2};
+                case GemmIsa::SSE: return {4, 8, &KernelSSE};
+                default: break;
+            }
+        }
+        if constexpr (std::is_same_v<Type, double>) {
+            switch (ActiveGemmIsa()) {
+                case GemmIsa::AVX512: return {12, 16, &KernelAVX512};
+                case GemmIsa::AVX2: return {6, 8, &KernelAVX2};
+                case GemmIsa::SSE: return {4, 4, &KernelSSE};
+                default: break;
+            }
+        }
+#endif
+        return {4, 4, &KernelGeneric<Type, 4, 4>};
+    }
+
+    /*
+     * Copies an mc x kc block of A into MR high column-major micro-panels, zero padding the last panel.
+     * A is addressed as A[i * rsa + p * csa], so a transposed operand is packed straight from its source.
+     */
+    template<typename Type, typename TypeA>
+    void PackA(int mc, int kc, const TypeA *A, ptrdiff_t rsa, ptrdiff_t csa, int MR, Type *Packed){
+        if constexpr (IsHalfV<TypeA>) {
+            if (csa == 1) {
+                // 16 bit rows are widened a run at a time so the conversion goes through SIMD, not per element
+                constexpr int Run = 256;
+                alignas(64) Type row[Run];
+                for (int ir = 0; ir < mc; ir += MR) {
+                    int mr = std::min(MR, mc - ir);
+                    for (int i = 0; i < MR; i++) {
+                        for (int p0 = 0; p0 < kc; p0 += Run) {
+                            int run = std::min(Run, kc - p0);
+                            if (i < mr)
+                                ConvertElements(A + (ir + i) * rsa + p0, row, size_t(run));
+                            else
+                                std::fill(row, row + run, Type());
+                            for (int p = 0; p < run; p++)
+                                Packed[(p0 + p) * MR + i] = row[p];
+                        }
+                    }
+                    Packed += size_t(MR) * kc;
+                }
+                return;
+            }
+        }
+        for (int ir = 0; ir < mc; ir += MR) {
+            int mr = std::min(MR, mc - ir);
+            for (int p = 0; p < kc; p++) {
+                for (int i = 0; i < mr; i++)
+                    Packed[i] = Type(A[(ir + i) * rsa + p * csa]);
+                for (int i = mr; i < MR; i++)
+                    Packed[i] = Type();
+                Packed += MR;
+            }
+        }
+    }
+
+    // Copies a kc x nc block of B (B[p * rsb + j * csb]) into NR wide row-major micro-panels, zero padding the last panel
+    template<typename Type, typename TypeB>
+    void PackB(int kc, int nc, const TypeB *B, ptrdiff_t rsb, ptrdiff_t csb, int NR, Type *Packed){
+        for (int jr = 0; jr < nc; jr += NR) {
+            int nr = std::min(NR, nc - jr);
+            for (int p = 0; p < kc; p++) {
+                const TypeB *src = B + p * rsb + jr * csb;
+                if (csb == 1)
+                    ConvertElements(src, Packed, nr);
+                else
+                    for (int j = 0; j < nr; j++)
+                        Packed[j] = Type(src[j * csb]);
+                for (int j = nr; j < NR; j++)
+                    Packed[j] = Type();
+                Packed += NR;
+            }
+        }
+    }
+
+    inline Workspace &GemmWorkspaceA(){
+        thread_local Workspace workspace;
+        return workspace;
+    }
+
+    inline Workspace &GemmWorkspaceB(){
+        thread_local Workspace workspace;
+        return workspace;
+    }
+
+    // Below this many multiply-adds packing costs more than it saves
+    constexpr long long GemmPackingThreshold = 32 * 32 * 32;
+
+    // Below this many multiply-adds a product stays on the calling thread
+    constexpr long long GemmParallelThreshold = 128 * 128 * 128;
+
+    // Packed, cache-blocked product of one C block; every thread packs into its own workspaces
+    template<typename Type, typename TypeA, typename TypeB>
+    void GemmBlocked(const GemmKernel<Type> &kernel, int m, int n, int k, const TypeA *A, ptrdiff_t rsa, ptrdiff_t csa,
+                     const TypeB *B, ptrdiff_t rsb, ptrdiff_t csb, Type *C, int ldc, Type alpha){
+        const int MR = kernel.mr;
+        const int NR = kernel.nr;
+        const int KC = sizeof(Type) > 4 ? 192 : 256;
+        const int MC = MR * std::max(1, 120 / MR);
+        const int NC = 4096;
+
+        Type *packedA = GemmWorkspaceA().Get<Type>(size_t(MC) * KC);
+        Type *packedB = GemmWorkspaceB().Get<Type>(size_t(std::min(n, NC) + NR) * KC);
+        alignas(64) Type tile[12 * 32];
+
+        for (int jc = 0; jc < n; jc += NC) {
+            int nc = std::min(NC, n - jc);
+            for (int pc = 0; pc < k; pc += KC) {
+                int kc = std::min(KC, k - pc);
+                PackB(kc, nc, B + pc * rsb + jc * csb, rsb, csb, NR, packedB);
+                for (int ic = 0; ic < m; ic += MC) {
+                    int mc = std::min(MC, m - ic);
+                    PackA(mc, kc, A + ic * rsa + pc * csa, rsa, csa, MR, packedA);
+                    for (int jr = 0; jr < nc; jr += NR) {
+                        int nr = std::min(NR, nc - jr);
+                        const Type *b = packedB + size_t(jr) * kc;
+                        for (int ir = 0; ir < mc; ir += MR) {
+                            int mr = std::min(MR, mc - ir);
+                            kernel.kernel(kc, packedA + size_t(ir) * kc, b, tile);
+                            Type *c = C + size_t(ic + ir) * ldc + jc + jr;
+                            for (int i = 0; i < mr; i++)
+                                for (int j = 0; j < nr; j++)
+                                    c[size_t(i) * ldc + j] += alpha * tile[i * NR + j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /*
+     * C[m x n] += alpha * A[m x k] * B[k x n] with C row-major (leading dimension ldc) and A, B given by
+     * a row and a column stride each, so transposed operands (swapped strides) are never materialized.
+     * A and B may have other element types; they are converted to Type while being packed.
+     */
+    template<typename Type, typename TypeA, typename TypeB>
+    void GemmStrided(int m, int n, int k, const TypeA *A, ptrdiff_t rsa, ptrdiff_t csa,
+                     const TypeB *B, ptrdiff_t rsb, ptrdiff_t csb, Type *C, int ldc, Type alpha = Type(1)){
+        if (m <= 0 || n <= 0 || k <= 0)
+            return;
+        MatrixProfiler::CountWork(2.0 * m * n * k,
+                                  size_t(m) * k * sizeof(TypeA) + size_t(k) * n * sizeof(TypeB) + 2 * size_t(m) * n * sizeof(Type));
+
+        if ((long long)m * n * k < GemmPackingThreshold) {
+            for (int i = 0; i < m; i++) {
+                Type *c = C + size_t(i) * ldc;
+                for (int p = 0; p < k; p++) {
+                    Type a = alpha * Type(A[i * rsa + p * csa]);
+                    const TypeB *b = B + p * rsb;
+                    if (csb == 1)
+                        for (int j = 0; j < n; j++)
+                            c[j] += a * Type(b[j]);
+                    else
+                        for (int j = 0; j < n; j++)
+                            c[j] += a * Type(b[j * csb]);
+                }
+            }
+            return;
+        }
+
+        const GemmKernel<Type> kernel = SelectGemmKernel<Type>();
+        MatrixThreadPool &pool = MatrixThreadPool::Instance();
+        int threads = pool.GetThreadCount();
+        if (threads == 1 || (long long)m * n * k < GemmParallelThreshold) {
+            GemmBlocked(kernel, m, n, k, A, rsa, csa, B, rsb, csb, C, ldc, alpha);
+            return;
+        }
+
+        // Split C into a grid of about 4 tiles per thread, shaped after C and aligned to the register tile
+        int target = threads * 4;
+        int split_m = std::clamp(int(std::ceil(std::sqrt(double(target) * m / n))), 1, (m + kernel.mr - 1) / kernel.mr);
+        int split_n = std::clamp((target + split_m - 1) / split_m, 1, (n + kernel.nr - 1) / kernel.nr);
+        int tile_m = ((m + split_m - 1) / split_m + kernel.mr - 1) / kernel.mr * kernel.mr;
+        int tile_n = ((n + split_n - 1) / split_n + kernel.nr - 1) / kernel.nr * kernel.nr;
+        int tiles_m = (m + tile_m - 1) / tile_m;
+        int tiles_n = (n + tile_n - 1) / tile_n;
+
+        pool.ParallelFor(0, tiles_m * tiles_n, 1, [&](int begin, int end) {
+            for (int tile = begin; tile < end; tile++) {
+                int i0 = (tile / tiles_n) * tile_m;
+                int j0 = (tile % tiles_n) * tile_n;
+                GemmBlocked(kernel, std::min(tile_m, m - i0), std::min(tile_n, n - j0), k,
+                            A + i0 * rsa, rsa, csa, B + j0 * csb, rsb, csb, C + size_t(i0) * ldc + j0, ldc, alpha);
+            }
+        });
+    }
+
+    // C[m x n] += alpha * A[m x k] * B[k x n], all row-major with leading dimensions lda/ldb/ldc
+    template<typename Type, typename TypeA>
+    void Gemm(int m, int n, int k, const TypeA *A, int lda, const Type *B, int ldb, Type *C, int ldc,
+              Type alpha = Type(1)){
+        GemmStrided(m, n, k, A, lda, 1, B, ldb, 1, C, ldc, alpha);
+    }
+
+    inline Workspace &MixedWorkspace(){
+        thread_local Workspace workspace;
+        return workspace;
+    }
+
+    /*
+     * C[m x n] += A[m x k] * B[k x n] with every sum carried in Accumulator whatever the three storage
+     * types are. A and B are widened while being packed; C is widened one row panel at a time into a
+     * scratch buffer, accumulated over the full depth there and rounded back once.
+     */
+    template<typename Accumulator, typename TypeA, typename TypeB, typename TypeC>
+    void GemmMixed(int m, int n, int k, const TypeA *A, ptrdiff_t rsa, ptrdiff_t csa,
+                   const TypeB *B, ptrdiff_t rsb, ptrdiff_t csb, TypeC *C, int ldc){
+        if constexpr (std::is_same_v<TypeC, Accumulator>) {
+            GemmStrided(m, n, k, A, rsa, csa, B, rsb, csb, C, ldc);
+        }
+        else {
+            if (m <= 0 || n <= 0 || k <= 0)
+                return;
+            // About 4 MB of accumulators per panel, but never so few rows that the panel cannot be split across threads
+            int panel = std::min(m, std::max(256, int((size_t(4) << 20) / (sizeof(Accumulator) * n))));
+            // Leased: the panel stays in use across ParallelFor and GemmStrided
+            WorkspaceLease lease(MixedWorkspace());
+            Accumulator *scratch = lease.Get<Accumulator>(size_t(panel) * n);
+            MatrixThreadPool &pool = MatrixThreadPool::Instance();
+            int grain = std::max(1, (1 << 14) / n);
+            for (int i0 = 0; i0 < m; i0 += panel) {
+                int rows = std::min(panel, m - i0);
+                pool.ParallelFor(0, rows, grain, [&](int begin, int end) {
+                    for (int i = begin; i < end; i++)
+                        ConvertElements(C + size_t(i0 + i) * ldc, scratch + size_t(i) * n, n);
+                });
+                GemmStrided(rows, n, k, A + i0 * rsa, rsa, csa, B, rsb, csb, scratch, n);
+                pool.ParallelFor(0, rows, grain, [&](int begin, int end) {
+                    for (int i = begin; i < end; i++)
+                        ConvertElements(scratch + size_t(i) * n, C + size_t(i0 + i) * ldc, n);
+                });
+            }
+        }
+    }
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MATRIX_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/*
+ * 16 bit storage types. Float16 is IEEE binary16 (the compiler's _Float16 where it has one,
+ * otherwise a software type with the same bits); BFloat16 keeps the float exponent and a 7 bit
+ * mantissa. Both are meant for storage: products and factorizations widen them to their
+ * MatrixAccumulator type, and arithmetic on single values goes through float.
+ */
+namespace MatrixDetail {
+    // binary32 -> binary16 with round to nearest even; subnormals, infinities and NaN are kept
+    inline uint16_t FloatToHalfBits(float value){
+        uint32_t x;
+        std::memcpy(&x, &value, sizeof(x));
+        uint32_t sign = (x >> 16) & 0x8000u;
+        uint32_t magnitude = x & 0x7fffffffu;
+        if (magnitude >= 0x7f800000u)
+            return uint16_t(sign | 0x7c00u | (magnitude > 0x7f800000u ? 0x200u : 0u));
+        if (magnitude >= 0x477ff000u)
+            return uint16_t(sign | 0x7c00u);
+        if (magnitude < 0x38800000u) {
+            // Adding 0.5 lines the float mantissa up with the 2^-24 spacing of half subnormals
+            float f;
+            std::memcpy(&f, &magnitude, sizeof(f));
+            f += 0.5f;
+            uint32_t bits;
+            std::memcpy(&bits, &f, sizeof(bits));
+            return uint16_t(sign | (bits - 0x3f000000u));
+        }
+        magnitude += 0xc8000fffu + ((magnitude >> 13) & 1u);
+        return uint16_t(sign | (magnitude >> 13));
+    }
+
+    inline float HalfBitsToFloat(uint16_t half){
+        uint32_t bits = uint32_t(half & 0x7fffu) << 13;
+        uint32_t exponent = bits & 0x0f800000u;
+        bits += uint32_t(127 - 15) << 23;
+        if (exponent == 0x0f800000u)
+            bits += uint32_t(128 - 16) << 23;
+        else if (exponent == 0) {
+            float f;
+            bits += 1u << 23;
+            std::memcpy(&f, &bits, sizeof(f));
+            f -= 6.103515625e-05f;
+            std::memcpy(&bits, &f, sizeof(bits));
+        }
+        bits |= uint32_t(half & 0x8000u) << 16;
+        float result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    inline uint16_t FloatToBFloat16Bits(float value){
+        uint32_t x;
+        std::memcpy(&x, &value, sizeof(x));
+        if ((x & 0x7fffffffu) > 0x7f800000u)
+            return uint16_t((x >> 16) | 0x40u);
+        x += 0x7fffu + ((x >> 16) & 1u);
+        return uint16_t(x >> 16);
+    }
+
+    inline float BFloat16BitsToFloat(uint16_t value){
+        uint32_t bits = uint32_t(value) << 16;
+        float result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+}
+
+// Storage-only 16 bit value: converts to and from float, so any expression on it is evaluated in float
+template<uint16_t (*Encode)(float), float (*Decode)(uint16_t)>
+class MatrixStorage16 {
+
+private:
+    uint16_t bits = 0;
+
+public:
+    MatrixStorage16() = default;
+    MatrixStorage16(float value) : bits(Encode(value)) {}
+
+    operator float() const { return Decode(bits); }
+
+    [[nodiscard]] uint16_t GetBits() const { return bits; }
+
+    static MatrixStorage16 FromBits(uint16_t value){
+        MatrixStorage16 result;
+        result.bits = value;
+        return result;
+    }
+
+    MatrixStorage16 &operator+=(float value) { return *this = float(*this) + value; }
+    MatrixStorage16 &operator-=(float value) { return *this = float(*this) - value; }
+    MatrixStorage16 &operator*=(float value) { return *this = float(*this) * value; }
+    MatrixStorage16 &operator/=(float value) { return *this = float(*this) / value; }
+};
+
+template<uint16_t (*Encode)(float), float (*Decode)(uint16_t)>
+std::ostream &operator<<(std::ostream &stream, MatrixStorage16<Encode, Decode> value){
+    return stream << float(value);
+}
+
+using BFloat16 = MatrixStorage16<MatrixDetail::FloatToBFloat16Bits, MatrixDetail::BFloat16BitsToFloat>;
+
+#if defined(__FLT16_MAX__) && !defined(MATRIX_SOFT_FLOAT16)
+#define MATRIX_NATIVE_FLOAT16
+using Float16 = _Float16;
+
+inline std::ostream &operator<<(std::ostream &stream, _Float16 value){
+    return stream << float(value);
+}
+#else
+using Float16 = MatrixStorage16<MatrixDetail::FloatToHalfBits, MatrixDetail::HalfBitsToFloat>;
+#endif
+
+namespace MatrixDetail {
+    template<typename Type>
+    constexpr bool IsHalfV = std::is_same_v<Type, Float16> || std::is_same_v<Type, BFloat16>;
+
+    template<typename Type>
+    constexpr bool IsFloatingV = std::is_floating_point_v<Type> || IsHalfV<Type>;
+
+    template<typename Type>
+    constexpr int FloatingRank = IsHalfV<Type> ? 0 : std::is_same_v<Type, float> ? 1 : std::is_same_v<Type, double> ? 2 : 3;
+}
+
+/*
+ * Type in which products and factorizations of Type carry their sums: float for the 16 bit types,
+ * the type itself otherwise. Specialize it to change the default, e.g. double sums for float storage.
+ */
+template<typename Type>
+struct MatrixAccumulator {
+    using type = std::conditional_t<MatrixDetail::IsHalfV<Type>, float, Type>;
+};
+
+template<typename Type>
+using MatrixAccumulatorT = typename MatrixAccumulator<Type>::type;
+
+/*
+ * Result type of an operation mixing two element types: a floating type wins over an integer one,
+ * the wider of two floating types wins, and Float16 with BFloat16 (neither holds the other) gives float.
+ */
+template<typename Left, typename Right, bool = MatrixDetail::IsFloatingV<Left> || MatrixDetail::IsFloatingV<Right>>
+struct MatrixPromote {
+    using type = std::common_type_t<Left, Right>;
+};
+
+template<typename Left, typename Right>
+struct MatrixPromote<Left, Right, true> {
+    using type = std::conditional_t<MatrixDetail::IsHalfV<Left> && MatrixDetail::IsHalfV<Right> && !std::is_same_v<Left, Right>, float,
+        std::conditional_t<!MatrixDetail::IsFloatingV<Right>, Left,
+        std::conditional_t<!MatrixDetail::IsFloatingV<Left>, Right,
+        std::conditional_t<(MatrixDetail::FloatingRank<Right> > MatrixDetail::FloatingRank<Left>), Right, Left>>>>;
+};
+
+template<typename Left, typename Right>
+using MatrixPromoteT = typename MatrixPromote<Left, Right>::type;
+
+namespace MatrixDetail {
+    // Factorizations of integer matrices run in double, everything else in its accumulator type
+    template<typename Type>
+    using FactorType = std::conditional_t<IsFloatingV<Type>, MatrixAccumulatorT<Type>, double>;
+
+    template<typename From, typename To>
+    void ConvertElements(const From *Source, To *Destination, size_t count){
+        for (size_t i = 0; i < count; i++)
+            Destination[i] = To(Source[i]);
+    }
+
+    inline void ConvertElements(const BFloat16 *Source, float *Destination, size_t count){
+        for (size_t i = 0; i < count; i++)
+            Destination[i] = BFloat16BitsToFloat(Source[i].GetBits());
+    }
+
+    inline void ConvertElements(const float *Source, BFloat16 *Destination, size_t count){
+        for (size_t i = 0; i < count; i++)
+            Destination[i] = BFloat16::FromBits(FloatToBFloat16Bits(Source[i]));
+    }
+
+#ifdef MATRIX_X86_DISPATCH
+    inline bool HasF16C(){
+        static const bool supported = [] {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("f16c") != 0;
+        }();
+        return supported;
+    }
+
+    __attribute__((target("avx,f16c")))
+    inline size_t HalfToFloatF16C(const void *Source, float *Destination, size_t count){
+        auto *source = static_cast<const unsigned char *>(Source);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+            _mm256_storeu_ps(Destination + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(source + 2 * i))));
+        return i;
+    }
+
+    __attribute__((target("avx,f16c")))
+    inline size_t FloatToHalfF16C(const float *Source, void *Destination, size_t count){
+        auto *destination = static_cast<unsigned char *>(Destination);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + 2 * i),
+                             _mm256_cvtps_ph(_mm256_loadu_ps(Source + i), _MM_FROUND_TO_NEAREST_INT));
+        return i;
+    }
+#endif
+
+    // Whole runs of Float16 go through F16C where the CPU has it, the rest through the bit conversion
+    inline void ConvertElements(const Float16 *Source, float *Destination, size_t count){
+        size_t i = 0;
+#ifdef MATRIX_X86_DISPATCH
+        if (HasF16C())
+            i = HalfToFloatF16C(Source, Destination, count);
+#endif
+        for (; i < count; i++) {
+            uint16_t bits;
+            std::memcpy(&bits, Source + i, sizeof(bits));
+            Destination[i] = HalfBitsToFloat(bits);
+        }
+    }
+
+    inline void ConvertElements(const float *Source, Float16 *Destination, size_t count){
+        size_t i = 0;
+#ifdef MATRIX_X86_DISPATCH
+        if (HasF16C())
+            i = FloatToHalfF16C(Source, Destination, count);
+#endif
+        for (; i < count; i++) {
+            uint16_t bits = FloatToHalfBits(Source[i]);
+            std::memcpy(Destination + i, &bits, sizeof(bits));
+        }
+    }
+}
@@ -0,0 +1,449 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "Matrix.h"
+
+/*
+ * Krylov solvers for A * x = b: ConjugateGradient for symmetric positive definite A, BiCGSTAB and
+ * GMRES(m) for general A. A is only touched through y = A * x, so an iteration costs one or two
+ * products - O(nnz) for a SparseMatrix - plus a few vector passes. x is read as the starting guess
+ * (a warm start, e.g. the solution of the previous time step) unless it has the wrong size, in which
+ * case the solve starts from zero. All three are preconditioned: CG symmetrically, BiCGSTAB and
+ * GMRES from the right, so the residual they test is the true one. The residual updated by the
+ * recurrences drifts from b - A * x in low precision, so convergence is only reported after
+ * recomputing it from x; if the two disagree the method restarts from the true residual.
+ */
+struct IterativeOptions {
+    // Stops once ||b - A * x|| <= tolerance * ||b||
+    double tolerance = 1e-8;
+    int max_iterations = 1000;
+    // Krylov basis size of GMRES before it restarts
+    int restart = 30;
+};
+
+struct IterativeResult {
+    bool converged = false;
+    int iterations = 0;
+    // ||b - A * x|| / ||b||, recomputed from x whenever the method reports convergence
+    double residual = 0;
+};
+
+/*
+ * The matrix-free interface: any y = A * x of a square A. A Matrix or SparseMatrix converts
+ * implicitly and is referenced, not copied, so it has to outlive the operator.
+ */
+template<typename Type>
+class LinearOperator {
+
+public:
+    using Function = std::function<void(const Vector<Type> &x, Vector<Type> &y)>;
+
+private:
+    int size = 0;
+    Function apply{};
+    std::shared_ptr<const SparseMatrix<Type>> converted{};
+
+public:
+    LinearOperator(int Size, Function Apply) : size(Size), apply(std::move(Apply)) {}
+
+    LinearOperator(const Matrix<Type> &A) : size(A.GetRows()){
+        assert(A.GetRows() == A.GetColumns());
+        const Matrix<Type> *source = &A;
+        apply = [source](const Vector<Type> &x, Vector<Type> &y) { Gemv(Type(1), source->GetView(), x, Type(0), y); };
+    }
+
+    // A CSC matrix is converted to CSR once, here, rather than on every product
+    LinearOperator(const SparseMatrix<Type> &A) : size(A.GetRows()){
+        assert(A.GetRows() == A.GetColumns());
+        const SparseMatrix<Type> *source = &A;
+        if (A.GetFormat() != SparseFormat::CSR) {
+            converted = std::make_shared<const SparseMatrix<Type>>(A.ToFormat(SparseFormat::CSR));
+            source = converted.get();
+        }
+        apply = [source](const Vector<Type> &x, Vector<Type> &y) { source->Multiply(x.Data(), y.Data()); };
+    }
+
+    [[nodiscard]] int GetSize() const { return size; }
+
+    void Apply(const Vector<Type> &x, Vector<Type> &y) const{
+        assert(x.GetSize() == size);
+        y.Resize(size, false);
+        apply(x, y);
+    }
+};
+
+template<typename Type>
+class IdentityPreconditioner {
+
+public:
+    void Apply(const Vector<Type> &r, Vector<Type> &z) const { z = r; }
+};
+
+// z = D^-1 * r with D the diagonal of A; zero diagonal entries are left as 1
+template<typename Type>
+class JacobiPreconditioner {
+
+private:
+    Vector<Type> inverse_diagonal{};
+
+    void Invert(){
+        for (Type &value : inverse_diagonal)
+            value = value != Type(0) ? Type(1) / value : Type(1);
+    }
+
+public:
+    explicit JacobiPreconditioner(const Vector<Type> &Diagonal) : inverse_diagonal(Diagonal) { Invert(); }
+
+    explicit JacobiPreconditioner(const Matrix<Type> &A) : inverse_diagonal(std::min(A.GetRows(), A.GetColumns())){
+        for (int i = 0; i < inverse_diagonal.GetSize(); i++)
+            inverse_diagonal[i] = A[i][i];
+        Invert();
+    }
+
+    explicit JacobiPreconditioner(const SparseMatrix<Type> &A) : inverse_diagonal(std::min(A.GetRows(), A.GetColumns())){
+        for (int i = 0; i < inverse_diagonal.GetSize(); i++)
+            inverse_diagonal[i] = A(i, i);
+        Invert();
+    }
+
+    void Apply(const Vector<Type> &r, Vector<Type> &z) const{
+        int n = inverse_diagonal.GetSize();
+        assert(r.GetSize() == n);
+        z.Resize(n, false);
+        const Type *d = inverse_diagonal.Data();
+        const Type *in = r.Data();
+        Type *out = z.Data();
+        MatrixDetail::VectorFor(n, MatrixDetail::VectorChunk, [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+                out[i] = d[i] * in[i];
+        });
+    }
+};
+
+/*
+ * Incomplete LU without fill-in: L * U restricted to the non-zero pattern of A, stored in that same
+ * CSR pattern (unit L below the diagonal, U from it). A missing or zero pivot marks the factors
+ * singular and Apply then passes r through unchanged, so a solve still runs, unpreconditioned.
+ */
+template<typename Type>
+class ILU0Preconditioner {
+
+private:
+    std::vector<int> offsets{};
+    std::vector<int> indices{};
+    std::vector<int> diagonal{};
+    std::vector<Type> values{};
+    bool singular = false;
+
+public:
+    explicit ILU0Preconditioner(const SparseMatrix<Type> &A){
+        MATRIX_PROFILE("ILU0Preconditioner::ILU0Preconditioner(const SparseMatrix<Type> &A)");
+        assert(A.GetRows() == A.GetColumns());
+        SparseMatrix<Type> csr = A.ToFormat(SparseFormat::CSR);
+        offsets = csr.GetOffsets();
+        indices = csr.GetIndices();
+        values = csr.GetValues();
+        int n = A.GetRows();
+        diagonal.assign(n, -1);
+        std::vector<int> position(n, -1);
+
+        // IKJ order: row i is reduced by the already final rows k < i of its pattern
+        for (int i = 0; i < n && !singular; i++) {
+            for (int p = offsets[i]; p < offsets[i + 1]; p++) {
+                position[indices[p]] = p;
+                if (indices[p] == i)
+                    diagonal[i] = p;
+            }
+            for (int p = offsets[i]; p < offsets[i + 1] && indices[p] < i; p++) {
+                int k = indices[p];
+                values[p] /= values[diagonal[k]];
+                Type l = values[p];
+                for (int q = diagonal[k] + 1; q < offsets[k + 1]; q++)
+                    if (position[indices[q]] >= 0)
+                        values[position[indices[q]]] -= l * values[q];
+            }
+            singular = diagonal[i] < 0 || values[diagonal[i]] == Type(0);
+            for (int p = offsets[i]; p < offsets[i + 1]; p++)
+                position[indices[p]] = -1;
+        }
+    }
+
+    explicit ILU0Preconditioner(const Matrix<Type> &A) : ILU0Preconditioner(SparseMatrix<Type>(A)) {}
+
+    [[nodiscard]] bool IsSingular() const { return singular; }
+
+    // z = U^-1 * L^-1 * r
+    void Apply(const Vector<Type> &r, Vector<Type> &z) const{
+        int n = int(diagonal.size());
+        assert(r.GetSize() == n);
+        z = r;
+        if (singular)
+            return;
+        Type *x = z.Data();
+        for (int i = 0; i < n; i++) {
+            Type sum = x[i];
+            for (int p = offsets[i]; p < diagonal[i]; p++)
+                sum -= values[p] * x[indices[p]];
+            x[i] = sum;
+        }
+        for (int i = n - 1; i >= 0; i--) {
+            Type sum = x[i];
+            for (int p = diagonal[i] + 1; p < offsets[i + 1]; p++)
+                sum -= values[p] * x[indices[p]];
+            x[i] = sum / values[diagonal[i]];
+        }
+    }
+};
+
+namespace MatrixDetail {
+    // Keeps Type deducible from b and x only, so a Matrix or SparseMatrix converts to LinearOperator
+    template<typename Type>
+    struct NonDeducedType { using type = Type; };
+
+    template<typename Type>
+    using NonDeduced = typename NonDeducedType<Type>::type;
+
+    // y = x + beta * y
+    template<typename Type>
+    void Xpay(int n, const Type *x, Type beta, Type *y){
+        VectorFor(n, VectorChunk, [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+                y[i] = x[i] + beta * y[i];
+        });
+    }
+
+    template<typename Type>
+    double Norm2(const Vector<Type> &x){
+        return std::sqrt(double(Dot(x.GetSize(), x.Data(), x.Data())));
+    }
+
+    // r = b - A * x
+    template<typename Type>
+    void Residual(const LinearOperator<Type> &A, const Vector<Type> &b, const Vector<Type> &x, Vector<Type> &r){
+        A.Apply(x, r);
+        Xpay(r.GetSize(), b.Data(), Type(-1), r.Data());
+    }
+
+    // Sizes x for a cold start; a zero right-hand side is solved by x = 0 straight away
+    template<typename Type>
+    bool IterativeStart(int n, const Vector<Type> &b, Vector<Type> &x, double &b_norm){
+        assert(b.GetSize() == n);
+        if (x.GetSize() != n)
+            x.Resize(n);
+        b_norm = Norm2(b);
+        if (b_norm == 0.0)
+            x.Resize(n);
+        return b_norm != 0.0;
+    }
+}
+
+template<typename Type, typename Preconditioner = IdentityPreconditioner<Type>>
+IterativeResult ConjugateGradient(const MatrixDetail::NonDeduced<LinearOperator<Type>> &A, const Vector<Type> &b, Vector<Type> &x,
+                                  const IterativeOptions &options = {}, const Preconditioner &M = Preconditioner()){
+    MATRIX_PROFILE("ConjugateGradient(const LinearOperator<Type> &A, const Vector<Type> &b, Vector<Type> &x)");
+    static_assert(std::is_floating_point_v<Type>, "ConjugateGradient needs a floating point system");
+    IterativeResult result;
+    int n = A.GetSize();
+    double b_norm;
+    if (!MatrixDetail::IterativeStart(n, b, x, b_norm)) {
+        result.converged = true;
+        return result;
+    }
+
+    Vector<Type> r(n), z(n), p(n), q(n);
+    MatrixDetail::Residual(A, b, x, r);
+    result.residual = MatrixDetail::Norm2(r) / b_norm;
+    M.Apply(r, z);
+    p = z;
+    Type rz = Dot(r, z);
+    while (result.residual > options.tolerance && result.iterations < options.max_iterations) {
+        A.Apply(p, q);
+        Type pq = Dot(p, q);
+        if (pq == Type(0))
+            break;
+        Type alpha = rz / pq;
+        MatrixDetail::Axpy(n, alpha, p.Data(), x.Data());
+        MatrixDetail::Axpy(n, -alpha, q.Data(), r.Data());
+        result.iterations++;
+        result.residual = MatrixDetail::Norm2(r) / b_norm;
+        if (result.residual <= options.tolerance) {
+            MatrixDetail::Residual(A, b, x, r);
+            result.residual = MatrixDetail::Norm2(r) / b_norm;
+            if (result.residual <= options.tolerance)
+                break;
+            M.Apply(r, z);
+            p = z;
+            rz = Dot(r, z);
+            continue;
+        }
+        M.Apply(r, z);
+        Type rz_next = Dot(r, z);
+        MatrixDetail::Xpay(n, z.Data(), rz_next / rz, p.Data());
+        rz = rz_next;
+    }
+    result.converged = result.residual <= options.tolerance;
+    return result;
+}
+
+template<typename Type, typename Preconditioner = IdentityPreconditioner<Type>>
+IterativeResult BiCGSTAB(const MatrixDetail::NonDeduced<LinearOperator<Type>> &A, const Vector<Type> &b, Vector<Type> &x,
+                         const IterativeOptions &options = {}, const Preconditioner &M = Preconditioner()){
+    MATRIX_PROFILE("BiCGSTAB(const LinearOperator<Type> &A, const Vector<Type> &b, Vector<Type> &x)");
+    static_assert(std::is_floating_point_v<Type>, "BiCGSTAB needs a floating point system");
+    IterativeResult result;
+    int n = A.GetSize();
+    double b_norm;
+    if (!MatrixDetail::IterativeStart(n, b, x, b_norm)) {
+        result.converged = true;
+        return result;
+    }
+
+    Vector<Type> r(n), shadow(n), p(n), v(n), s(n), t(n), p_hat(n), s_hat(n);
+    MatrixDetail::Residual(A, b, x, r);
+    result.residual = MatrixDetail::Norm2(r) / b_norm;
+    shadow = r;
+    Type rho = Type(1), alpha = Type(1), omega = Type(1);
+    auto restart = [&] {
+        MatrixDetail::Residual(A, b, x, r);
+        result.residual = MatrixDetail::Norm2(r) / b_norm;
+        shadow = r;
+        rho = alpha = omega = Type(1);
+        p.Resize(n);
+        v.Resize(n);
+        return result.residual <= options.tolerance;
+    };
+    while (result.residual > options.tolerance && result.iterations < options.max_iterations) {
+        Type rho_next = Dot(shadow, r);
+        if (rho_next == Type(0) || omega == Type(0))
+            break;
+        // p = r + beta * (p - omega * v)
+        Type beta = (rho_next / rho) * (alpha / omega);
+        MatrixDetail::Axpy(n, -omega, v.Data(), p.Data());
+        MatrixDetail::Xpay(n, r.Data(), beta, p.Data());
+        rho = rho_next;
+
+        M.Apply(p, p_hat);
+        A.Apply(p_hat, v);
+        Type shadow_v = Dot(shadow, v);
+        if (shadow_v == Type(0))
+            break;
+        alpha = rho / shadow_v;
+        s = r;
+        MatrixDetail::Axpy(n, -alpha, v.Data(), s.Data());
+        result.iterations++;
+        double s_norm = MatrixDetail::Norm2(s) / b_norm;
+        if (s_norm <= options.tolerance) {
+            MatrixDetail::Axpy(n, alpha, p_hat.Data(), x.Data());
+            if (restart())
+                break;
+            continue;
+        }
+
+        M.Apply(s, s_hat);
+        A.Apply(s_hat, t);
+        Type tt = Dot(t, t);
+        omega = tt != Type(0) ? Dot(t, s) / tt : Type(0);
+        MatrixDetail::Axpy(n, alpha, p_hat.Data(), x.Data());
+        MatrixDetail::Axpy(n, omega, s_hat.Data(), x.Data());
+        r = s;
+        MatrixDetail::Axpy(n, -omega, t.Data(), r.Data());
+        result.residual = MatrixDetail::Norm2(r) / b_norm;
+        if (result.residual <= options.tolerance && restart())
+            break;
+    }
+    result.converged = result.residual <= options.tolerance;
+    return result;
+}
+
+/*
+ * Restarted GMRES(m): modified Gram-Schmidt Arnoldi with Givens rotations, so the residual norm of
+ * every step is known without forming x. Every restart recomputes the true residual.
+ */
+template<typename Type, typename Preconditioner = IdentityPreconditioner<Type>>
+IterativeResult GMRES(const MatrixDetail::NonDeduced<LinearOperator<Type>> &A, const Vector<Type> &b, Vector<Type> &x,
+                      const IterativeOptions &options = {}, const Preconditioner &M = Preconditioner()){
+    MATRIX_PROFILE("GMRES(const LinearOperator<Type> &A, const Vector<Type> &b, Vector<Type> &x)");
+    static_assert(std::is_floating_point_v<Type>, "GMRES needs a floating point system");
+    IterativeResult result;
+    int n = A.GetSize();
+    double b_norm;
+    if (!MatrixDetail::IterativeStart(n, b, x, b_norm)) {
+        result.converged = true;
+        return result;
+    }
+
+    const int m = std::max(1, std::min(options.restart, n));
+    std::vector<Vector<Type>> basis(m + 1, Vector<Type>(n));
+    Vector<Type> w(n), z(n);
+    std::vector<double> H(size_t(m + 1) * m), cs(m), sn(m), g(m + 1), y(m);
+    auto h = [&H, m](int i, int j) -> double & { return H[size_t(i) * m + j]; };
+
+    while (true) {
+        MatrixDetail::Residual(A, b, x, w);
+        double beta = MatrixDetail::Norm2(w);
+        result.residual = beta / b_norm;
+        if (result.residual <= options.tolerance || result.iterations >= options.max_iterations)
+            break;
+
+        basis[0] = w;
+        basis[0] /= Type(beta);
+        std::fill(g.begin(), g.end(), 0.0);
+        g[0] = beta;
+        int j = 0;
+        bool breakdown = false;
+        while (j < m && result.iterations < options.max_iterations && !breakdown) {
+            M.Apply(basis[j], z);
+            A.Apply(z, w);
+            for (int i = 0; i <= j; i++) {
+                h(i, j) = double(Dot(w, basis[i]));
+                MatrixDetail::Axpy(n, Type(-h(i, j)), basis[i].Data(), w.Data());
+            }
+            double next = MatrixDetail::Norm2(w);
+            h(j + 1, j) = next;
+            breakdown = next == 0.0;
+            if (!breakdown) {
+                basis[j + 1] = w;
+                basis[j + 1] /= Type(next);
+            }
+
+            for (int i = 0; i < j; i++) {
+                double t = cs[i] * h(i, j) + sn[i] * h(i + 1, j);
+                h(i + 1, j) = -sn[i] * h(i, j) + cs[i] * h(i + 1, j);
+                h(i, j) = t;
+            }
+            double radius = std::hypot(h(j, j), h(j + 1, j));
+            cs[j] = radius != 0.0 ? h(j, j) / radius : 1.0;
+            sn[j] = radius != 0.0 ? h(j + 1, j) / radius : 0.0;
+            h(j, j) = radius;
+            h(j + 1, j) = 0.0;
+            g[j + 1] = -sn[j] * g[j];
+            g[j] *= cs[j];
+
+            j++;
+            result.iterations++;
+            if (std::abs(g[j]) / b_norm <= options.tolerance)
+                break;
+        }
+
+        // x += M^-1 * V * y with H * y = g, H upper triangular after the rotations
+        for (int i = j - 1; i >= 0; i--) {
+            double sum = g[i];
+            for (int k = i + 1; k < j; k++)
+                sum -= h(i, k) * y[k];
+            y[i] = h(i, i) != 0.0 ? sum / h(i, i) : 0.0;
+        }
+        w.Resize(n);
+        for (int i = 0; i < j; i++)
+            MatrixDetail::Axpy(n, Type(y[i]), basis[i].Data(), w.Data());
+        M.Apply(w, z);
+        MatrixDetail::Axpy(n, Type(1), z.Data(), x.Data());
+    }
+    result.converged = result.residual <= options.tolerance;
+    return result;
+}
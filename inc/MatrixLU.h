@@ -0,0 +1,300 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+#include "Matrix.h"
+#include "MatrixTriangular.h"
+
+namespace MatrixDetail {
+    constexpr int LUBlockSize = 64;
+
+    /*
+     * In-place blocked right-looking LU with partial pivoting of an n x n row-major matrix.
+     * On return A holds the unit lower factor L below the diagonal and U on and above it,
+     * and pivots[j] is the row swapped with row j at step j. Returns the permutation sign,
+     * or 0 if a zero pivot was met (the matrix is singular, factorization still completes).
+     */
+    template<typename Type>
+    int LUFactor(int n, Type *A, int lda, int *pivots){
+        MatrixProfiler::CountWork(2.0 / 3.0 * n * n * n, 2 * size_t(n) * n * sizeof(Type));
+        int sign = 1;
+        bool singular = false;
+        auto a = [A, lda](int i, int j) -> Type & { return A[size_t(i) * lda + j]; };
+
+        for (int k0 = 0; k0 < n; k0 += LUBlockSize) {
+            int k1 = std::min(n, k0 + LUBlockSize);
+
+            // Unblocked factorization of the panel A[k0:n, k0:k1]
+            for (int j = k0; j < k1; j++) {
+                int p = j;
+                for (int i = j + 1; i < n; i++)
+                    if (std::abs(a(i, j)) > std::abs(a(p, j)))
+                        p = i;
+                pivots[j] = p;
+                if (p != j) {
+                    std::swap_ranges(&a(j, 0), &a(j, 0) + n, &a(p, 0));
+                    sign = -sign;
+                }
+                if (a(j, j) == Type(0)) {
+                    singular = true;
+                    continue;
+                }
+                Type inv = Type(1) / a(j, j);
+                for (int i = j + 1; i < n; i++) {
+                    Type l = a(i, j) *= inv;
+                    for (int c = j + 1; c < k1; c++)
+                        a(i, c) -= l * a(j, c);
+                }
+            }
+            if (k1 == n)
+                break;
+
+            // U12 = L11^-1 * A12
+            for (int j = k0; j < k1; j++)
+                for (int i = j + 1; i < k1; i++) {
+                    Type l = a(i, j);
+                    for (int c = k1; c < n; c++)
+                        a(i, c) -= l * a(j, c);
+                }
+
+            // A22 -= L21 * U12
+            Gemm(n - k1, n - k1, k1 - k0, &a(k1, k0), lda, &a(k0, k1), lda, &a(k1, k1), lda, Type(-1));
+        }
+        return singular ? 0 : sign;
+    }
+
+    inline Workspace &InverseWorkspace(){
+        thread_local Workspace workspace;
+        return workspace;
+    }
+
+    // True when a pivot is zero or negligible next to the largest one, i.e. the factors cannot be inverted
+    template<typename Type>
+    bool LUIsSingular(int n, const Type *A, int lda){
+        Type largest = Type(0);
+        for (int i = 0; i < n; i++)
+            largest = std::max(largest, Type(std::abs(A[size_t(i) * lda + i])));
+        Type threshold = largest * Type(n) * std::numeric_limits<Type>::epsilon();
+        for (int i = 0; i < n; i++)
+            if (std::abs(A[size_t(i) * lda + i]) <= threshold)
+                return true;
+        return false;
+    }
+
+    /*
+     * Turns the output of LUFactor into A^-1 in place (LAPACK getri scheme):
+     *   1. U <- U^-1, row by row from the bottom, touching only the upper triangle
+     *   2. X <- U^-1 * L^-1 by solving X * L = U^-1, one block of columns at a time;
+     *      the block's L columns are copied to the workspace and the rest is a Gemm update
+     *   3. A^-1 = X * P, i.e. the row swaps are undone as column swaps in reverse order
+     * The only scratch memory is one n x LUBlockSize buffer, leased per call because the Gemm
+     * updates may run other kernels on this thread.
+     */
+    template<typename Type>
+    void LUInvert(int n, Type *A, int lda, const int *pivots){
+        auto a = [A, lda](int i, int j) -> Type & { return A[size_t(i) * lda + j]; };
+        const int NB = LUBlockSize;
+        WorkspaceLease lease(InverseWorkspace());
+        Type *work = lease.Get<Type>(size_t(n) * NB);
+
+        for (int i = n - 1; i >= 0; i--) {
+            std::fill(work + i + 1, work + n, Type(0));
+            for (int k = i + 1; k < n; k++) {
+                Type u = a(i, k);
+                for (int j = k; j < n; j++)
+                    work[j] += u * a(k, j);
+            }
+            Type d = Type(1) / a(i, i);
+            a(i, i) = d;
+            for (int j = i + 1; j < n; j++)
+                a(i, j) = -d * work[j];
+        }
+
+        for (int j1 = n; j1 > 0; j1 -= NB) {
+            int j0 = std::max(0, j1 - NB);
+            int nb = j1 - j0;
+            for (int k = j0; k < n; k++)
+                for (int j = j0; j < j1; j++) {
+                    Type &w = work[size_t(k - j0) * nb + (j - j0)];
+                    if (k > j) {
+                        w = a(k, j);
+                        a(k, j) = Type(0);
+                    }
+                    else
+                        w = Type(0);
+                }
+            Gemm(n, nb, n - j1, &a(0, j1), lda, work + size_t(j1 - j0) * nb, nb, &a(0, j0), lda, Type(-1));
+            for (int j = j1 - 1; j >= j0; j--)
+                for (int i = 0; i < n; i++) {
+                    Type sum = Type(0);
+                    for (int k = j + 1; k < j1; k++)
+                        sum += a(i, k) * work[size_t(k - j0) * nb + (j - j0)];
+                    a(i, j) -= sum;
+                }
+        }
+
+        for (int j = n - 1; j >= 0; j--)
+            if (pivots[j] != j)
+                for (int i = 0; i < n; i++)
+                    std::swap(a(i, j), a(i, pivots[j]));
+    }
+
+    template<typename SourceType>
+    double Norm1(const MatrixView<SourceType> &Source){
+        std::vector<double> sums(Source.GetColumns(), 0.0);
+        for (int i = 0; i < Source.GetRows(); i++)
+            for (int j = 0; j < Source.GetColumns(); j++)
+                sums[j] += std::abs(double(Source(i, j)));
+        return sums.empty() ? 0.0 : *std::max_element(sums.begin(), sums.end());
+    }
+
+    /*
+     * Hager/Higham estimate of ||A^-1||_1 from a handful of solves with A and A^T,
+     * so that the condition number costs O(n^2) once the factors exist.
+     */
+    template<typename Type, typename SolveFunction, typename SolveTransposedFunction>
+    double EstimateInverseNorm1(int n, SolveFunction Solve, SolveTransposedFunction SolveTransposed){
+        std::vector<Type> x(n, Type(1) / Type(n)), y(n), z(n);
+        double estimate = 0;
+        for (int iteration = 0; iteration < 5; iteration++) {
+            y = x;
+            Solve(y.data());
+            estimate = 0;
+            for (int i = 0; i < n; i++) {
+                estimate += std::abs(double(y[i]));
+                z[i] = y[i] >= Type(0) ? Type(1) : Type(-1);
+            }
+            SolveTransposed(z.data());
+            int j = 0;
+            double ztx = 0;
+            for (int i = 0; i < n; i++) {
+                if (std::abs(z[i]) > std::abs(z[j]))
+                    j = i;
+                ztx += double(z[i]) * double(x[i]);
+            }
+            if (iteration > 0 && std::abs(double(z[j])) <= ztx)
+                break;
+            std::fill(x.begin(), x.end(), Type(0));
+            x[j] = Type(1);
+        }
+        return estimate;
+    }
+
+    // 1 / (||A||_1 * ||A^-1||_1), the LAPACK style reciprocal condition number; 0 means singular
+    inline double ReciprocalCondition(double norm, double inverse_norm){
+        if (norm == 0.0 || inverse_norm == 0.0 || !std::isfinite(inverse_norm))
+            return 0.0;
+        return 1.0 / (norm * inverse_norm);
+    }
+}
+
+/*
+ * LU factorization P * A = L * U of a square matrix with partial pivoting.
+ * Factor once, then reuse the object for determinants, solves and inverses.
+ */
+template<typename Type>
+class LU {
+
+private:
+    Matrix<Type> factors{};
+    std::vector<int> pivots{};
+    int sign = 1;
+    double norm = 0;
+
+    void ApplyPivots(Type *B, int ldb, int nrhs) const{
+        for (int j = 0; j < GetSize(); j++)
+            if (pivots[j] != j)
+                std::swap_ranges(B + size_t(j) * ldb, B + size_t(j) * ldb + nrhs, B + size_t(pivots[j]) * ldb);
+    }
+
+    void SolveInPlace(Type *B, int ldb, int nrhs) const{
+        int n = GetSize();
+        ApplyPivots(B, ldb, nrhs);
+        MatrixDetail::TrsmLower(n, nrhs, factors.Data(), factors.GetStride(), true, B, ldb);
+        MatrixDetail::TrsmUpper(n, nrhs, factors.Data(), factors.GetStride(), false, B, ldb);
+    }
+
+    // A^T = U^T * L^T * P, so solve with U^T, then L^T, then undo the row swaps in reverse
+    void SolveTransposedInPlace(Type *x) const{
+        int n = GetSize();
+        MatrixDetail::TrsvUpperTransposed(n, factors.Data(), factors.GetStride(), false, x);
+        MatrixDetail::TrsvLowerTransposed(n, factors.Data(), factors.GetStride(), true, x);
+        for (int j = n - 1; j >= 0; j--)
+            if (pivots[j] != j)
+                std::swap(x[j], x[pivots[j]]);
+    }
+
+public:
+    template<typename SourceType>
+    explicit LU(const MatrixView<SourceType> &Source){
+        MATRIX_PROFILE("LU::LU(const MatrixView<SourceType> &Source)");
+        assert(Source.GetRows() == Source.GetColumns());
+        int n = Source.GetRows();
+        factors = Matrix<Type>(n, n);
+        for (int i = 0; i < n; i++) {
+            if (Source.IsRowContiguous())
+                std::copy(Source.RowPointer(i), Source.RowPointer(i) + n, factors[i].begin());
+            else
+                for (int j = 0; j < n; j++)
+                    factors[i][j] = Type(Source(i, j));
+        }
+        norm = MatrixDetail::Norm1(Source);
+        pivots.resize(factors.GetRows());
+        sign = MatrixDetail::LUFactor(factors.GetRows(), factors.Data(), factors.GetStride(), pivots.data());
+    }
+
+    template<typename SourceType>
+    explicit LU(const Matrix<SourceType> &Source) : LU(MatrixView<SourceType>(Source)) {}
+
+    [[nodiscard]] int GetSize() const { return factors.GetRows(); }
+    [[nodiscard]] bool IsSingular() const { return sign == 0; }
+    [[nodiscard]] const Matrix<Type> &GetFactors() const { return factors; }
+    [[nodiscard]] const std::vector<int> &GetPivots() const { return pivots; }
+
+    [[nodiscard]] Type Determinant() const{
+        Type det = Type(sign);
+        for (int i = 0; i < GetSize(); i++)
+            det *= factors[i][i];
+        return det;
+    }
+
+    // Overwrites the n x k right-hand side matrix with the solution of A * X = RHS
+    bool Solve(Matrix<Type> &RHS) const{
+        MATRIX_PROFILE("LU::Solve(Matrix<Type> &RHS)");
+        assert(RHS.GetRows() == GetSize());
+        if (IsSingular())
+            return false;
+        SolveInPlace(RHS.Data(), RHS.GetStride(), RHS.GetColumns());
+        return true;
+    }
+
+    bool Solve(std::vector<Type> &RHS) const{
+        assert(RHS.size() == GetSize());
+        if (IsSingular())
+            return false;
+        SolveInPlace(RHS.data(), 1, 1);
+        return true;
+    }
+
+    // Writes A^-1 to out_inverse, reusing the stored factors
+    bool Inverse(Matrix<Type> &out_inverse) const{
+        MATRIX_PROFILE("LU::Inverse(Matrix<Type> &out_inverse)");
+        if (IsSingular())
+            return false;
+        out_inverse = factors;
+        MatrixDetail::LUInvert(GetSize(), out_inverse.Data(), out_inverse.GetStride(), pivots.data());
+        return true;
+    }
+
+    [[nodiscard]] double ReciprocalCondition() const{
+        if (IsSingular())
+            return 0.0;
+        double inverse_norm = MatrixDetail::EstimateInverseNorm1<Type>(GetSize(),
+            [this](Type *x) { SolveInPlace(x, 1, 1); },
+            [this](Type *x) { SolveTransposedInPlace(x); });
+        return MatrixDetail::ReciprocalCondition(norm, inverse_norm);
+    }
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace MatrixDetail {
+    // Every matrix buffer starts on a cache line so rows of SIMD kernels never split a line at the start
+    constexpr size_t Alignment = 64;
+
+    template<typename Type>
+    Type *AllocAligned(size_t count){
+        if (count == 0)
+            return nullptr;
+        return static_cast<Type *>(::operator new(count * sizeof(Type), std::align_val_t(Alignment)));
+    }
+
+    template<typename Type>
+    void FreeAligned(Type *ptr){
+        if (ptr)
+            ::operator delete(ptr, std::align_val_t(Alignment));
+    }
+
+    /*
+     * Grow-only aligned scratch buffers. Kernels keep one per thread so that
+     * repeated calls of the same size never go back to the allocator.
+     * Get() is for leaf kernels that call nothing else while they use the buffer.
+     * Scratch held across a Gemm, a ParallelFor or anything that may run another
+     * kernel on this thread is taken through a WorkspaceLease instead.
+     */
+    class Workspace {
+
+        friend class WorkspaceLease;
+
+    private:
+        struct Buffer {
+            unsigned char *data = nullptr;
+            size_t bytes = 0;
+        };
+
+        // One buffer per nesting level; leases take levels in stack order
+        std::vector<Buffer> buffers{};
+        size_t depth = 0;
+
+        unsigned char *Reserve(size_t level, size_t required){
+            if (level >= buffers.size())
+                buffers.resize(level + 1);
+            Buffer &buffer = buffers[level];
+            if (required > buffer.bytes) {
+                FreeAligned(buffer.data);
+                buffer.data = AllocAligned<unsigned char>(required);
+                buffer.bytes = required;
+            }
+            return buffer.data;
+        }
+
+    public:
+        Workspace() = default;
+        Workspace(const Workspace &) = delete;
+        Workspace &operator=(const Workspace &) = delete;
+        ~Workspace(){
+            for (Buffer &buffer : buffers)
+                FreeAligned(buffer.data);
+        }
+
+        template<typename Type>
+        Type *Get(size_t count){
+            return reinterpret_cast<Type *>(Reserve(depth, count * sizeof(Type)));
+        }
+    };
+
+    /*
+     * A Workspace buffer owned by one call until the lease goes out of scope. A lease
+     * taken while another is alive on the same thread gets the next level, so a nested
+     * call never regrows or overwrites the scratch its caller is still using.
+     */
+    class WorkspaceLease {
+
+    private:
+        Workspace &workspace;
+        size_t level;
+
+    public:
+        explicit WorkspaceLease(Workspace &Owner) : workspace(Owner), level(Owner.depth++) {}
+        WorkspaceLease(const WorkspaceLease &) = delete;
+        WorkspaceLease &operator=(const WorkspaceLease &) = delete;
+        ~WorkspaceLease(){ workspace.depth--; }
+
+        template<typename Type>
+        Type *Get(size_t count){
+            return reinterpret_cast<Type *>(workspace.Reserve(level, count * sizeof(Type)));
+        }
+    };
+
+    // Pivot indices of in-place factorizations, kept per thread like the kernel scratch buffers
+    inline Workspace &PivotWorkspace(){
+        thread_local Workspace workspace;
+        return workspace;
+    }
+}
+
+/*
+ * Leading dimension of newly allocated matrices. Rows of at least PadFrom bytes are padded to whole
+ * cache lines, so every row starts Alignment aligned and SIMD loads never split a line. A row pitch
+ * that is a multiple of the aliasing stride gets one more line: otherwise a walk down a column maps
+ * every row onto the same few L1 sets (1024 floats or 512 doubles per row, for instance).
+ * Only GetStride() shows the padding; sizes, views, files and comparisons still see rows x columns.
+ */
+class MatrixLayout {
+
+private:
+    struct Settings {
+        std::atomic<bool> padding{true};
+        std::atomic<size_t> aliasing_stride{4096};
+    };
+
+    static Settings &Get(){
+        static Settings settings;
+        return settings;
+    }
+
+public:
+    // Narrower rows stay packed: a small matrix would mostly store padding
+    static constexpr size_t PadFrom = 256;
+
+    static void EnablePadding(bool on = true) { Get().padding.store(on, std::memory_order_relaxed); }
+    static bool IsPaddingEnabled() { return Get().padding.load(std::memory_order_relaxed); }
+
+    // Row pitches that are a multiple of this many bytes get one cache line more; 0 turns it off
+    static void SetAliasingStride(size_t bytes) { Get().aliasing_stride.store(bytes, std::memory_order_relaxed); }
+    static size_t GetAliasingStride() { return Get().aliasing_stride.load(std::memory_order_relaxed); }
+
+    template<typename Type>
+    static int LeadingDimension(int rows, int columns){
+        constexpr size_t Line = MatrixDetail::Alignment;
+        size_t bytes = size_t(columns) * sizeof(Type);
+        if (rows <= 1 || bytes < PadFrom || Line % sizeof(Type) != 0 || !IsPaddingEnabled())
+            return columns;
+        bytes = (bytes + Line - 1) / Line * Line;
+        size_t aliasing = GetAliasingStride();
+        if (aliasing != 0 && bytes % aliasing == 0)
+            bytes += Line;
+        return int(bytes / sizeof(Type));
+    }
+};
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Matrix.h"
+
+/*
+ * Out-of-core C = A * B over matrix files (see MatrixFile.h) that need not fit in memory.
+ * C is produced tile by tile: for every C tile the matching row panel of A and column panel of B
+ * are streamed in KC deep slices and multiplied with the in-memory GEMM. Slices are double
+ * buffered - the next A and B tiles are read on one I/O thread, kept for the whole product, while
+ * the current ones are multiplied - and a finished C tile is written back while the next one is
+ * computed. Tile sizes are derived from the memory budget, which covers all six tile buffers.
+ */
+namespace MatrixDetail {
+#ifdef MATRIX_POSIX_IO
+    // Opens a matrix file of element type Type and reads its header; returns -1 on any mismatch
+    template<typename Type>
+    int OpenMatrixFile(const std::string &path, MatrixFileHeader &header){
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return -1;
+        struct stat info{};
+        if (::fstat(fd, &info) != 0 || ::pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header)) ||
+            !ValidateHeader<Type>(header, uint64_t(info.st_size))) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    inline bool PreadAll(int fd, void *buffer, size_t bytes, uint64_t offset){
+        auto *out = static_cast<char *>(buffer);
+        while (bytes > 0) {
+            ssize_t result = ::pread(fd, out, bytes, off_t(offset));
+            if (result <= 0)
+                return false;
+            out += result;
+            bytes -= size_t(result);
+            offset += uint64_t(result);
+        }
+        return true;
+    }
+
+    inline bool PwriteAll(int fd, const void *buffer, size_t bytes, uint64_t offset){
+        auto *in = static_cast<const char *>(buffer);
+        while (bytes > 0) {
+            ssize_t result = ::pwrite(fd, in, bytes, off_t(offset));
+            if (result <= 0)
+                return false;
+            in += result;
+            bytes -= size_t(result);
+            offset += uint64_t(result);
+        }
+        return true;
+    }
+
+    // Reads the r x c block at (row, column) of a file matrix into a dense buffer with leading dimension c
+    template<typename Type>
+    bool ReadTile(int fd, const MatrixFileHeader &header, int row, int column, int r, int c, Type *tile){
+        for (int i = 0; i < r; i++) {
+            uint64_t element = uint64_t(row + i) * uint64_t(header.stride) + uint64_t(column);
+            if (!PreadAll(fd, tile + size_t(i) * c, size_t(c) * sizeof(Type), header.payload_offset + element * sizeof(Type)))
+                return false;
+        }
+        return true;
+    }
+
+    // Writes a dense r x c tile held in Tile (e.g. the accumulator type) as Type, one row at a time
+    template<typename Type, typename Tile>
+    bool WriteTile(int fd, const MatrixFileHeader &header, int row, int column, int r, int c, const Tile *tile){
+        std::vector<Type> converted(std::is_same_v<Type, Tile> ? 0 : size_t(c));
+        for (int i = 0; i < r; i++) {
+            const Type *source;
+            if constexpr (std::is_same_v<Type, Tile>)
+                source = tile + size_t(i) * c;
+            else {
+                ConvertElements(tile + size_t(i) * c, converted.data(), size_t(c));
+                source = converted.data();
+            }
+            uint64_t element = uint64_t(row + i) * uint64_t(header.stride) + uint64_t(column);
+            if (!PwriteAll(fd, source, size_t(c) * sizeof(Type), header.payload_offset + element * sizeof(Type)))
+                return false;
+        }
+        return true;
+    }
+
+    // A single thread that runs I/O requests in submission order until it is destroyed
+    class OutOfCoreIO {
+
+    private:
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<std::packaged_task<bool()>> requests{};
+        bool stopping = false;
+        std::thread thread;
+
+        void Loop(){
+            while (true) {
+                std::packaged_task<bool()> request;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wake.wait(lock, [this] { return stopping || !requests.empty(); });
+                    if (requests.empty())
+                        return;
+                    request = std::move(requests.front());
+                    requests.pop_front();
+                }
+                request();
+            }
+        }
+
+    public:
+        OutOfCoreIO() : thread(&OutOfCoreIO::Loop, this) {}
+        OutOfCoreIO(const OutOfCoreIO &) = delete;
+        OutOfCoreIO &operator=(const OutOfCoreIO &) = delete;
+
+        // Runs what is still queued, then joins
+        ~OutOfCoreIO(){
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_one();
+            thread.join();
+        }
+
+        std::future<bool> Run(std::function<bool()> function){
+            std::packaged_task<bool()> request(std::move(function));
+            std::future<bool> result = request.get_future();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                requests.push_back(std::move(request));
+            }
+            wake.notify_one();
+            return result;
+        }
+    };
+#endif
+
+    // Largest square-ish tiles with 2 A tiles + 2 B tiles + 2 C tiles inside the budget
+    inline void OutOfCoreTiles(size_t budget_bytes, size_t element_size, int m, int n, int k, int &mt, int &nt, int &kt){
+        double elements = double(budget_bytes) / double(element_size) / 6.0;
+        int tile = std::max(64, int(std::sqrt(elements)) / 64 * 64);
+        mt = std::min(m, tile);
+        nt = std::min(n, tile);
+        // Whatever the short dimensions leave unused goes to the depth, which saves C tile passes
+        kt = int(std::min<double>(k, std::max<double>(tile, (elements * 6.0 - 2.0 * mt * nt) / (2.0 * (mt + nt)))));
+        kt = std::max(1, kt);
+    }
+}
+
+/*
+ * C = A * B for files written by Matrix::Save / MatrixDetail::SaveMatrix. The result is written to a
+ * temporary file next to c_path and renamed over it once complete, so c_path may name one of the
+ * inputs and a failed product leaves c_path as it was. memory_budget bounds the tile buffers; GEMM
+ * workspaces come on top. Returns false if a file cannot be opened, the shapes or element types
+ * do not match, or I/O fails.
+ */
+template<typename Type>
+bool MultiplyOutOfCore(const std::string &a_path, const std::string &b_path, const std::string &c_path,
+                       size_t memory_budget = size_t(1) << 30){
+    MATRIX_PROFILE("MultiplyOutOfCore(const std::string &a_path, const std::string &b_path, const std::string &c_path)");
+#ifdef MATRIX_POSIX_IO
+    using namespace MatrixDetail;
+    MatrixFileHeader ha{}, hb{};
+    int fa = OpenMatrixFile<Type>(a_path, ha);
+    int fb = OpenMatrixFile<Type>(b_path, hb);
+    std::string temp_path = c_path + ".XXXXXX";
+    int fc = ::mkstemp(&temp_path[0]);
+    auto close_all = [&]() {
+        for (int fd : {fa, fb, fc})
+            if (fd >= 0)
+                ::close(fd);
+    };
+    // Closes everything and moves the finished result into place, or drops the temporary
+    auto finish = [&](bool ok) {
+        ok = ok && ::fchmod(fc, 0644) == 0;
+        close_all();
+        if (fc >= 0 && !(ok && ::rename(temp_path.c_str(), c_path.c_str()) == 0)) {
+            ::unlink(temp_path.c_str());
+            ok = false;
+        }
+        return ok;
+    };
+    if (fa < 0 || fb < 0 || fc < 0 || ha.columns != hb.rows)
+        return finish(false);
+
+    int m = int(ha.rows), n = int(hb.columns), k = int(ha.columns);
+    MatrixFileHeader hc = MakeFileHeader<Type>(m, n, n);
+    std::vector<char> page(hc.payload_offset, 0);
+    std::memcpy(page.data(), &hc, sizeof(hc));
+    if (!PwriteAll(fc, page.data(), page.size(), 0) ||
+        ::ftruncate(fc, off_t(hc.payload_offset + uint64_t(m) * n * sizeof(Type))) != 0)
+        return finish(false);
+    if (m == 0 || n == 0)
+        return finish(true);
+
+    // C tiles stay in the accumulator type over the whole depth and are rounded only when written
+    using Accumulator = MatrixAccumulatorT<Type>;
+    int mt, nt, kt;
+    OutOfCoreTiles(memory_budget, std::max(sizeof(Type), sizeof(Accumulator)), m, n, k, mt, nt, kt);
+    std::vector<Type> a_tiles[2], b_tiles[2];
+    std::vector<Accumulator> c_tiles[2];
+    for (int b = 0; b < 2; b++) {
+        a_tiles[b].resize(size_t(mt) * std::max(kt, 1));
+        b_tiles[b].resize(size_t(std::max(kt, 1)) * nt);
+        c_tiles[b].resize(size_t(mt) * nt);
+    }
+
+    // Every (C tile, depth slice) pair is one step; step s + 1 is read while step s is multiplied
+    struct Step { int i0, j0, p0, mr, nr, kr; };
+    std::vector<Step> steps;
+    for (int i0 = 0; i0 < m; i0 += mt)
+        for (int j0 = 0; j0 < n; j0 += nt)
+            for (int p0 = 0; p0 < std::max(k, 1); p0 += kt)
+                steps.push_back({i0, j0, p0, std::min(mt, m - i0), std::min(nt, n - j0), std::min(kt, k - p0)});
+
+    auto load = [&](const Step &step, int buffer) {
+        return ReadTile(fa, ha, step.i0, step.p0, step.mr, step.kr, a_tiles[buffer].data()) &&
+               ReadTile(fb, hb, step.p0, step.j0, step.kr, step.nr, b_tiles[buffer].data());
+    };
+
+    bool ok = true;
+    OutOfCoreIO io;
+    std::future<bool> reading = io.Run([&load, &steps] { return load(steps[0], 0); });
+    std::future<bool> writing;
+    int c_buffer = 0;
+    for (size_t s = 0; s < steps.size() && ok; s++) {
+        const Step &step = steps[s];
+        int buffer = int(s % 2);
+        ok = reading.get();
+        if (s + 1 < steps.size())
+            reading = io.Run([&load, &steps, s, buffer] { return load(steps[s + 1], 1 - buffer); });
+        if (!ok)
+            break;
+
+        Accumulator *c = c_tiles[c_buffer].data();
+        if (step.p0 == 0)
+            std::fill(c, c + size_t(step.mr) * step.nr, Accumulator(0));
+        GemmStrided(step.mr, step.nr, step.kr, a_tiles[buffer].data(), step.kr, 1,
+                    b_tiles[buffer].data(), step.nr, 1, c, step.nr);
+
+        if (step.p0 + kt >= k) {
+            if (writing.valid() && !writing.get())
+                ok = false;
+            writing = io.Run([&, step, c]() {
+                return WriteTile<Type>(fc, hc, step.i0, step.j0, step.mr, step.nr, c);
+            });
+            c_buffer = 1 - c_buffer;
+        }
+    }
+    if (reading.valid())
+        reading.wait();
+    if (writing.valid() && !writing.get())
+        ok = false;
+    return finish(ok);
+#else
+    (void)a_path;
+    (void)b_path;
+    (void)c_path;
+    (void)memory_budget;
+    return false;
+#endif
+}
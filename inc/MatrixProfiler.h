@@ -0,0 +1,338 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Always-compiled instrumentation. Every public operation opens a MATRIX_PROFILE("name") scope.
+ * While profiling is disabled (the default) a scope costs one relaxed atomic load. Once enabled,
+ * every thread keeps its own counters per operation: calls, FLOPs, bytes moved, buffer allocations
+ * and a log2 latency histogram. Kernels report work with MatrixProfiler::CountWork and the matrix
+ * allocator with MatrixProfiler::CountAllocation; both are charged to the innermost open scope.
+ * Snapshot() sums all threads. With tracing on, every scope also becomes a complete event
+ * that WriteChromeTrace() exports for chrome://tracing or Perfetto.
+ *
+ * Counters are atomics that only their own thread adds to, so snapshots can be taken while work
+ * runs. Reset() never writes them: it records their current values as a baseline that snapshots
+ * subtract, so a reset cannot race with an owner's update.
+ */
+struct MatrixOpSnapshot {
+    static constexpr int HistogramBuckets = 40;
+
+    std::string name;
+    uint64_t calls = 0;
+    double flops = 0;
+    uint64_t bytes = 0;
+    uint64_t allocations = 0;
+    uint64_t allocated_bytes = 0;
+    uint64_t total_ns = 0;
+    // histogram[b] counts calls that took [2^b, 2^(b+1)) nanoseconds
+    uint64_t histogram[HistogramBuckets] = {};
+
+    [[nodiscard]] double Seconds() const { return double(total_ns) * 1e-9; }
+    [[nodiscard]] double GFlops() const { return total_ns ? flops / double(total_ns) : 0.0; }
+};
+
+class MatrixProfiler {
+
+private:
+    struct OpCounters {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<double> flops{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> allocations{0};
+        std::atomic<uint64_t> allocated_bytes{0};
+        std::atomic<uint64_t> total_ns{0};
+        std::atomic<uint64_t> histogram[MatrixOpSnapshot::HistogramBuckets]{};
+        // Values at the last Reset(); guarded by the registry lock
+        MatrixOpSnapshot baseline{};
+    };
+
+    struct TraceEvent {
+        int op;
+        uint64_t start_ns;
+        uint64_t duration_ns;
+        double flops;
+        uint64_t bytes;
+    };
+
+    struct ThreadProfile {
+        int thread_id = 0;
+        std::vector<std::unique_ptr<OpCounters>> ops{};
+        std::mutex trace_mutex;
+        std::vector<TraceEvent> trace{};
+
+        ThreadProfile();
+        ~ThreadProfile();
+
+        OpCounters &Op(int op){
+            // Only the owning thread grows the table; readers take the registry lock, see Snapshot()
+            if (op >= int(ops.size())) {
+                std::lock_guard<std::mutex> lock(Instance().registry_mutex);
+                while (int(ops.size()) <= op)
+                    ops.push_back(std::make_unique<OpCounters>());
+            }
+            return *ops[op];
+        }
+    };
+
+    std::atomic<bool> enabled{false};
+    std::atomic<bool> tracing{false};
+    std::mutex registry_mutex;
+    std::vector<std::string> names{};
+    std::unordered_map<std::string, int> ids{};
+    std::vector<ThreadProfile *> threads{};
+    std::vector<MatrixOpSnapshot> retired{};
+    std::vector<std::pair<int, TraceEvent>> retired_trace{};
+    int next_thread_id = 1;
+    size_t max_trace_events = size_t(1) << 20;
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+    MatrixProfiler() = default;
+
+    static void Add(std::atomic<uint64_t> &counter, uint64_t value){
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    static void Add(std::atomic<double> &counter, double value){
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    static ThreadProfile &Local(){
+        thread_local ThreadProfile profile;
+        return profile;
+    }
+
+    static MatrixOpSnapshot Read(const OpCounters &c){
+        MatrixOpSnapshot s;
+        s.calls = c.calls.load(std::memory_order_relaxed);
+        s.flops = c.flops.load(std::memory_order_relaxed);
+        s.bytes = c.bytes.load(std::memory_order_relaxed);
+        s.allocations = c.allocations.load(std::memory_order_relaxed);
+        s.allocated_bytes = c.allocated_bytes.load(std::memory_order_relaxed);
+        s.total_ns = c.total_ns.load(std::memory_order_relaxed);
+        for (int b = 0; b < MatrixOpSnapshot::HistogramBuckets; b++)
+            s.histogram[b] = c.histogram[b].load(std::memory_order_relaxed);
+        return s;
+    }
+
+    // Adds what each counter gained since its baseline; the caller holds the registry lock
+    static void Accumulate(std::vector<MatrixOpSnapshot> &out, const std::vector<std::unique_ptr<OpCounters>> &ops){
+        for (size_t op = 0; op < ops.size(); op++) {
+            const MatrixOpSnapshot current = Read(*ops[op]);
+            const MatrixOpSnapshot &base = ops[op]->baseline;
+            MatrixOpSnapshot &s = out[op];
+            s.calls += current.calls - base.calls;
+            s.flops += current.flops - base.flops;
+            s.bytes += current.bytes - base.bytes;
+            s.allocations += current.allocations - base.allocations;
+            s.allocated_bytes += current.allocated_bytes - base.allocated_bytes;
+            s.total_ns += current.total_ns - base.total_ns;
+            for (int b = 0; b < MatrixOpSnapshot::HistogramBuckets; b++)
+                s.histogram[b] += current.histogram[b] - base.histogram[b];
+        }
+    }
+
+public:
+    class Scope;
+
+    static MatrixProfiler &Instance(){
+        static MatrixProfiler profiler;
+        return profiler;
+    }
+
+    static bool IsEnabled() { return Instance().enabled.load(std::memory_order_relaxed); }
+    static void Enable(bool on = true) { Instance().enabled.store(on, std::memory_order_relaxed); }
+
+    // Tracing records one event per scope (up to max_events per thread) on top of the counters
+    static void EnableTrace(bool on = true, size_t max_events = size_t(1) << 20){
+        MatrixProfiler &profiler = Instance();
+        {
+            std::lock_guard<std::mutex> lock(profiler.registry_mutex);
+            profiler.max_trace_events = max_events;
+        }
+        profiler.tracing.store(on, std::memory_order_relaxed);
+        if (on)
+            Enable();
+    }
+
+    // Id of an operation name; MATRIX_PROFILE caches it in a function-local static
+    static int Register(const char *name){
+        MatrixProfiler &profiler = Instance();
+        std::lock_guard<std::mutex> lock(profiler.registry_mutex);
+        auto it = profiler.ids.find(name);
+        if (it != profiler.ids.end())
+            return it->second;
+        profiler.names.emplace_back(name);
+        profiler.retired.emplace_back();
+        return profiler.ids[name] = int(profiler.names.size()) - 1;
+    }
+
+    static inline thread_local Scope *current = nullptr;
+
+    // Charges work done by a kernel to the innermost open scope of this thread
+    static void CountWork(double flops, uint64_t bytes);
+    static void CountAllocation(uint64_t bytes);
+
+    static std::vector<MatrixOpSnapshot> Snapshot(){
+        MatrixProfiler &profiler = Instance();
+        std::lock_guard<std::mutex> lock(profiler.registry_mutex);
+        std::vector<MatrixOpSnapshot> result = profiler.retired;
+        for (size_t op = 0; op < result.size(); op++)
+            result[op].name = profiler.names[op];
+        for (ThreadProfile *thread : profiler.threads)
+            Accumulate(result, thread->ops);
+        result.erase(std::remove_if(result.begin(), result.end(),
+                                    [](const MatrixOpSnapshot &s) { return s.calls == 0; }), result.end());
+        return result;
+    }
+
+    // Starts all counters over from zero and drops recorded trace events
+    static void Reset(){
+        MatrixProfiler &profiler = Instance();
+        std::lock_guard<std::mutex> lock(profiler.registry_mutex);
+        for (MatrixOpSnapshot &s : profiler.retired)
+            s = MatrixOpSnapshot{};
+        profiler.retired_trace.clear();
+        for (ThreadProfile *thread : profiler.threads) {
+            for (auto &c : thread->ops)
+                c->baseline = Read(*c);
+            std::lock_guard<std::mutex> trace_lock(thread->trace_mutex);
+            thread->trace.clear();
+        }
+    }
+
+    // Chrome trace-event format: one complete ("X") event per recorded scope, timestamps in microseconds
+    static bool WriteChromeTrace(const std::string &path){
+        MatrixProfiler &profiler = Instance();
+        std::vector<std::pair<int, TraceEvent>> events;
+        std::vector<std::string> names;
+        {
+            std::lock_guard<std::mutex> lock(profiler.registry_mutex);
+            names = profiler.names;
+            events = profiler.retired_trace;
+            for (ThreadProfile *thread : profiler.threads) {
+                std::lock_guard<std::mutex> trace_lock(thread->trace_mutex);
+                for (const TraceEvent &event : thread->trace)
+                    events.emplace_back(thread->thread_id, event);
+            }
+        }
+        std::FILE *file = std::fopen(path.c_str(), "w");
+        if (!file)
+            return false;
+        std::fprintf(file, "{\"traceEvents\":[\n");
+        for (size_t i = 0; i < events.size(); i++) {
+            const TraceEvent &e = events[i].second;
+            std::string name;
+            for (char c : names[e.op])
+                name += c == '"' || c == '\\' ? ' ' : c;
+            std::fprintf(file, "{\"name\":\"%s\",\"cat\":\"matrix\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                               "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"flops\":%.0f,\"bytes\":%llu}}%s\n",
+                         name.c_str(), events[i].first, double(e.start_ns) * 1e-3, double(e.duration_ns) * 1e-3,
+                         e.flops, (unsigned long long)e.bytes, i + 1 < events.size() ? "," : "");
+        }
+        std::fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+        return std::fclose(file) == 0;
+    }
+
+    static uint64_t NowNs(){
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - Instance().epoch).count());
+    }
+
+    class Scope {
+
+    private:
+        int op;
+        bool active;
+        uint64_t start_ns = 0;
+        double flops = 0;
+        uint64_t bytes = 0;
+        uint64_t allocations = 0;
+        uint64_t allocated_bytes = 0;
+        Scope *parent = nullptr;
+
+        friend class MatrixProfiler;
+
+    public:
+        explicit Scope(int Op) : op(Op), active(IsEnabled()){
+            if (!active)
+                return;
+            parent = current;
+            current = this;
+            start_ns = NowNs();
+        }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+        ~Scope(){
+            if (!active)
+                return;
+            uint64_t duration = NowNs() - start_ns;
+            current = parent;
+            ThreadProfile &local = Local();
+            OpCounters &c = local.Op(op);
+            Add(c.calls, 1);
+            Add(c.flops, flops);
+            Add(c.bytes, bytes);
+            Add(c.allocations, allocations);
+            Add(c.allocated_bytes, allocated_bytes);
+            Add(c.total_ns, duration);
+            int bucket = duration ? std::min(MatrixOpSnapshot::HistogramBuckets - 1, 63 - __builtin_clzll(duration)) : 0;
+            Add(c.histogram[bucket], 1);
+            MatrixProfiler &profiler = Instance();
+            if (profiler.tracing.load(std::memory_order_relaxed)) {
+                std::lock_guard<std::mutex> lock(local.trace_mutex);
+                if (local.trace.size() < profiler.max_trace_events)
+                    local.trace.push_back({op, start_ns, duration, flops, bytes});
+            }
+        }
+    };
+};
+
+inline MatrixProfiler::ThreadProfile::ThreadProfile(){
+    MatrixProfiler &profiler = Instance();
+    std::lock_guard<std::mutex> lock(profiler.registry_mutex);
+    thread_id = profiler.next_thread_id++;
+    profiler.threads.push_back(this);
+}
+
+// A finished thread folds its counters and trace into the process totals
+inline MatrixProfiler::ThreadProfile::~ThreadProfile(){
+    MatrixProfiler &profiler = Instance();
+    std::lock_guard<std::mutex> lock(profiler.registry_mutex);
+    Accumulate(profiler.retired, ops);
+    for (const TraceEvent &event : trace)
+        profiler.retired_trace.emplace_back(thread_id, event);
+    profiler.threads.erase(std::find(profiler.threads.begin(), profiler.threads.end(), this));
+}
+
+inline void MatrixProfiler::CountWork(double flops, uint64_t bytes){
+    if (Scope *scope = current) {
+        scope->flops += flops;
+        scope->bytes += bytes;
+    }
+}
+
+inline void MatrixProfiler::CountAllocation(uint64_t bytes){
+    if (Scope *scope = current) {
+        scope->allocations++;
+        scope->allocated_bytes += bytes;
+    }
+}
+
+#define MATRIX_PROFILE_CONCAT_(a, b) a##b
+#define MATRIX_PROFILE_CONCAT(a, b) MATRIX_PROFILE_CONCAT_(a, b)
+#define MATRIX_PROFILE(name) \
+    static const int MATRIX_PROFILE_CONCAT(matrix_profile_id_, __LINE__) = MatrixProfiler::Register(name); \
+    MatrixProfiler::Scope MATRIX_PROFILE_CONCAT(matrix_profile_scope_, __LINE__)(MATRIX_PROFILE_CONCAT(matrix_profile_id_, __LINE__))
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "Matrix.h"
+#include "MatrixTriangular.h"
+
+namespace MatrixDetail {
+    constexpr int QRBlockSize = 32;
+
+    inline Workspace &QRWorkspace(){
+        thread_local Workspace workspace;
+        return workspace;
+    }
+
+    /*
+     * Householder reflector H = I - tau * v * v^T with v[0] = 1 that maps (alpha, x) to (beta, 0).
+     * alpha becomes beta and x (length - 1 elements, step incx) becomes v[1:]. The norm is
+     * taken on scaled values, so it neither overflows nor underflows. tau == 0 means H = I.
+     */
+    template<typename Type>
+    Type HouseholderVector(int length, Type &alpha, Type *x, ptrdiff_t incx){
+        Type scale = std::abs(alpha);
+        for (int i = 0; i < length - 1; i++)
+            scale = std::max(scale, Type(std::abs(x[i * incx])));
+        if (scale == Type(0))
+            return Type(0);
+        Type tail = Type(0);
+        for (int i = 0; i < length - 1; i++) {
+            Type value = x[i * incx] / scale;
+            tail += value * value;
+        }
+        if (tail == Type(0))
+            return Type(0);
+        Type a = alpha / scale;
+        Type beta = std::sqrt(a * a + tail) * scale;
+        if (alpha > Type(0))
+            beta = -beta;
+        Type tau = (beta - alpha) / beta;
+        Type inv = Type(1) / (alpha - beta);
+        for (int i = 0; i < length - 1; i++)
+            x[i * incx] *= inv;
+        alpha = beta;
+        return tau;
+    }
+
+    // Copies the reflectors of a panel (rows x nb below the diagonal of A) to V with the unit diagonal made explicit
+    template<typename Type>
+    void QRPanelVectors(int rows, int nb, const Type *A, int lda, Type *V){
+        for (int r = 0; r < rows; r++) {
+            const Type *a = A + size_t(r) * lda;
+            Type *v = V + size_t(r) * nb;
+            for (int c = 0; c < nb; c++)
+                v[c] = c < r ? a[c] : c == r ? Type(1) : Type(0);
+        }
+    }
+
+    /*
+     * C = (I - V T V^T) C, or with T^T when transpose is set (that is H_nb ... H_1 C, i.e. Q^T C).
+     * V is rows x nb, C is rows x columns; work holds nb x columns.
+     */
+    template<typename Type>
+    void ApplyBlockReflector(int rows, int columns, int nb, const Type *V, const Type *T, int ldt, bool transpose,
+                             Type *C, int ldc, Type *work){
+        if (columns <= 0 || nb <= 0)
+            return;
+        std::fill(work, work + size_t(nb) * columns, Type(0));
+        GemmStrided(nb, columns, rows, V, 1, nb, C, ldc, 1, work, columns);
+        // work = T^T work runs bottom-up and work = T work top-down, so every row still reads unchanged rows
+        auto combine = [&](int r) {
+            Type *w = work + size_t(r) * columns;
+            int s0 = transpose ? 0 : r + 1;
+            int s1 = transpose ? r : nb;
+            Type diagonal = T[size_t(r) * ldt + r];
+            for (int j = 0; j < columns; j++)
+                w[j] *= diagonal;
+            for (int s = s0; s < s1; s++) {
+                Type t = transpose ? T[size_t(s) * ldt + r] : T[size_t(r) * ldt + s];
+                const Type *ws = work + size_t(s) * columns;
+                for (int j = 0; j < columns; j++)
+                    w[j] += t * ws[j];
+            }
+        };
+        if (transpose)
+            for (int r = nb - 1; r >= 0; r--)
+                combine(r);
+        else
+            for (int r = 0; r < nb; r++)
+                combine(r);
+        Gemm(rows, columns, nb, V, nb, work, columns, C, ldc, Type(-1));
+    }
+
+    /*
+     * In-place blocked Householder QR of an m x n row-major matrix, m >= n (LAPACK geqrt scheme).
+     * On return R is on and above the diagonal, the reflectors v are below it, tau[j] belongs to
+     * column j and T holds the upper triangular nb x nb factor of every panel at columns k0..k0+nb.
+     */
+    template<typename Type>
+    void QRFactor(int m, int n, Type *A, int lda, Type *tau, Type *T, int ldt){
+        MatrixProfiler::CountWork(2.0 * n * n * (m - n / 3.0), 2 * size_t(m) * n * sizeof(Type));
+        auto a = [A, lda](int i, int j) -> Type & { return A[size_t(i) * lda + j]; };
+        const int NB = QRBlockSize;
+        // V and the work rows stay in use across the Gemm calls, which may run other kernels on this thread
+        WorkspaceLease lease(QRWorkspace());
+
+        for (int k0 = 0; k0 < n; k0 += NB) {
+            int k1 = std::min(n, k0 + NB);
+            int nb = k1 - k0;
+            int rows = m - k0;
+            Type *V = lease.Get<Type>(size_t(rows) * nb + size_t(nb) * (nb + std::max(n - k1, 1)));
+            Type *work = V + size_t(rows) * nb;
+
+            // Unblocked factorization of the panel A[k0:m, k0:k1]; the reflector is applied row by row
+            for (int j = k0; j < k1; j++) {
+                tau[j] = HouseholderVector(m - j, a(j, j), &a(std::min(j + 1, m - 1), j), lda);
+                if (tau[j] == Type(0) || j + 1 == k1)
+                    continue;
+                Type *w = work;
+                std::copy(&a(j, j + 1), &a(j, 0) + k1, w);
+                for (int i = j + 1; i < m; i++) {
+                    Type v = a(i, j);
+                    for (int c = j + 1; c < k1; c++)
+                        w[c - j - 1] += v * a(i, c);
+                }
+                for (int c = j + 1; c < k1; c++)
+                    a(j, c) -= tau[j] * w[c - j - 1];
+                for (int i = j + 1; i < m; i++) {
+                    Type v = tau[j] * a(i, j);
+                    for (int c = j + 1; c < k1; c++)
+                        a(i, c) -= v * w[c - j - 1];
+                }
+            }
+
+            // T from tau and the Gram matrix G = V^T V: T[0:i, i] = -tau_i * T[0:i, 0:i] * G[0:i, i]
+            QRPanelVectors(rows, nb, &a(k0, k0), lda, V);
+            Type *gram = work;
+            std::fill(gram, gram + size_t(nb) * nb, Type(0));
+            GemmStrided(nb, nb, rows, V, 1, nb, V, nb, 1, gram, nb);
+            Type *t = T + k0;
+            for (int i = 0; i < nb; i++) {
+                Type tau_i = tau[k0 + i];
+                for (int r = 0; r < i; r++) {
+                    Type sum = Type(0);
+                    for (int s = r; s < i; s++)
+                        sum += t[size_t(r) * ldt + s] * gram[size_t(s) * nb + i];
+                    t[size_t(r) * ldt + i] = -tau_i * sum;
+                }
+                t[size_t(i) * ldt + i] = tau_i;
+                for (int r = i + 1; r < nb; r++)
+                    t[size_t(r) * ldt + i] = Type(0);
+            }
+
+            // A[k0:m, k1:n] = Q_panel^T * A[k0:m, k1:n]
+            ApplyBlockReflector(rows, n - k1, nb, V, t, ldt, true, &a(k0, k1), lda, work);
+        }
+    }
+}
+
+/*
+ * Householder QR factorization A = Q * R of an m x n matrix with m >= n. Reflectors are
+ * generated in panels of QRBlockSize and each panel is kept in compact WY form,
+ * H_1 ... H_nb = I - V * T * V^T, so applying it is two Gemm calls and a small triangular
+ * product. All but an O(m * n * nb) share of the O(m * n^2) work runs in Gemm.
+ * Factor once, then reuse the object for least-squares solves, Q^T * B products, or Q and R.
+ */
+template<typename Type>
+class QR {
+
+private:
+    Matrix<Type> factors{};
+    Matrix<Type> block_factors{};
+    std::vector<Type> tau{};
+    bool rank_deficient = false;
+
+    // B = Q^T * B (transpose) or B = Q * B for an m x nrhs block; the reflector panels go in opposite orders
+    void ApplyInPlace(Type *B, int ldb, int nrhs, bool transpose) const{
+        int m = GetRows(), n = GetColumns();
+        const int NB = MatrixDetail::QRBlockSize;
+        int panels = (n + NB - 1) / NB;
+        MatrixDetail::WorkspaceLease lease(MatrixDetail::QRWorkspace());
+        for (int p = 0; p < panels; p++) {
+            int k0 = (transpose ? p : panels - 1 - p) * NB;
+            int nb = std::min(NB, n - k0);
+            int rows = m - k0;
+            Type *V = lease.Get<Type>(size_t(rows) * nb + size_t(nb) * std::max(nrhs, 1));
+            MatrixDetail::QRPanelVectors(rows, nb, factors.Data() + size_t(k0) * factors.GetStride() + k0, factors.GetStride(), V);
+            MatrixDetail::ApplyBlockReflector(rows, nrhs, nb, V, block_factors.Data() + k0, block_factors.GetStride(), transpose,
+                                              B + size_t(k0) * ldb, ldb, V + size_t(rows) * nb);
+        }
+    }
+
+public:
+    template<typename SourceType>
+    explicit QR(const MatrixView<SourceType> &Source){
+        MATRIX_PROFILE("QR::QR(const MatrixView<SourceType> &Source)");
+        int m = Source.GetRows(), n = Source.GetColumns();
+        assert(m >= n);
+        factors = Matrix<Type>(m, n);
+        for (int i = 0; i < m; i++) {
+            if (Source.IsRowContiguous())
+                std::copy(Source.RowPointer(i), Source.RowPointer(i) + n, factors[i].begin());
+            else
+                for (int j = 0; j < n; j++)
+                    factors[i][j] = Type(Source(i, j));
+        }
+        tau.resize(n);
+        block_factors = Matrix<Type>(std::min(n, MatrixDetail::QRBlockSize), n);
+        MatrixDetail::QRFactor(m, n, factors.Data(), factors.GetStride(), tau.data(), block_factors.Data(), block_factors.GetStride());
+
+        // Same test as LUIsSingular: a diagonal entry of R negligible next to the largest one
+        Type largest = Type(0);
+        for (int i = 0; i < n; i++)
+            largest = std::max(largest, Type(std::abs(factors[i][i])));
+        Type threshold = largest * Type(m) * std::numeric_limits<Type>::epsilon();
+        for (int i = 0; i < n; i++)
+            if (std::abs(factors[i][i]) <= threshold)
+                rank_deficient = true;
+    }
+
+    template<typename SourceType>
+    explicit QR(const Matrix<SourceType> &Source) : QR(MatrixView<SourceType>(Source)) {}
+
+    [[nodiscard]] int GetRows() const { return factors.GetRows(); }
+    [[nodiscard]] int GetColumns() const { return factors.GetColumns(); }
+    [[nodiscard]] bool IsRankDeficient() const { return rank_deficient; }
+    [[nodiscard]] const Matrix<Type> &GetFactors() const { return factors; }
+    [[nodiscard]] const std::vector<Type> &GetTau() const { return tau; }
+
+    // The n x n upper triangular factor
+    [[nodiscard]] Matrix<Type> GetR() const{
+        int n = GetColumns();
+        Matrix<Type> R(n, n);
+        for (int i = 0; i < n; i++)
+            std::copy(factors[i].begin() + i, factors[i].end(), R[i].begin() + i);
+        return R;
+    }
+
+    // The first n columns of Q (thin, m x n) or all of it (m x m)
+    [[nodiscard]] Matrix<Type> GetQ(bool thin = true) const{
+        MATRIX_PROFILE("QR::GetQ(bool thin)");
+        int m = GetRows();
+        Matrix<Type> Q(m, thin ? GetColumns() : m);
+        for (int i = 0; i < Q.GetColumns(); i++)
+            Q[i][i] = Type(1);
+        ApplyInPlace(Q.Data(), Q.GetStride(), Q.GetColumns(), false);
+        return Q;
+    }
+
+    // Overwrites the m x k matrix B with Q^T * B
+    void ApplyQTransposed(Matrix<Type> &B) const{
+        MATRIX_PROFILE("QR::ApplyQTransposed(Matrix<Type> &B)");
+        assert(B.GetRows() == GetRows());
+        ApplyInPlace(B.Data(), B.GetStride(), B.GetColumns(), true);
+    }
+
+    // Overwrites the m x k matrix B with Q * B
+    void ApplyQ(Matrix<Type> &B) const{
+        MATRIX_PROFILE("QR::ApplyQ(Matrix<Type> &B)");
+        assert(B.GetRows() == GetRows());
+        ApplyInPlace(B.Data(), B.GetStride(), B.GetColumns(), false);
+    }
+
+    // X minimizing ||A * X - RHS|| column by column: R * X = (Q^T * RHS)[0:n]
+    bool LeastSquares(const Matrix<Type> &RHS, Matrix<Type> &out_solution) const{
+        MATRIX_PROFILE("QR::LeastSquares(const Matrix<Type> &RHS, Matrix<Type> &out_solution)");
+        assert(RHS.GetRows() == GetRows());
+        if (rank_deficient)
+            return false;
+        Matrix<Type> B = RHS;
+        ApplyQTransposed(B);
+        int n = GetColumns();
+        MatrixDetail::TrsmUpper(n, B.GetColumns(), factors.Data(), factors.GetStride(), false, B.Data(), B.GetStride());
+        out_solution = Matrix<Type>(n, B.GetColumns());
+        for (int i = 0; i < n; i++)
+            out_solution[i] = B[i];
+        return true;
+    }
+
+    bool LeastSquares(const std::vector<Type> &RHS, std::vector<Type> &out_solution) const{
+        assert(RHS.size() == size_t(GetRows()));
+        if (rank_deficient)
+            return false;
+        std::vector<Type> b = RHS;
+        ApplyInPlace(b.data(), 1, 1, true);
+        MatrixDetail::TrsmUpper(GetColumns(), 1, factors.Data(), factors.GetStride(), false, b.data(), 1);
+        out_solution.assign(b.begin(), b.begin() + GetColumns());
+        return true;
+    }
+};
@@ -0,0 +1,408 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+#include <vector>
+#include "Matrix.h"
+
+/*
+ * Compressed sparse matrices. CSR keeps, for every row, the column indices and values of its
+ * non-zeros (offsets[i] .. offsets[i + 1] into indices/values); CSC is the same with rows and
+ * columns swapped. Indices inside a row (column) are sorted and unique.
+ *
+ * Products run in CSR: sparse * dense and sparse * vector are parallel over output rows, and the
+ * sparse * vector inner products use AVX2 gathers for float and double. A CSC operand is converted
+ * first. Sparse * sparse is Gustavson's row-by-row algorithm with a dense accumulator.
+ */
+enum class SparseFormat { CSR, CSC };
+
+template<typename Type>
+struct SparseTriplet {
+    int row;
+    int column;
+    Type value;
+};
+
+namespace MatrixDetail {
+    // Sparse kernels only go parallel above this many multiply-adds
+    constexpr long long SparseParallelThreshold = 1 << 16;
+
+    template<typename Type>
+    Type SparseDotGeneric(int count, const Type *values, const int *indices, const Type *x){
+        Type acc[4] = {};
+        int p = 0;
+        for (; p + 4 <= count; p += 4)
+            for (int u = 0; u < 4; u++)
+                acc[u] += values[p + u] * x[indices[p + u]];
+        for (; p < count; p++)
+            acc[0] += values[p] * x[indices[p]];
+        return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    }
+
+#ifdef MATRIX_X86_DISPATCH
+    __attribute__((target("avx2,fma")))
+    inline float SparseDotAVX2(int count, const float *values, const int *indices, const float *x){
+        __m256 acc = _mm256_setzero_ps();
+        int p = 0;
+        for (; p + 8 <= count; p += 8) {
+            __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(indices + p));
+            acc = _mm256_fmadd_ps(_mm256_loadu_ps(values + p), _mm256_i32gather_ps(x, index, 4), acc);
+        }
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        float result = _mm_cvtss_f32(sum);
+        for (; p < count; p++)
+            result += values[p] * x[indices[p]];
+        return result;
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline double SparseDotAVX2(int count, const double *values, const int *indices, const double *x){
+        __m256d acc = _mm256_setzero_pd();
+        int p = 0;
+        for (; p + 4 <= count; p += 4) {
+            __m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i *>(indices + p));
+            acc = _mm256_fmadd_pd(_mm256_loadu_pd(values + p), _mm256_i32gather_pd(x, index, 8), acc);
+        }
+        __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+        double result = _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+        for (; p < count; p++)
+            result += values[p] * x[indices[p]];
+        return result;
+    }
+#endif
+
+    template<typename Type>
+    bool SparseUsesAVX2(){
+#ifdef MATRIX_X86_DISPATCH
+        if constexpr (std::is_same_v<Type, float> || std::is_same_v<Type, double>)
+            return ActiveGemmIsa() == GemmIsa::AVX2 || ActiveGemmIsa() == GemmIsa::AVX512;
+#endif
+        return false;
+    }
+
+    template<typename Type>
+    Type SparseDot(int count, const Type *values, const int *indices, const Type *x, bool avx2){
+#ifdef MATRIX_X86_DISPATCH
+        if constexpr (std::is_same_v<Type, float> || std::is_same_v<Type, double>)
+            if (avx2)
+                return SparseDotAVX2(count, values, indices, x);
+#endif
+        (void)avx2;
+        return SparseDotGeneric(count, values, indices, x);
+    }
+
+    // Runs body(begin, end) over [0, count) rows, in parallel once the work is worth it
+    template<typename Function>
+    void SparseForRows(int count, long long work, Function &&body){
+        MatrixThreadPool &pool = MatrixThreadPool::Instance();
+        if (work < SparseParallelThreshold || pool.GetThreadCount() == 1) {
+            body(0, count);
+            return;
+        }
+        int grain = int(std::max(1LL, (long long)count * SparseParallelThreshold / work));
+        pool.ParallelFor(0, count, grain, body);
+    }
+}
+
+template<typename Type>
+class SparseMatrix {
+
+    template<typename OtherType>
+    friend class SparseMatrix;
+
+private:
+    int rows = 0;
+    int columns = 0;
+    SparseFormat format = SparseFormat::CSR;
+    std::vector<int> offsets{0};
+    std::vector<int> indices{};
+    std::vector<Type> values{};
+
+    [[nodiscard]] int MajorSize() const { return format == SparseFormat::CSR ? rows : columns; }
+    [[nodiscard]] int MinorSize() const { return format == SparseFormat::CSR ? columns : rows; }
+
+    // Counting sort of the entries by their minor index: turns CSR into CSC and back in O(nnz)
+    [[nodiscard]] SparseMatrix Transpose() const{
+        SparseMatrix result(rows, columns, format == SparseFormat::CSR ? SparseFormat::CSC : SparseFormat::CSR);
+        int minor = MinorSize();
+        result.offsets.assign(minor + 1, 0);
+        for (int index : indices)
+            result.offsets[index + 1]++;
+        std::partial_sum(result.offsets.begin(), result.offsets.end(), result.offsets.begin());
+        result.indices.resize(indices.size());
+        result.values.resize(values.size());
+        std::vector<int> next(result.offsets.begin(), result.offsets.end() - 1);
+        for (int major = 0; major < MajorSize(); major++)
+            for (int p = offsets[major]; p < offsets[major + 1]; p++) {
+                int q = next[indices[p]]++;
+                result.indices[q] = major;
+                result.values[q] = values[p];
+            }
+        return result;
+    }
+
+public:
+    SparseMatrix() = default;
+
+    SparseMatrix(int num_rows, int num_columns, SparseFormat Format = SparseFormat::CSR)
+        : rows(num_rows), columns(num_columns), format(Format){
+        offsets.assign(MajorSize() + 1, 0);
+    }
+
+    // Keeps the entries with |value| > tolerance
+    explicit SparseMatrix(const MatrixView<Type> &Source, SparseFormat Format = SparseFormat::CSR, Type tolerance = Type(0))
+        : SparseMatrix(Source.GetRows(), Source.GetColumns(), SparseFormat::CSR){
+        MATRIX_PROFILE("SparseMatrix::SparseMatrix(const MatrixView<Type> &Source)");
+        for (int i = 0; i < rows; i++) {
+            for (int j = 0; j < columns; j++) {
+                Type value = Source(i, j);
+                if (std::abs(value) > tolerance) {
+                    indices.push_back(j);
+                    values.push_back(value);
+                }
+            }
+            offsets[i + 1] = int(indices.size());
+        }
+        if (Format == SparseFormat::CSC)
+            *this = Transpose();
+    }
+
+    explicit SparseMatrix(const Matrix<Type> &Source, SparseFormat Format = SparseFormat::CSR, Type tolerance = Type(0))
+        : SparseMatrix(Source.GetView(), Format, tolerance) {}
+
+    // Builds from unordered (row, column, value) entries; duplicates are summed
+    static SparseMatrix FromTriplets(int num_rows, int num_columns, std::vector<SparseTriplet<Type>> triplets,
+                                     SparseFormat Format = SparseFormat::CSR){
+        SparseMatrix result(num_rows, num_columns, Format);
+        bool csr = Format == SparseFormat::CSR;
+        std::sort(triplets.begin(), triplets.end(), [csr](const SparseTriplet<Type> &a, const SparseTriplet<Type> &b) {
+            return csr ? (a.row != b.row ? a.row < b.row : a.column < b.column)
+                       : (a.column != b.column ? a.column < b.column : a.row < b.row);
+        });
+        for (const SparseTriplet<Type> &entry : triplets) {
+            assert(entry.row < num_rows && entry.column < num_columns);
+            int major = csr ? entry.row : entry.column;
+            int minor = csr ? entry.column : entry.row;
+            if (result.offsets[major + 1] > 0 && result.indices.back() == minor)
+                result.values.back() += entry.value;
+            else {
+                result.indices.push_back(minor);
+                result.values.push_back(entry.value);
+                result.offsets[major + 1]++;
+            }
+        }
+        std::partial_sum(result.offsets.begin(), result.offsets.end(), result.offsets.begin());
+        return result;
+    }
+
+    [[nodiscard]] int GetRows() const { return rows; }
+    [[nodiscard]] int GetColumns() const { return columns; }
+    [[nodiscard]] SparseFormat GetFormat() const { return format; }
+    [[nodiscard]] int GetNonZeros() const { return int(values.size()); }
+    [[nodiscard]] const std::vector<int> &GetOffsets() const { return offsets; }
+    [[nodiscard]] const std::vector<int> &GetIndices() const { return indices; }
+    [[nodiscard]] const std::vector<Type> &GetValues() const { return values; }
+
+    [[nodiscard]] double Density() const{
+        return rows && columns ? double(values.size()) / (double(rows) * columns) : 0.0;
+    }
+
+    [[nodiscard]] SparseMatrix ToFormat(SparseFormat Format) const{
+        return Format == format ? *this : Transpose();
+    }
+
+    // A^T shares the compressed arrays: CSR of A is CSC of A^T
+    [[nodiscard]] SparseMatrix Transposed() const{
+        SparseMatrix result = *this;
+        std::swap(result.rows, result.columns);
+        result.format = format == SparseFormat::CSR ? SparseFormat::CSC : SparseFormat::CSR;
+        return result;
+    }
+
+    [[nodiscard]] Matrix<Type> ToDense() const{
+        Matrix<Type> result(rows, columns);
+        for (int major = 0; major < MajorSize(); major++)
+            for (int p = offsets[major]; p < offsets[major + 1]; p++) {
+                if (format == SparseFormat::CSR)
+                    result[major][indices[p]] = values[p];
+                else
+                    result[indices[p]][major] = values[p];
+            }
+        return result;
+    }
+
+    [[nodiscard]] Type operator()(int i, int j) const{
+        assert(i < rows && j < columns);
+        int major = format == SparseFormat::CSR ? i : j;
+        int minor = format == SparseFormat::CSR ? j : i;
+        auto begin = indices.begin() + offsets[major];
+        auto end = indices.begin() + offsets[major + 1];
+        auto it = std::lower_bound(begin, end, minor);
+        return it != end && *it == minor ? values[it - indices.begin()] : Type(0);
+    }
+
+    // y = A * x into caller storage, so iterative solvers can reuse their vectors; CSR only
+    void Multiply(const Type *x, Type *y) const{
+        MATRIX_PROFILE("SparseMatrix::Multiply(const Type *x, Type *y)");
+        assert(format == SparseFormat::CSR);
+        MatrixProfiler::CountWork(2.0 * GetNonZeros(), size_t(GetNonZeros()) * (sizeof(Type) + sizeof(int)) +
+                                                    size_t(rows + columns) * sizeof(Type));
+        const bool avx2 = MatrixDetail::SparseUsesAVX2<Type>();
+        MatrixDetail::SparseForRows(rows, GetNonZeros(), [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+                y[i] = MatrixDetail::SparseDot(offsets[i + 1] - offsets[i], values.data() + offsets[i],
+                                               indices.data() + offsets[i], x, avx2);
+        });
+    }
+
+    // y = A * x
+    [[nodiscard]] std::vector<Type> operator*(const std::vector<Type> &x) const{
+        MATRIX_PROFILE("SparseMatrix::operator*(const std::vector<Type> &x)");
+        assert(int(x.size()) == columns);
+        if (format == SparseFormat::CSC)
+            return ToFormat(SparseFormat::CSR) * x;
+        std::vector<Type> y(rows);
+        Multiply(x.data(), y.data());
+        return y;
+    }
+
+    // C = A * B with a dense B: every non-zero adds a scaled, contiguous row of B to a row of C
+    [[nodiscard]] Matrix<Type> operator*(const MatrixView<Type> &B) const{
+        MATRIX_PROFILE("SparseMatrix::operator*(const MatrixView<Type> &B)");
+        assert(columns == B.GetRows());
+        if (format == SparseFormat::CSC)
+            return ToFormat(SparseFormat::CSR) * B;
+        if (!B.IsRowContiguous())
+            return *this * Matrix<Type>(B).GetView();
+        int n = B.GetColumns();
+        MatrixProfiler::CountWork(2.0 * GetNonZeros() * n, size_t(GetNonZeros()) * n * 2 * sizeof(Type));
+        Matrix<Type> C(rows, n);
+        MatrixDetail::SparseForRows(rows, (long long)GetNonZeros() * n, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                Type *c = C[i].begin();
+                for (int p = offsets[i]; p < offsets[i + 1]; p++) {
+                    Type a = values[p];
+                    const Type *b = B.RowPointer(indices[p]);
+                    for (int j = 0; j < n; j++)
+                        c[j] += a * b[j];
+                }
+            }
+        });
+        return C;
+    }
+
+    [[nodiscard]] Matrix<Type> operator*(const Matrix<Type> &B) const { return *this * B.GetView(); }
+
+    // Gustavson: row i of C accumulates the rows of B selected by the non-zeros of row i of A
+    [[nodiscard]] SparseMatrix operator*(const SparseMatrix &other) const{
+        MATRIX_PROFILE("SparseMatrix::operator*(const SparseMatrix &other)");
+        assert(columns == other.rows);
+        if (format == SparseFormat::CSC || other.format == SparseFormat::CSC)
+            return ToFormat(SparseFormat::CSR) * other.ToFormat(SparseFormat::CSR);
+
+        const SparseMatrix &B = other;
+        int n = B.columns;
+        long long work = 0;
+        for (int index : indices)
+            work += B.offsets[index + 1] - B.offsets[index];
+        MatrixProfiler::CountWork(2.0 * work, size_t(work) * (sizeof(Type) + sizeof(int)));
+
+        // Symbolic pass counts the entries of every row of C, the numeric pass fills them in
+        SparseMatrix C(rows, n);
+        MatrixDetail::SparseForRows(rows, work, [&](int begin, int end) {
+            std::vector<int> marker(n, -1);
+            for (int i = begin; i < end; i++) {
+                int count = 0;
+                for (int p = offsets[i]; p < offsets[i + 1]; p++)
+                    for (int q = B.offsets[indices[p]]; q < B.offsets[indices[p] + 1]; q++)
+                        if (marker[B.indices[q]] != i) {
+                            marker[B.indices[q]] = i;
+                            count++;
+                        }
+                C.offsets[i + 1] = count;
+            }
+        });
+        std::partial_sum(C.offsets.begin(), C.offsets.end(), C.offsets.begin());
+        C.indices.resize(C.offsets[rows]);
+        C.values.resize(C.offsets[rows]);
+
+        MatrixDetail::SparseForRows(rows, work, [&](int begin, int end) {
+            std::vector<Type> accumulator(n, Type(0));
+            std::vector<int> marker(n, -1);
+            for (int i = begin; i < end; i++) {
+                int *row = C.indices.data() + C.offsets[i];
+                int count = 0;
+                for (int p = offsets[i]; p < offsets[i + 1]; p++) {
+                    Type a = values[p];
+                    for (int q = B.offsets[indices[p]]; q < B.offsets[indices[p] + 1]; q++) {
+                        int j = B.indices[q];
+                        if (marker[j] != i) {
+                            marker[j] = i;
+                            row[count++] = j;
+                        }
+                        accumulator[j] += a * B.values[q];
+                    }
+                }
+                std::sort(row, row + count);
+                for (int k = 0; k < count; k++) {
+                    C.values[C.offsets[i] + k] = accumulator[row[k]];
+                    accumulator[row[k]] = Type(0);
+                }
+            }
+        });
+        return C;
+    }
+};
+
+// C = A * S with a dense A: row i of C accumulates the rows of S selected by the non-zeros of row i of A
+template<typename Type>
+Matrix<Type> operator*(const MatrixView<Type> &A, const SparseMatrix<Type> &S){
+    MATRIX_PROFILE("operator*(const MatrixView<Type> &A, const SparseMatrix<Type> &S)");
+    assert(A.GetColumns() == S.GetRows());
+    if (S.GetFormat() == SparseFormat::CSC)
+        return A * S.ToFormat(SparseFormat::CSR);
+    const std::vector<int> &offsets = S.GetOffsets();
+    const std::vector<int> &indices = S.GetIndices();
+    const std::vector<Type> &values = S.GetValues();
+    Matrix<Type> C(A.GetRows(), S.GetColumns());
+    MatrixDetail::SparseForRows(A.GetRows(), (long long)A.GetRows() * S.GetNonZeros(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            Type *c = C[i].begin();
+            for (int k = 0; k < A.GetColumns(); k++) {
+                Type a = A(i, k);
+                if (a == Type(0))
+                    continue;
+                for (int p = offsets[k]; p < offsets[k + 1]; p++)
+                    c[indices[p]] += a * values[p];
+            }
+        }
+    });
+    return C;
+}
+
+template<typename Type>
+Matrix<Type> operator*(const Matrix<Type> &A, const SparseMatrix<Type> &S){
+    return A.GetView() * S;
+}
+
+namespace MatrixDetail {
+    /*
+     * Dense A * B goes through a CSR copy of A when A is sparse enough and B wide enough for
+     * the O(m * k) scan and conversion to be repaid; the scan stops as soon as A proves dense.
+     */
+    template<typename Type>
+    bool SparseProductPaysOff(const Matrix<Type> &A, const Matrix<Type> &B){
+        if (B.GetColumns() < 16 || (long long)A.GetRows() * A.GetColumns() * B.GetColumns() < GemmPackingThreshold)
+            return false;
+        return A.IsSparseMatrix(SparseDensityThreshold);
+    }
+
+    template<typename Type>
+    Matrix<Type> SparseProduct(const Matrix<Type> &A, const Matrix<Type> &B){
+        return SparseMatrix<Type>(A) * B;
+    }
+}
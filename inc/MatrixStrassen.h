@@ -0,0 +1,311 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include "MatrixGemm.h"
+#include "MatrixMemory.h"
+#include "MatrixProfiler.h"
+#include "MatrixThreadPool.h"
+#include "MatrixVector.h"
+
+/*
+ * Strassen-Winograd multiplication for large products (7 half-size products and 15 additions per
+ * level instead of 8 products). Every level halves m, k and n until the smallest of them would drop
+ * below the crossover, then the blocked Gemm takes over. Odd dimensions are peeled: the even part
+ * recurses and the last row / column / rank-1 term are fixed up with Gemm.
+ *
+ * The schedule (Boyer, Dumas, Pernet, Zhou) overwrites C and needs two temporaries per level,
+ * X of m/2 x max(k, n)/2 and Y of k/2 x n/2; all levels are carved from one per-thread buffer.
+ *
+ * Off by default. Once enabled, Matrix::operator* uses it for products whose smallest side is at
+ * least twice the crossover. The crossover is measured on first use unless set explicitly.
+ * Each result is then verified with a randomized residual check, r = A (B x) - C x for a random
+ * +-1 vector x. A result whose ||r|| / (||A|| ||B||) exceeds the tolerance is recomputed with the
+ * classical kernel.
+ */
+class MatrixStrassen {
+
+private:
+    struct Settings {
+        std::atomic<bool> enabled{false};
+        std::atomic<int> crossover{0};
+        std::atomic<double> tolerance{0};
+        std::atomic<double> last_residual{0};
+    };
+
+    static Settings &Get(){
+        static Settings settings;
+        return settings;
+    }
+
+    template<typename Type>
+    static std::atomic<int> &TunedCrossover(){
+        static std::atomic<int> crossover{0};
+        return crossover;
+    }
+
+public:
+    static void Enable(bool on = true) { Get().enabled.store(on, std::memory_order_relaxed); }
+    static bool IsEnabled() { return Get().enabled.load(std::memory_order_relaxed); }
+
+    // Smallest half-size worth another level; 0 returns to auto-tuning
+    static void SetCrossover(int size) { Get().crossover.store(std::max(size, 0), std::memory_order_relaxed); }
+
+    // Largest accepted ||A (B x) - C x|| / (||A|| ||B||) in max-row-sum norms; 0 means 32 * k * epsilon
+    static void SetTolerance(double tolerance) { Get().tolerance.store(tolerance, std::memory_order_relaxed); }
+
+    // Relative residual measured by the last Strassen product (0 when none ran yet)
+    static double GetLastResidual() { return Get().last_residual.load(std::memory_order_relaxed); }
+    static void SetLastResidual(double residual) { Get().last_residual.store(residual, std::memory_order_relaxed); }
+
+    template<typename Type>
+    static double GetTolerance(int k){
+        double tolerance = Get().tolerance.load(std::memory_order_relaxed);
+        return tolerance > 0 ? tolerance : 32.0 * k * double(std::numeric_limits<Type>::epsilon());
+    }
+
+    template<typename Type>
+    static int Tune();
+
+    template<typename Type>
+    static int GetCrossover(){
+        int crossover = Get().crossover.load(std::memory_order_relaxed);
+        if (crossover > 0)
+            return crossover;
+        int tuned = TunedCrossover<Type>().load(std::memory_order_relaxed);
+        if (tuned == 0) {
+            tuned = Tune<Type>();
+            TunedCrossover<Type>().store(tuned, std::memory_order_relaxed);
+        }
+        return tuned;
+    }
+};
+
+namespace MatrixDetail {
+    inline Workspace &StrassenWorkspace(){
+        thread_local Workspace workspace;
+        return workspace;
+    }
+
+    // Z = X + sign * Y over a rows x cols block; Z may be X or Y
+    template<typename Type>
+    void StrassenCombine(int rows, int cols, const Type *X, ptrdiff_t ldx, const Type *Y, ptrdiff_t ldy,
+                         Type *Z, ptrdiff_t ldz, Type sign){
+        auto body = [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                const Type *x = X + i * ldx, *y = Y + i * ldy;
+                Type *z = Z + i * ldz;
+                for (int j = 0; j < cols; j++)
+                    z[j] = x[j] + sign * y[j];
+            }
+        };
+        MatrixThreadPool &pool = MatrixThreadPool::Instance();
+        if (pool.GetThreadCount() == 1 || (long long)rows * cols < GemmParallelThreshold / 64)
+            body(0, rows);
+        else
+            pool.ParallelFor(0, rows, std::max(1, int(GemmParallelThreshold / 64 / std::max(cols, 1))), body);
+    }
+
+    template<typename Type>
+    void StrassenZero(int rows, int cols, Type *C, ptrdiff_t ldc){
+        for (int i = 0; i < rows; i++)
+            std::fill(C + i * ldc, C + i * ldc + cols, Type(0));
+    }
+
+    // Elements of scratch the recursion below a product of this shape needs
+    inline size_t StrassenWorkspaceSize(int m, int k, int n, int levels){
+        size_t total = 0;
+        for (; levels > 0; levels--) {
+            m /= 2, k /= 2, n /= 2;
+            total += size_t(m) * std::max(k, n) + size_t(k) * n;
+        }
+        return total;
+    }
+
+    // C = A * B (C is overwritten) with `levels` Strassen-Winograd levels
+    template<typename Type>
+    void StrassenRecursive(int m, int k, int n, const Type *A, ptrdiff_t lda, const Type *B, ptrdiff_t ldb,
+                           Type *C, ptrdiff_t ldc, int levels, Type *work){
+        if (levels == 0 || m < 2 || k < 2 || n < 2) {
+            StrassenZero(m, n, C, ldc);
+            GemmStrided(m, n, k, A, lda, 1, B, ldb, 1, C, int(ldc));
+            return;
+        }
+        int mh = m / 2, kh = k / 2, nh = n / 2;
+        const Type *A11 = A, *A12 = A + kh, *A21 = A + mh * lda, *A22 = A21 + kh;
+        const Type *B11 = B, *B12 = B + nh, *B21 = B + kh * ldb, *B22 = B21 + nh;
+        Type *C11 = C, *C12 = C + nh, *C21 = C + mh * ldc, *C22 = C21 + nh;
+        Type *X = work;
+        Type *Y = X + size_t(mh) * std::max(kh, nh);
+        Type *next = Y + size_t(kh) * nh;
+        ptrdiff_t ldx = kh, ldy = nh;
+        auto product = [&](const Type *P, ptrdiff_t ldp, const Type *Q, ptrdiff_t ldq, Type *R, ptrdiff_t ldr) {
+            StrassenRecursive(mh, kh, nh, P, ldp, Q, ldq, R, ldr, levels - 1, next);
+        };
+
+        StrassenCombine(mh, kh, A11, lda, A21, lda, X, ldx, Type(-1));   // S3 = A11 - A21
+        StrassenCombine(kh, nh, B22, ldb, B12, ldb, Y, ldy, Type(-1));   // T3 = B22 - B12
+        product(X, ldx, Y, ldy, C21, ldc);                               // P7 = S3 T3
+        StrassenCombine(mh, kh, A21, lda, A22, lda, X, ldx, Type(1));    // S1 = A21 + A22
+        StrassenCombine(kh, nh, B12, ldb, B11, ldb, Y, ldy, Type(-1));   // T1 = B12 - B11
+        product(X, ldx, Y, ldy, C22, ldc);                               // P5 = S1 T1
+        StrassenCombine(mh, kh, X, ldx, A11, lda, X, ldx, Type(-1));     // S2 = S1 - A11
+        StrassenCombine(kh, nh, B22, ldb, Y, ldy, Y, ldy, Type(-1));     // T2 = B22 - T1
+        product(X, ldx, Y, ldy, C12, ldc);                               // P6 = S2 T2
+        StrassenCombine(mh, kh, A12, lda, X, ldx, X, ldx, Type(-1));     // S4 = A12 - S2
+        product(X, ldx, B22, ldb, C11, ldc);                             // P3 = S4 B22
+        product(A11, lda, B11, ldb, X, nh);                              // P1 = A11 B11, X is now mh x nh
+        StrassenCombine(mh, nh, X, nh, C12, ldc, C12, ldc, Type(1));     // U2 = P1 + P6
+        StrassenCombine(mh, nh, C12, ldc, C21, ldc, C21, ldc, Type(1));  // U3 = U2 + P7
+        StrassenCombine(mh, nh, C12, ldc, C22, ldc, C12, ldc, Type(1));  // U4 = U2 + P5
+        StrassenCombine(mh, nh, C21, ldc, C22, ldc, C22, ldc, Type(1));  // U7 = U3 + P5 -> C22
+        StrassenCombine(mh, nh, C12, ldc, C11, ldc, C12, ldc, Type(1));  // U5 = U4 + P3 -> C12
+        StrassenCombine(kh, nh, Y, ldy, B21, ldb, Y, ldy, Type(-1));     // T4 = T2 - B21
+        product(A22, lda, Y, ldy, C11, ldc);                             // P4 = A22 T4
+        StrassenCombine(mh, nh, C21, ldc, C11, ldc, C21, ldc, Type(-1)); // U6 = U3 - P4 -> C21
+        product(A12, lda, B21, ldb, C11, ldc);                           // P2 = A12 B21
+        StrassenCombine(mh, nh, X, nh, C11, ldc, C11, ldc, Type(1));     // U1 = P1 + P2 -> C11
+
+        // Peeling: odd k adds a rank-1 term, odd n / m leave a last column / row to compute directly
+        int me = 2 * mh, ke = 2 * kh, ne = 2 * nh;
+        if (k != ke)
+            GemmStrided(me, ne, 1, A + ke, lda, 1, B + ke * ldb, ldb, 1, C, int(ldc));
+        if (n != ne) {
+            StrassenZero(me, 1, C + ne, ldc);
+            GemmStrided(me, 1, k, A, lda, 1, B + ne, ldb, 1, C + ne, int(ldc));
+        }
+        if (m != me) {
+            StrassenZero(1, n, C + me * ldc, ldc);
+            GemmStrided(1, n, k, A + me * lda, lda, 1, B, ldb, 1, C + me * ldc, int(ldc));
+        }
+    }
+
+    inline int StrassenLevels(int m, int k, int n, int crossover){
+        int levels = 0;
+        for (int size = std::min({m, k, n}); size / 2 >= crossover; size /= 2)
+            levels++;
+        return levels;
+    }
+
+    template<typename Type>
+    Type MaxRowSum(int rows, int cols, const Type *A, ptrdiff_t lda){
+        constexpr int L = VectorLanes<Type>;
+        Type norm = Type(0);
+        VectorRun([&] {
+            for (int i = 0; i < rows; i++) {
+                const Type *a = A + i * lda;
+                Type acc[L] = {};
+                int j = 0;
+                for (; j + L <= cols; j += L)
+                    for (int l = 0; l < L; l++)
+                        acc[l] += std::abs(a[j + l]);
+                for (; j < cols; j++)
+                    acc[0] += std::abs(a[j]);
+                Type sum = Type(0);
+                for (int l = 0; l < L; l++)
+                    sum += acc[l];
+                norm = std::max(norm, sum);
+            }
+        });
+        return norm;
+    }
+
+    /*
+     * ||A (B x) - C x|| / (||A|| ||B||) in max norms for a pseudo-random +-1 vector x: three Gemv passes
+     * for the residual and one row-sum pass over each of A and B for the scale, all in the working
+     * precision, whose own rounding (about k * epsilon) stays below the tolerance.
+     */
+    template<typename Type>
+    double StrassenResidual(int m, int k, int n, const Type *A, int lda, const Type *B, int ldb, const Type *C, int ldc){
+        std::vector<Type> x(n), bx(k), abx(m), cx(m);
+        unsigned state = 2463534242u;
+        for (Type &value : x) {
+            state ^= state << 13, state ^= state >> 17, state ^= state << 5;
+            value = (state & 1) ? Type(1) : Type(-1);
+        }
+        Gemv(k, n, Type(1), B, ldb, x.data(), Type(0), bx.data());
+        Gemv(m, k, Type(1), A, lda, bx.data(), Type(0), abx.data());
+        Gemv(m, n, Type(1), C, ldc, x.data(), Type(0), cx.data());
+        double residual = 0;
+        for (int i = 0; i < m; i++)
+            residual = std::max(residual, std::abs(double(abx[i]) - double(cx[i])));
+        double scale = double(MaxRowSum(m, k, A, lda)) * double(MaxRowSum(k, n, B, ldb));
+        return scale > 0 ? residual / scale : residual;
+    }
+
+    /*
+     * C = A * B through Strassen-Winograd when it is enabled and the product is large enough;
+     * returns false (C untouched) otherwise, leaving the product to the caller's classical path.
+     */
+    template<typename Type>
+    bool StrassenMultiply(int m, int n, int k, const Type *A, int lda, const Type *B, int ldb, Type *C, int ldc){
+        if constexpr (!std::is_floating_point_v<Type>) {
+            return false;
+        }
+        else {
+            if (!MatrixStrassen::IsEnabled() || std::min({m, n, k}) < 64)
+                return false;
+            int levels = StrassenLevels(m, k, n, MatrixStrassen::GetCrossover<Type>());
+            if (levels == 0)
+                return false;
+            MATRIX_PROFILE("MatrixDetail::StrassenMultiply(int m, int n, int k)");
+            // Leased: the combines and leaf products run on the pool, which may start another product on this thread
+            WorkspaceLease lease(StrassenWorkspace());
+            Type *work = lease.Get<Type>(StrassenWorkspaceSize(m, k, n, levels));
+            StrassenRecursive(m, k, n, A, lda, B, ldb, C, ldc, levels, work);
+
+            double residual = StrassenResidual(m, k, n, A, lda, B, ldb, C, ldc);
+            MatrixStrassen::SetLastResidual(residual);
+            if (!(residual <= MatrixStrassen::GetTolerance<Type>(k))) {
+#ifdef DEBUG
+                std::cout << "Strassen residual " << residual << " above tolerance, recomputing classically\n";
+#endif
+                StrassenZero(m, n, C, ldc);
+                Gemm(m, n, k, A, lda, B, ldb, C, ldc);
+            }
+            return true;
+        }
+    }
+}
+
+/*
+ * Times one Strassen level against the classical kernel on 2s x 2s products for growing s. The
+ * crossover is one doubling above the first s where the level wins: the tuning products stay in
+ * cache, while in large products the additions of the upper levels stream from memory.
+ */
+template<typename Type>
+int MatrixStrassen::Tune(){
+    MATRIX_PROFILE("MatrixStrassen::Tune()");
+    using Clock = std::chrono::steady_clock;
+    constexpr int Largest = 1024;
+    for (int s = 128; s <= Largest; s *= 2) {
+        int n = 2 * s;
+        std::vector<Type> A(size_t(n) * n), B(size_t(n) * n), C(size_t(n) * n);
+        for (size_t i = 0; i < A.size(); i++) {
+            A[i] = Type(int(i * 7 % 13) - 6) / Type(7);
+            B[i] = Type(int(i * 5 % 11) - 5) / Type(5);
+        }
+        MatrixDetail::WorkspaceLease lease(MatrixDetail::StrassenWorkspace());
+        Type *work = lease.Get<Type>(MatrixDetail::StrassenWorkspaceSize(n, n, n, 1));
+        double classical = 1e30, strassen = 1e30;
+        for (int repeat = 0; repeat < 2; repeat++) {
+            auto start = Clock::now();
+            MatrixDetail::StrassenZero(n, n, C.data(), n);
+            MatrixDetail::Gemm(n, n, n, A.data(), n, B.data(), n, C.data(), n);
+            auto middle = Clock::now();
+            MatrixDetail::StrassenRecursive(n, n, n, A.data(), n, B.data(), n, C.data(), n, 1, work);
+            auto end = Clock::now();
+            classical = std::min(classical, std::chrono::duration<double>(middle - start).count());
+            strassen = std::min(strassen, std::chrono::duration<double>(end - middle).count());
+        }
+        if (strassen < 0.97 * classical)
+            return 2 * s;
+    }
+    return 4 * Largest;
+}
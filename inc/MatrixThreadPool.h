@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/*
+ * Library-owned work-stealing pool. Every worker owns a deque: it pops its own work from
+ * the back (most recently split, still hot in cache) and steals from the front of the
+ * others. Threads that are not pool workers submit through an extra injection queue.
+ * A thread waiting in ParallelFor runs the still queued chunks of its own job and nothing
+ * else, so nested parallel calls (e.g. a GEMM inside a parallel LU) cannot deadlock, and a
+ * kernel never finds unrelated work - with its own use of the per-thread scratch buffers -
+ * running on its stack. Submit() queues a task nobody waits for; the pool owns it and
+ * deletes it once it has run. Only WaitUntil() runs arbitrary queued tasks.
+ */
+class MatrixThreadPool {
+
+public:
+    struct Job {
+        std::atomic<int> remaining{0};
+        virtual void Run(int begin, int end) = 0;
+        virtual ~Job() = default;
+    };
+
+private:
+    struct Task {
+        Job *job;
+        int begin;
+        int end;
+        bool owned = false;
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::thread> workers{};
+    std::vector<std::unique_ptr<WorkerQueue>> queues{};
+    std::vector<int> affinity{};
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::atomic<int> queued{0};
+    std::atomic<bool> stopping{false};
+    std::mutex configure_mutex;
+
+    // Index of the calling thread's queue: 0 for outside threads, 1..n for workers of this pool
+    static int &LocalQueueIndex(){
+        thread_local int index = 0;
+        return index;
+    }
+
+    static const MatrixThreadPool *&LocalPool(){
+        thread_local const MatrixThreadPool *pool = nullptr;
+        return pool;
+    }
+
+    int OwnQueue() const { return LocalPool() == this ? LocalQueueIndex() : 0; }
+
+    void Push(int queue_index, const Task &task){
+        {
+            std::lock_guard<std::mutex> lock(queues[queue_index]->mutex);
+            queues[queue_index]->tasks.push_back(task);
+        }
+        queued.fetch_add(1, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        wake.notify_one();
+    }
+
+    bool Pop(int queue_index, Task &task, bool steal){
+        WorkerQueue &queue = *queues[queue_index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            return false;
+        if (steal) {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+        }
+        else {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+        }
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool TryRunOne(int own){
+        Task task{};
+        bool found = Pop(own, task, false);
+        for (size_t offset = 1; !found && offset < queues.size(); offset++)
+            found = Pop(int((own + offset) % queues.size()), task, true);
+        if (!found)
+            return false;
+        task.job->Run(task.begin, task.end);
+        if (task.owned)
+            delete task.job;
+        else
+            task.job->remaining.fetch_sub(1, std::memory_order_acq_rel);
+        return true;
+    }
+
+    // Claims a queued chunk of job from any queue, own queue first, and runs it
+    bool TryRunChunk(int own, Job &job){
+        for (size_t offset = 0; offset < queues.size(); offset++) {
+            WorkerQueue &queue = *queues[(own + offset) % queues.size()];
+            Task task{};
+            {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                auto found = std::find_if(queue.tasks.rbegin(), queue.tasks.rend(), [&job](const Task &t) { return t.job == &job; });
+                if (found == queue.tasks.rend())
+                    continue;
+                task = *found;
+                queue.tasks.erase(std::next(found).base());
+            }
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            job.Run(task.begin, task.end);
+            job.remaining.fetch_sub(1, std::memory_order_acq_rel);
+            return true;
+        }
+        return false;
+    }
+
+    void WorkerLoop(int index){
+        LocalPool() = this;
+        LocalQueueIndex() = index;
+        while (!stopping.load(std::memory_order_acquire)) {
+            if (TryRunOne(index))
+                continue;
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            wake.wait(lock, [this] { return stopping.load() || queued.load() > 0; });
+        }
+    }
+
+    void PinWorker(std::thread &worker, int index){
+#ifdef __linux__
+        if (affinity.empty())
+            return;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(affinity[index % affinity.size()], &set);
+        pthread_setaffinity_np(worker.native_handle(), sizeof(set), &set);
+#else
+        (void)worker;
+        (void)index;
+#endif
+    }
+
+    void Stop(){
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+            wake.notify_all();
+        }
+        for (auto &worker : workers)
+            worker.join();
+        workers.clear();
+        stopping = false;
+    }
+
+    void Start(int num_threads){
+        queues.clear();
+        for (int i = 0; i < num_threads; i++)
+            queues.push_back(std::make_unique<WorkerQueue>());
+        for (int i = 1; i < num_threads; i++) {
+            workers.emplace_back(&MatrixThreadPool::WorkerLoop, this, i);
+            PinWorker(workers.back(), i - 1);
+        }
+    }
+
+    MatrixThreadPool(){
+        Start(std::max(1, int(std::thread::hardware_concurrency())));
+    }
+
+public:
+    MatrixThreadPool(const MatrixThreadPool &) = delete;
+    MatrixThreadPool &operator=(const MatrixThreadPool &) = delete;
+
+    ~MatrixThreadPool(){
+        Stop();
+    }
+
+    static MatrixThreadPool &Instance(){
+        static MatrixThreadPool pool;
+        return pool;
+    }
+
+    /*
+     * Restarts the pool with num_threads threads in total (the calling thread counts as one,
+     * so 1 disables parallelism). Worker i is pinned to cpus[i % cpus.size()] when cpus is
+     * given; pinning is only supported on Linux. Must not be called while work is running.
+     */
+    void Configure(int num_threads, const std::vector<int> &cpus = {}){
+        std::lock_guard<std::mutex> lock(configure_mutex);
+        Stop();
+        affinity = cpus;
+        Start(std::max(1, num_threads));
+    }
+
+    [[nodiscard]] int GetThreadCount() const { return int(queues.size()); }
+
+    // Splits [begin, end) into chunks of at least grain items, runs them on the pool and waits
+    template<typename Function>
+    void ParallelFor(int begin, int end, int grain, Function &&body){
+        int count = end - begin;
+        if (count <= 0)
+            return;
+        grain = std::max(grain, 1);
+        int chunks = std::min((count + grain - 1) / grain, GetThreadCount() * 4);
+        if (chunks <= 1 || GetThreadCount() == 1) {
+            body(begin, end);
+            return;
+        }
+
+        struct RangeJob : Job {
+            Function &function;
+            explicit RangeJob(Function &f) : function(f) {}
+            void Run(int b, int e) override { function(b, e); }
+        } job(body);
+
+        job.remaining = chunks;
+        int own = OwnQueue();
+        for (int c = 0; c < chunks; c++) {
+            int b = begin + int((long long)count * c / chunks);
+            int e = begin + int((long long)count * (c + 1) / chunks);
+            Push(own, Task{&job, b, e});
+        }
+        // Chunks other threads already took are left to them: helping with anything else could
+        // run a kernel that regrows scratch the caller of this ParallelFor still holds
+        while (job.remaining.load(std::memory_order_acquire) != 0)
+            if (!TryRunChunk(own, job))
+                std::this_thread::yield();
+    }
+
+    // Queues task() and returns at once; with a single thread it runs when someone waits on the pool
+    void Submit(std::function<void()> task){
+        struct FunctionJob : Job {
+            std::function<void()> function;
+            explicit FunctionJob(std::function<void()> f) : function(std::move(f)) {}
+            void Run(int, int) override { function(); }
+        };
+        Push(OwnQueue(), Task{new FunctionJob(std::move(task)), 0, 1, true});
+    }
+
+    // Executes any queued tasks on the calling thread until done() holds; not for use inside kernels
+    template<typename Predicate>
+    void WaitUntil(Predicate &&done){
+        int own = OwnQueue();
+        while (!done())
+            if (!TryRunOne(own))
+                std::this_thread::yield();
+    }
+};
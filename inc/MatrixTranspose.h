@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+#include "MatrixMemory.h"
+#include "MatrixGemm.h"
+
+/*
+ * Blocked transpose. The matrix is walked in TransposeBlock square blocks so that the rows read
+ * and the rows written both stay in L1, and every block is moved as 8 x 8 register tiles
+ * (AVX unpack/shuffle/permute networks for float and double, plain loops otherwise).
+ * Square matrices are transposed in place by swapping mirrored tile pairs, other dense shapes by
+ * following the cycles of the index permutation.
+ */
+namespace MatrixDetail {
+    constexpr int TransposeTile = 8;
+    constexpr int TransposeBlock = 64;
+
+    // dst (c x r) = src (r x c)^T for a tile of at most TransposeTile x TransposeTile
+    template<typename Type>
+    void TransposeTileGeneric(int r, int c, const Type *src, int lds, Type *dst, int ldd){
+        for (int i = 0; i < r; i++)
+            for (int j = 0; j < c; j++)
+                dst[size_t(j) * ldd + i] = src[size_t(i) * lds + j];
+    }
+
+#ifdef MATRIX_X86_DISPATCH
+    __attribute__((target("avx")))
+    inline void TransposeTileAVX(const float *src, int lds, float *dst, int ldd){
+        __m256 r[8], t[8];
+        for (int i = 0; i < 8; i++)
+            r[i] = _mm256_loadu_ps(src + size_t(i) * lds);
+        for (int i = 0; i < 8; i += 2) {
+            t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+            t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+        }
+        for (int i = 0; i < 8; i += 4) {
+            r[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+            r[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+            r[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+            r[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+        }
+        for (int i = 0; i < 4; i++) {
+            _mm256_storeu_ps(dst + size_t(i) * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x20));
+            _mm256_storeu_ps(dst + size_t(i + 4) * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x31));
+        }
+    }
+
+    // 8 x 8 doubles as four 4 x 4 quadrants, each transposed and stored to the mirrored quadrant
+    __attribute__((target("avx")))
+    inline void TransposeTileAVX(const double *src, int lds, double *dst, int ldd){
+        for (int qi = 0; qi < 8; qi += 4)
+            for (int qj = 0; qj < 8; qj += 4) {
+                const double *s = src + size_t(qi) * lds + qj;
+                double *d = dst + size_t(qj) * ldd + qi;
+                __m256d r0 = _mm256_loadu_pd(s);
+                __m256d r1 = _mm256_loadu_pd(s + lds);
+                __m256d r2 = _mm256_loadu_pd(s + 2 * size_t(lds));
+                __m256d r3 = _mm256_loadu_pd(s + 3 * size_t(lds));
+                __m256d t0 = _mm256_unpacklo_pd(r0, r1);
+                __m256d t1 = _mm256_unpackhi_pd(r0, r1);
+                __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+                __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+                _mm256_storeu_pd(d, _mm256_permute2f128_pd(t0, t2, 0x20));
+                _mm256_storeu_pd(d + ldd, _mm256_permute2f128_pd(t1, t3, 0x20));
+                _mm256_storeu_pd(d + 2 * size_t(ldd), _mm256_permute2f128_pd(t0, t2, 0x31));
+                _mm256_storeu_pd(d + 3 * size_t(ldd), _mm256_permute2f128_pd(t1, t3, 0x31));
+            }
+    }
+#endif
+
+    template<typename Type>
+    bool TransposeUsesAVX(){
+#ifdef MATRIX_X86_DISPATCH
+        if constexpr (std::is_same_v<Type, float> || std::is_same_v<Type, double>)
+            return ActiveGemmIsa() == GemmIsa::AVX2 || ActiveGemmIsa() == GemmIsa::AVX512;
+#endif
+        return false;
+    }
+
+    template<typename Type>
+    void TransposeTileAny(int r, int c, const Type *src, int lds, Type *dst, int ldd, bool avx){
+#ifdef MATRIX_X86_DISPATCH
+        if constexpr (std::is_same_v<Type, float> || std::is_same_v<Type, double>)
+            if (avx && r == TransposeTile && c == TransposeTile) {
+                TransposeTileAVX(src, lds, dst, ldd);
+                return;
+            }
+#endif
+        (void)avx;
+        TransposeTileGeneric(r, c, src, lds, dst, ldd);
+    }
+
+    // dst (cols x rows, leading dimension ldd) = src (rows x cols, leading dimension lds)^T; must not overlap
+    template<typename Type>
+    void Transpose(int rows, int cols, const Type *src, int lds, Type *dst, int ldd){
+        MatrixProfiler::CountWork(0, 2 * size_t(rows) * cols * sizeof(Type));
+        const bool avx = TransposeUsesAVX<Type>();
+        for (int ib = 0; ib < rows; ib += TransposeBlock)
+            for (int jb = 0; jb < cols; jb += TransposeBlock)
+                for (int i = ib; i < std::min(ib + TransposeBlock, rows); i += TransposeTile)
+                    for (int j = jb; j < std::min(jb + TransposeBlock, cols); j += TransposeTile)
+                        TransposeTileAny(std::min(TransposeTile, rows - i), std::min(TransposeTile, cols - j),
+                                         src + size_t(i) * lds + j, lds, dst + size_t(j) * ldd + i, ldd, avx);
+    }
+
+    // In-place transpose of an n x n matrix: each off-diagonal tile pair is swapped through one register-sized buffer
+    template<typename Type>
+    void TransposeInPlace(int n, Type *A, int lda){
+        MatrixProfiler::CountWork(0, 2 * size_t(n) * n * sizeof(Type));
+        const bool avx = TransposeUsesAVX<Type>();
+        alignas(64) Type buffer[TransposeTile * TransposeTile];
+        auto tile = [&](int i, int j) { return A + size_t(i) * lda + j; };
+
+        for (int ib = 0; ib < n; ib += TransposeBlock)
+            for (int jb = ib; jb < n; jb += TransposeBlock)
+                for (int i = ib; i < std::min(ib + TransposeBlock, n); i += TransposeTile)
+                    for (int j = jb == ib ? i : jb; j < std::min(jb + TransposeBlock, n); j += TransposeTile) {
+                        int ri = std::min(TransposeTile, n - i);
+                        int rj = std::min(TransposeTile, n - j);
+                        TransposeTileAny(rj, ri, tile(j, i), lda, buffer, TransposeTile, avx);
+                        if (i != j)
+                            TransposeTileAny(ri, rj, tile(i, j), lda, tile(j, i), lda, avx);
+                        for (int r = 0; r < ri; r++)
+                            std::copy(buffer + r * TransposeTile, buffer + r * TransposeTile + rj, tile(i + r, j));
+                    }
+    }
+
+    // Non-square in-place transposes up to this many bytes go through a leased scratch copy, larger ones follow cycles
+    constexpr size_t TransposeScratchBytes = size_t(4) << 20;
+
+    inline Workspace &TransposeWorkspace(){
+        thread_local Workspace workspace;
+        return workspace;
+    }
+
+    // In-place transpose of a dense rows x cols matrix into cols x rows by following the permutation
+    // cycles; the only scratch is one bit per element marking what has already moved
+    template<typename Type>
+    void TransposeCycles(int rows, int cols, Type *A){
+        size_t count = size_t(rows) * cols;
+        MatrixProfiler::CountWork(0, 2 * count * sizeof(Type));
+        if (rows <= 1 || cols <= 1)
+            return;
+        std::vector<uint64_t> moved((count + 63) / 64);
+        // The first and the last element stay where they are
+        for (size_t start = 1; start + 1 < count; start++) {
+            if (moved[start / 64] >> (start % 64) & 1)
+                continue;
+            Type value = A[start];
+            size_t k = start;
+            do {
+                k = (k % cols) * rows + k / cols;
+                std::swap(A[k], value);
+                moved[k / 64] |= uint64_t(1) << (k % 64);
+            } while (k != start);
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include "MatrixGemm.h"
+
+namespace MatrixDetail {
+    constexpr int TrsmBlockSize = 64;
+
+    /*
+     * Solves L * X = B in place for a lower triangular n x n L and an n x nrhs right-hand side B.
+     * Diagonal blocks are solved row by row, everything below them is updated through Gemm.
+     */
+    template<typename Type>
+    void TrsmLower(int n, int nrhs, const Type *L, int ldl, bool unit_diagonal, Type *B, int ldb){
+        for (int i0 = 0; i0 < n; i0 += TrsmBlockSize) {
+            int i1 = std::min(n, i0 + TrsmBlockSize);
+            Gemm(i1 - i0, nrhs, i0, L + size_t(i0) * ldl, ldl, B, ldb, B + size_t(i0) * ldb, ldb, Type(-1));
+            for (int i = i0; i < i1; i++) {
+                Type *b = B + size_t(i) * ldb;
+                for (int k = i0; k < i; k++) {
+                    Type l = L[size_t(i) * ldl + k];
+                    const Type *x = B + size_t(k) * ldb;
+                    for (int j = 0; j < nrhs; j++)
+                        b[j] -= l * x[j];
+                }
+                if (!unit_diagonal) {
+                    Type inv = Type(1) / L[size_t(i) * ldl + i];
+                    for (int j = 0; j < nrhs; j++)
+                        b[j] *= inv;
+                }
+            }
+        }
+    }
+
+    // Solves U * X = B in place for an upper triangular n x n U, walking the blocks bottom-up
+    template<typename Type>
+    void TrsmUpper(int n, int nrhs, const Type *U, int ldu, bool unit_diagonal, Type *B, int ldb){
+        for (int i1 = n; i1 > 0; i1 -= TrsmBlockSize) {
+            int i0 = std::max(0, i1 - TrsmBlockSize);
+            Gemm(i1 - i0, nrhs, n - i1, U + size_t(i0) * ldu + i1, ldu, B + size_t(i1) * ldb, ldb,
+                 B + size_t(i0) * ldb, ldb, Type(-1));
+            for (int i = i1 - 1; i >= i0; i--) {
+                Type *b = B + size_t(i) * ldb;
+                for (int k = i + 1; k < i1; k++) {
+                    Type u = U[size_t(i) * ldu + k];
+                    const Type *x = B + size_t(k) * ldb;
+                    for (int j = 0; j < nrhs; j++)
+                        b[j] -= u * x[j];
+                }
+                if (!unit_diagonal) {
+                    Type inv = Type(1) / U[size_t(i) * ldu + i];
+                    for (int j = 0; j < nrhs; j++)
+                        b[j] *= inv;
+                }
+            }
+        }
+    }
+
+    // Solves L^T * x = b in place for a single vector, reading L by rows
+    template<typename Type>
+    void TrsvLowerTransposed(int n, const Type *L, int ldl, bool unit_diagonal, Type *x){
+        for (int k = n - 1; k >= 0; k--) {
+            const Type *row = L + size_t(k) * ldl;
+            if (!unit_diagonal)
+                x[k] /= row[k];
+            for (int i = 0; i < k; i++)
+                x[i] -= row[i] * x[k];
+        }
+    }
+
+    // Solves U^T * x = b in place for a single vector, reading U by rows
+    template<typename Type>
+    void TrsvUpperTransposed(int n, const Type *U, int ldu, bool unit_diagonal, Type *x){
+        for (int k = 0; k < n; k++) {
+            const Type *row = U + size_t(k) * ldu;
+            if (!unit_diagonal)
+                x[k] /= row[k];
+            for (int i = k + 1; i < n; i++)
+                x[i] -= row[i] * x[k];
+        }
+    }
+}
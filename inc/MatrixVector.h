@@ -0,0 +1,476 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <initializer_list>
+#include <type_traits>
+#include <vector>
+#include "Matrix.h"
+
+/*
+ * Dense vectors and level 1/2 kernels. Vector<Type> owns one aligned buffer from the current
+ * memory resource, like Matrix. Dot/Axpy/Gemv are written as fixed-width lane loops (several
+ * independent accumulators per lane) that the compiler vectorizes; they are compiled for the widest
+ * ISA found at runtime and split over the thread pool once a call moves enough data.
+ *
+ * Dot products are summed in fixed chunks combined in order, so results do not depend on the
+ * thread count. Gemv reads A once: rows are dotted with x, and the transposed product walks rows
+ * of A adding them into column strips of y, so A^T is never formed.
+ */
+namespace MatrixDetail {
+    template<typename Type>
+    Type DotKernel(int n, const Type *x, const Type *y){
+        constexpr int L = 4 * VectorLanes<Type>;
+        Type acc[L] = {};
+        int i = 0;
+        for (; i + L <= n; i += L)
+            for (int l = 0; l < L; l++)
+                acc[l] += x[i + l] * y[i + l];
+        for (; i < n; i++)
+            acc[i % L] += x[i] * y[i];
+        // Pairwise fold keeps the reduction vectorized too
+        for (int width = L / 2; width > 0; width /= 2)
+            for (int l = 0; l < width; l++)
+                acc[l] += acc[l + width];
+        return acc[0];
+    }
+
+    // Dots four rows of A with x at once: x is loaded once per step and the rows give four independent chains
+    template<typename Type>
+    void DotKernel4(int n, const Type *A, ptrdiff_t lda, const Type *x, Type *out){
+        constexpr int L = VectorLanes<Type>;
+        const Type *a0 = A, *a1 = A + lda, *a2 = a1 + lda, *a3 = a2 + lda;
+        Type acc[4][L] = {};
+        int j = 0;
+        for (; j + L <= n; j += L)
+            for (int l = 0; l < L; l++) {
+                Type xv = x[j + l];
+                acc[0][l] += a0[j + l] * xv;
+                acc[1][l] += a1[j + l] * xv;
+                acc[2][l] += a2[j + l] * xv;
+                acc[3][l] += a3[j + l] * xv;
+            }
+        for (; j < n; j++) {
+            acc[0][j % L] += a0[j] * x[j];
+            acc[1][j % L] += a1[j] * x[j];
+            acc[2][j % L] += a2[j] * x[j];
+            acc[3][j % L] += a3[j] * x[j];
+        }
+        for (int r = 0; r < 4; r++) {
+            for (int width = L / 2; width > 0; width /= 2)
+                for (int l = 0; l < width; l++)
+                    acc[r][l] += acc[r][l + width];
+            out[r] = acc[r][0];
+        }
+    }
+
+    // The four-row kernel is the Gemv hot loop; compilers vectorize the generic one unreliably, so x86 gets it by hand
+#ifdef MATRIX_X86_DISPATCH
+    __attribute__((target("avx512f")))
+    inline void DotKernel4AVX512(int n, const float *A, ptrdiff_t lda, const float *x, float *out){
+        const float *a[4] = {A, A + lda, A + 2 * lda, A + 3 * lda};
+        __m512 acc[4] = {_mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps()};
+        int j = 0;
+        for (; j + 16 <= n; j += 16) {
+            __m512 xv = _mm512_loadu_ps(x + j);
+            for (int r = 0; r < 4; r++)
+                acc[r] = _mm512_fmadd_ps(_mm512_loadu_ps(a[r] + j), xv, acc[r]);
+        }
+        if (j < n) {
+            __mmask16 mask = __mmask16((1u << (n - j)) - 1);
+            __m512 xv = _mm512_mask_loadu_ps(_mm512_setzero_ps(), mask, x + j);
+            for (int r = 0; r < 4; r++)
+                acc[r] = _mm512_fmadd_ps(_mm512_mask_loadu_ps(_mm512_setzero_ps(), mask, a[r] + j), xv, acc[r]);
+        }
+        for (int r = 0; r < 4; r++)
+            out[r] = _mm512_reduce_add_ps(acc[r]);
+    }
+
+    __attribute__((target("avx512f")))
+    inline void DotKernel4AVX512(int n, const double *A, ptrdiff_t lda, const double *x, double *out){
+        const double *a[4] = {A, A + lda, A + 2 * lda, A + 3 * lda};
+        __m512d acc[4] = {_mm512_setzero_pd(), _mm512_setzero_pd(), _mm512_setzero_pd(), _mm512_setzero_pd()};
+        int j = 0;
+        for (; j + 8 <= n; j += 8) {
+            __m512d xv = _mm512_loadu_pd(x + j);
+            for (int r = 0; r < 4; r++)
+                acc[r] = _mm512_fmadd_pd(_mm512_loadu_pd(a[r] + j), xv, acc[r]);
+        }
+        if (j < n) {
+            __mmask8 mask = __mmask8((1u << (n - j)) - 1);
+            __m512d xv = _mm512_mask_loadu_pd(_mm512_setzero_pd(), mask, x + j);
+            for (int r = 0; r < 4; r++)
+                acc[r] = _mm512_fmadd_pd(_mm512_mask_loadu_pd(_mm512_setzero_pd(), mask, a[r] + j), xv, acc[r]);
+        }
+        for (int r = 0; r < 4; r++)
+            out[r] = _mm512_reduce_add_pd(acc[r]);
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline void DotKernel4AVX2(int n, const float *A, ptrdiff_t lda, const float *x, float *out){
+        const float *a[4] = {A, A + lda, A + 2 * lda, A + 3 * lda};
+        __m256 acc[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+        int j = 0;
+        for (; j + 8 <= n; j += 8) {
+            __m256 xv = _mm256_loadu_ps(x + j);
+            for (int r = 0; r < 4; r++)
+                acc[r] = _mm256_fmadd_ps(_mm256_loadu_ps(a[r] + j), xv, acc[r]);
+        }
+        for (int r = 0; r < 4; r++) {
+            __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc[r]), _mm256_extractf128_ps(acc[r], 1));
+            sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+            sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+            out[r] = _mm_cvtss_f32(sum);
+            for (int t = j; t < n; t++)
+                out[r] += a[r][t] * x[t];
+        }
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline void DotKernel4AVX2(int n, const double *A, ptrdiff_t lda, const double *x, double *out){
+        const double *a[4] = {A, A + lda, A + 2 * lda, A + 3 * lda};
+        __m256d acc[4] = {_mm256_setzero_pd(), _mm256_setzero_pd(), _mm256_setzero_pd(), _mm256_setzero_pd()};
+        int j = 0;
+        for (; j + 4 <= n; j += 4) {
+            __m256d xv = _mm256_loadu_pd(x + j);
+            for (int r = 0; r < 4; r++)
+                acc[r] = _mm256_fmadd_pd(_mm256_loadu_pd(a[r] + j), xv, acc[r]);
+        }
+        for (int r = 0; r < 4; r++) {
+            __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(acc[r]), _mm256_extractf128_pd(acc[r], 1));
+            out[r] = _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+            for (int t = j; t < n; t++)
+                out[r] += a[r][t] * x[t];
+        }
+    }
+#endif
+
+    template<typename Type>
+    using DotKernel4Function = void (*)(int n, const Type *A, ptrdiff_t lda, const Type *x, Type *out);
+
+    template<typename Type>
+    DotKernel4Function<Type> SelectDotKernel4(){
+#ifdef MATRIX_X86_DISPATCH
+        if constexpr (std::is_same_v<Type, float> || std::is_same_v<Type, double>) {
+            switch (ActiveGemmIsa()) {
+                case GemmIsa::AVX512: return &DotKernel4AVX512;
+                case GemmIsa::AVX2: return &DotKernel4AVX2;
+                default: break;
+            }
+        }
+#endif
+        return &DotKernel4<Type>;
+    }
+
+    template<typename Type>
+    void AxpyKernel(int n, Type alpha, const Type *x, Type *y){
+        for (int i = 0; i < n; i++)
+            y[i] += alpha * x[i];
+    }
+
+    template<typename Type>
+    Type Dot(int n, const Type *x, const Type *y){
+        int chunks = (n + VectorChunk - 1) / VectorChunk;
+        if (chunks <= 1) {
+            Type result = Type(0);
+            VectorRun([&] { result = DotKernel(n, x, y); });
+            return result;
+        }
+        std::vector<Type> partial(chunks);
+        VectorFor(chunks, 1, [&](int begin, int end) {
+            for (int c = begin; c < end; c++) {
+                int offset = c * VectorChunk;
+                partial[c] = DotKernel(std::min(VectorChunk, n - offset), x + offset, y + offset);
+            }
+        });
+        Type sum = Type(0);
+        for (Type value : partial)
+            sum += value;
+        return sum;
+    }
+
+    // y = alpha * x + y
+    template<typename Type>
+    void Axpy(int n, Type alpha, const Type *x, Type *y){
+        VectorFor(n, VectorChunk, [&](int begin, int end) {
+            AxpyKernel(end - begin, alpha, x + begin, y + begin);
+        });
+    }
+
+    // y = beta * y, with beta == 0 clearing y even if it holds NaNs
+    template<typename Type>
+    void ScaleVector(int n, Type beta, Type *y){
+        if (beta == Type(0))
+            std::fill(y, y + n, Type(0));
+        else if (beta != Type(1))
+            for (int i = 0; i < n; i++)
+                y[i] *= beta;
+    }
+
+    // y = alpha * A * x + beta * y, A row-major m x n with leading dimension lda
+    template<typename Type>
+    void Gemv(int m, int n, Type alpha, const Type *A, ptrdiff_t lda, const Type *x, Type beta, Type *y){
+        MatrixProfiler::CountWork(2.0 * m * n, (size_t(m) * n + n + 2 * size_t(m)) * sizeof(Type));
+        int grain = std::max(1, VectorChunk / std::max(n, 1));
+        grain = (grain + 3) / 4 * 4;
+        const DotKernel4Function<Type> kernel = SelectDotKernel4<Type>();
+        VectorFor(m, grain, [&](int begin, int end) {
+            Type dots[4];
+            int i = begin;
+            for (; i + 4 <= end; i += 4) {
+                kernel(n, A + i * lda, lda, x, dots);
+                for (int r = 0; r < 4; r++)
+                    y[i + r] = alpha * dots[r] + (beta == Type(0) ? Type(0) : beta * y[i + r]);
+            }
+            for (; i < end; i++)
+                y[i] = alpha * DotKernel(n, A + i * lda, x) + (beta == Type(0) ? Type(0) : beta * y[i]);
+        });
+    }
+
+    /*
+     * y = alpha * A^T * x + beta * y for the same row-major A (y has n entries). Every task owns a
+     * strip of y and adds alpha * x[i] * A[i, strip] for four rows at a time.
+     */
+    template<typename Type>
+    void GemvTransposed(int m, int n, Type alpha, const Type *A, ptrdiff_t lda, const Type *x, Type beta, Type *y){
+        MatrixProfiler::CountWork(2.0 * m * n, (size_t(m) * n + m + 2 * size_t(n)) * sizeof(Type));
+        constexpr int L = VectorLanes<Type>;
+        int grain = (std::max(L, VectorChunk / std::max(m, 1)) + L - 1) / L * L;
+        VectorFor(n, grain, [&](int begin, int end) {
+            int width = end - begin;
+            Type *out = y + begin;
+            ScaleVector(width, beta, out);
+            int i = 0;
+            for (; i + 4 <= m; i += 4) {
+                const Type *r0 = A + i * lda + begin, *r1 = r0 + lda, *r2 = r1 + lda, *r3 = r2 + lda;
+                Type a0 = alpha * x[i], a1 = alpha * x[i + 1], a2 = alpha * x[i + 2], a3 = alpha * x[i + 3];
+                for (int j = 0; j < width; j++)
+                    out[j] += a0 * r0[j] + a1 * r1[j] + a2 * r2[j] + a3 * r3[j];
+            }
+            for (; i < m; i++)
+                AxpyKernel(width, alpha * x[i], A + i * lda + begin, out);
+        });
+    }
+}
+
+template<typename Type>
+class Vector {
+
+private:
+    int length = 0;
+    size_t capacity = 0;
+    Type *data = nullptr;
+    MatrixMemoryResource *resource = MatrixDetail::CurrentResource();
+
+    void Free(){
+        if (data)
+            resource->Deallocate(data, capacity * sizeof(Type));
+        data = nullptr;
+        capacity = 0;
+    }
+
+public:
+    using ValueType = Type;
+
+    Vector() = default;
+
+    explicit Vector(int Size, Type value = Type()){
+        Resize(Size, false);
+        std::fill(data, data + length, value);
+    }
+
+    Vector(std::initializer_list<Type> values){
+        Resize(int(values.size()), false);
+        std::copy(values.begin(), values.end(), data);
+    }
+
+    explicit Vector(const std::vector<Type> &values){
+        Resize(int(values.size()), false);
+        std::copy(values.begin(), values.end(), data);
+    }
+
+    Vector(const Vector &other){
+        Resize(other.length, false);
+        std::copy(other.data, other.data + length, data);
+    }
+
+    Vector(Vector &&other) noexcept{
+        Swap(other);
+    }
+
+    Vector &operator=(const Vector &other){
+        if (this != &other) {
+            Resize(other.length, false);
+            std::copy(other.data, other.data + length, data);
+        }
+        return *this;
+    }
+
+    Vector &operator=(Vector &&other) noexcept{
+        Swap(other);
+        return *this;
+    }
+
+    ~Vector(){
+        Free();
+    }
+
+    void Swap(Vector &other) noexcept{
+        std::swap(length, other.length);
+        std::swap(capacity, other.capacity);
+        std::swap(data, other.data);
+        std::swap(resource, other.resource);
+    }
+
+    // Keeps the buffer when it is large enough, so loops that reuse a vector do not allocate
+    void Resize(int Size, bool zero_fill = true){
+        assert(Size >= 0);
+        if (size_t(Size) > capacity) {
+            Free();
+            data = static_cast<Type *>(resource->Allocate(size_t(Size) * sizeof(Type)));
+            capacity = size_t(Size);
+            MatrixProfiler::CountAllocation(capacity * sizeof(Type));
+        }
+        length = Size;
+        if (zero_fill)
+            std::fill(data, data + length, Type());
+    }
+
+    [[nodiscard]] int GetSize() const { return length; }
+    [[nodiscard]] size_t size() const { return size_t(length); }
+    [[nodiscard]] Type *Data() { return data; }
+    [[nodiscard]] const Type *Data() const { return data; }
+    Type *begin() { return data; }
+    Type *end() { return data + length; }
+    const Type *begin() const { return data; }
+    const Type *end() const { return data + length; }
+
+    Type &operator[](int idx){
+        assert(idx < length);
+        return data[idx];
+    }
+
+    const Type &operator[](int idx) const{
+        assert(idx < length);
+        return data[idx];
+    }
+
+    [[nodiscard]] Type Dot(const Vector &other) const{
+        MATRIX_PROFILE("Vector::Dot(const Vector &other)");
+        assert(length == other.length);
+        MatrixProfiler::CountWork(2.0 * length, 2 * size_t(length) * sizeof(Type));
+        return MatrixDetail::Dot(length, data, other.data);
+    }
+
+    // Euclidean norm
+    [[nodiscard]] Type Norm() const{
+        MATRIX_PROFILE("Vector::Norm()");
+        MatrixProfiler::CountWork(2.0 * length, size_t(length) * sizeof(Type));
+        return Type(std::sqrt(MatrixDetail::Dot(length, data, data)));
+    }
+
+    Vector &operator+=(const Vector &other){
+        assert(length == other.length);
+        MatrixDetail::Axpy(length, Type(1), other.data, data);
+        return *this;
+    }
+
+    Vector &operator-=(const Vector &other){
+        assert(length == other.length);
+        MatrixDetail::Axpy(length, Type(-1), other.data, data);
+        return *this;
+    }
+
+    Vector &operator*=(Type value){
+        MatrixDetail::ScaleVector(length, value, data);
+        return *this;
+    }
+
+    Vector &operator/=(Type value){
+        for (Type &element : *this)
+            element /= value;
+        return *this;
+    }
+
+    Vector operator+(const Vector &other) const{
+        Vector temp(*this);
+        temp += other;
+        return temp;
+    }
+
+    Vector operator-(const Vector &other) const{
+        Vector temp(*this);
+        temp -= other;
+        return temp;
+    }
+
+    Vector operator*(Type value) const{
+        Vector temp(*this);
+        temp *= value;
+        return temp;
+    }
+
+    Vector operator/(Type value) const{
+        Vector temp(*this);
+        temp /= value;
+        return temp;
+    }
+
+    bool operator==(const Vector &other) const{
+        return length == other.length && std::equal(begin(), end(), other.begin());
+    }
+
+    bool operator!=(const Vector &other) const{
+        return !(*this == other);
+    }
+};
+
+template<typename Type>
+Vector<Type> operator*(Type value, const Vector<Type> &v){
+    return v * value;
+}
+
+// y = alpha * x + y
+template<typename Type>
+void Axpy(Type alpha, const Vector<Type> &x, Vector<Type> &y){
+    MATRIX_PROFILE("Axpy(Type alpha, const Vector<Type> &x, Vector<Type> &y)");
+    assert(x.GetSize() == y.GetSize());
+    MatrixProfiler::CountWork(2.0 * x.GetSize(), 3 * x.size() * sizeof(Type));
+    MatrixDetail::Axpy(x.GetSize(), alpha, x.Data(), y.Data());
+}
+
+template<typename Type>
+Type Dot(const Vector<Type> &x, const Vector<Type> &y){
+    return x.Dot(y);
+}
+
+/*
+ * y = alpha * A * x + beta * y. A transposed view (A.Transposed()) runs the transposed kernel on the
+ * original storage; other strided or minor views are materialized first. y must not alias x.
+ */
+template<typename Type>
+void Gemv(Type alpha, const MatrixView<Type> &A, const Vector<Type> &x, Type beta, Vector<Type> &y){
+    MATRIX_PROFILE("Gemv(Type alpha, const MatrixView<Type> &A, const Vector<Type> &x, Type beta, Vector<Type> &y)");
+    assert(A.GetColumns() == x.GetSize() && &x != &y);
+    if (y.GetSize() != A.GetRows())
+        y.Resize(A.GetRows());
+    if (A.IsRowContiguous())
+        MatrixDetail::Gemv(A.GetRows(), A.GetColumns(), alpha, A.Data(), A.GetRowStride(), x.Data(), beta, y.Data());
+    else if (!A.HasExclusions() && A.GetRowStride() == 1)
+        MatrixDetail::GemvTransposed(A.GetColumns(), A.GetRows(), alpha, A.Data(), A.GetColumnStride(), x.Data(), beta, y.Data());
+    else
+        Gemv(alpha, Matrix<Type>(A).GetView(), x, beta, y);
+}
+
+template<typename Type>
+Vector<Type> operator*(const MatrixView<Type> &A, const Vector<Type> &x){
+    Vector<Type> y(A.GetRows(), Type(0));
+    Gemv(Type(1), A, x, Type(0), y);
+    return y;
+}
+
+template<typename Type>
+Vector<Type> operator*(const Matrix<Type> &A, const Vector<Type> &x){
+    return A.GetView() * x;
+}
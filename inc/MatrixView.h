@@ -0,0 +1,267 @@
+#pragma once
+
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include "Matrix.h"
+
+/*
+ * Read-only, non-owning window onto matrix data: an origin pointer, a row and a column
+ * stride, and optionally one excluded row and one excluded column. Sub-matrices, minors,
+ * row and column slices and transposes are all O(1) to create and never copy.
+ * A view is also an expression leaf, so Matrix<Type> m = view (or view + matrix) materializes it.
+ * The viewed matrix must outlive the view and keep its shape.
+ */
+template<typename Type>
+class MatrixView : public MatrixExpression<MatrixView<Type>> {
+
+private:
+    const Type *data = nullptr;
+    int rows = 0;
+    int columns = 0;
+    ptrdiff_t row_stride = 0;
+    ptrdiff_t column_stride = 1;
+    int excluded_row = INT_MAX;
+    int excluded_column = INT_MAX;
+
+    int SourceRow(int i) const { return i + (i >= excluded_row); }
+    int SourceColumn(int j) const { return j + (j >= excluded_column); }
+
+    struct RowEvaluator {
+        const Type *row;
+        ptrdiff_t stride;
+        int excluded;
+        Type operator[](int j) const { return row[(j + (j >= excluded)) * stride]; }
+    };
+
+    /*
+     * True when a square view has only zeros below the diagonal (if below), above it (if above) and
+     * Diagonal holds for every a_ii (unless it is nullptr). Only those parts of each row are read.
+     */
+    template<typename Diagonal>
+    bool ScanTriangles(bool below, bool above, Diagonal diagonal) const{
+        const Type zero = Type(0);
+        auto diagonal_ok = [&](int i) {
+            if constexpr (std::is_same_v<Diagonal, std::nullptr_t>)
+                return true;
+            else
+                return bool(diagonal((*this)(i, i)));
+        };
+        int n = rows;
+        if (HasExclusions() || (column_stride != 1 && row_stride != 1)) {
+            for (int i = 0; i < n; i++) {
+                if (!diagonal_ok(i))
+                    return false;
+                for (int j = 0; j < n; j++)
+                    if (((j < i && below) || (j > i && above)) && (*this)(i, j) != zero)
+                        return false;
+            }
+            return true;
+        }
+        // Stored by columns: row i of the storage is column i of the view, so the two sides swap
+        bool by_columns = column_stride != 1;
+        ptrdiff_t ld = by_columns ? column_stride : row_stride;
+        bool left = by_columns ? above : below;
+        bool right = by_columns ? below : above;
+        return MatrixDetail::AllSpans(n, n, false, [&](int i, int, int) {
+            const Type *row = data + i * ld;
+            auto nonzero = [row, zero](int j) { return row[j] != zero; };
+            return diagonal_ok(i) && (!left || MatrixDetail::NoneInRange(0, i, nonzero)) &&
+                   (!right || MatrixDetail::NoneInRange(i + 1, n, nonzero));
+        });
+    }
+
+public:
+    using ValueType = Type;
+
+    MatrixView() = default;
+
+    MatrixView(const Type *Data, int num_rows, int num_columns, ptrdiff_t RowStride, ptrdiff_t ColumnStride = 1)
+        : data(Data), rows(num_rows), columns(num_columns), row_stride(RowStride), column_stride(ColumnStride) {}
+
+    MatrixView(const Matrix<Type> &Source)
+        : MatrixView(Source.Data(), Source.GetRows(), Source.GetColumns(), Source.GetStride()) {}
+
+    [[nodiscard]] int GetRows() const { return rows; }
+    [[nodiscard]] int GetColumns() const { return columns; }
+    [[nodiscard]] const Type *Data() const { return data; }
+    [[nodiscard]] ptrdiff_t GetRowStride() const { return row_stride; }
+    [[nodiscard]] ptrdiff_t GetColumnStride() const { return column_stride; }
+
+    // A view with an excluded row or column cannot be described by strides alone
+    [[nodiscard]] bool HasExclusions() const { return excluded_row != INT_MAX || excluded_column != INT_MAX; }
+
+    const Type &operator()(int i, int j) const{
+        assert(i < rows && j < columns);
+        return data[SourceRow(i) * row_stride + SourceColumn(j) * column_stride];
+    }
+
+    Matrix<Type> *Storage() { return nullptr; }
+
+    // True when the view reads [begin, end) other than element (i, j) at begin[i * stride + j], e.g. A.Transposed() of A
+    template<typename Target>
+    bool Aliases(const Target *begin, const Target *end, ptrdiff_t stride) const{
+        if constexpr (!std::is_same_v<Target, Type>) {
+            return false;
+        }
+        else {
+            if (rows == 0 || columns == 0)
+                return false;
+            if (data == begin && row_stride == stride && column_stride == 1 && !HasExclusions())
+                return false;
+            ptrdiff_t last_row = (rows - 1 + (excluded_row != INT_MAX)) * row_stride;
+            ptrdiff_t last_column = (columns - 1 + (excluded_column != INT_MAX)) * column_stride;
+            ptrdiff_t low = std::min<ptrdiff_t>(0, last_row) + std::min<ptrdiff_t>(0, last_column);
+            ptrdiff_t high = std::max<ptrdiff_t>(0, last_row) + std::max<ptrdiff_t>(0, last_column);
+            auto address = [](const Type *p) { return reinterpret_cast<uintptr_t>(p); };
+            uintptr_t first = address(data) + low * sizeof(Type), last = address(data) + high * sizeof(Type);
+            return first < address(end) && last >= address(begin);
+        }
+    }
+
+    RowEvaluator RowAt(int i) const { return RowEvaluator{data + SourceRow(i) * row_stride, column_stride, excluded_column}; }
+
+    // True when every row is a plain contiguous array, so kernels may read it through RowPointer
+    [[nodiscard]] bool IsRowContiguous() const { return column_stride == 1 && excluded_column == INT_MAX; }
+
+    [[nodiscard]] const Type *RowPointer(int i) const{
+        assert(IsRowContiguous());
+        return data + SourceRow(i) * row_stride;
+    }
+
+    [[nodiscard]] MatrixView SubMatrix(int row, int column, int num_rows, int num_columns) const{
+        assert(row + num_rows <= rows && column + num_columns <= columns);
+        assert(excluded_row == INT_MAX && excluded_column == INT_MAX);
+        return MatrixView(data + row * row_stride + column * column_stride, num_rows, num_columns, row_stride, column_stride);
+    }
+
+    [[nodiscard]] MatrixView Row(int i) const { return SubMatrix(i, 0, 1, columns); }
+    [[nodiscard]] MatrixView Column(int j) const { return SubMatrix(0, j, rows, 1); }
+
+    // The matrix without one row and one column, e.g. for cofactors
+    [[nodiscard]] MatrixView Minor(int row, int column) const{
+        assert(excluded_row == INT_MAX && excluded_column == INT_MAX);
+        assert(row < rows && column < columns);
+        MatrixView view = *this;
+        view.rows--;
+        view.columns--;
+        view.excluded_row = row;
+        view.excluded_column = column;
+        return view;
+    }
+
+    [[nodiscard]] MatrixView Transposed() const{
+        MatrixView view(data, columns, rows, column_stride, row_stride);
+        view.excluded_row = excluded_column;
+        view.excluded_column = excluded_row;
+        return view;
+    }
+
+    // The structure checks read only the triangle they are about and stop at the first offending block
+    [[nodiscard]] bool IsDiagonalMatrix() const{
+        if (rows != columns)
+            return false;
+        return ScanTriangles(true, true, [](Type d) { return d != Type(0); });
+    }
+
+    [[nodiscard]] bool IsUpperTriangleMatrix() const{
+        if (rows != columns)
+            return false;
+        return ScanTriangles(true, false, nullptr);
+    }
+
+    [[nodiscard]] bool IsLowerTriangleMatrix() const{
+        if (rows != columns)
+            return false;
+        return ScanTriangles(false, true, nullptr);
+    }
+
+    [[nodiscard]] bool IsIdentityMatrix() const{
+        if (rows != columns)
+            return false;
+        return ScanTriangles(true, true, [](Type d) { return d == Type(1); });
+    }
+
+    // Stops at the first non-zero over the budget, so a dense matrix is rejected early
+    [[nodiscard]] bool IsSparseMatrix(double max_density = MatrixDetail::SparseDensityThreshold) const{
+        long long budget = (long long)(max_density * double(rows) * double(columns));
+        for (int i = 0; i < rows; i++) {
+            auto row = RowAt(i);
+            for (int j = 0; j < columns; j++)
+                if (row[j] != Type(0) && --budget < 0)
+                    return false;
+        }
+        return true;
+    }
+
+    template<typename Accumulator = MatrixDetail::FactorType<Type>>
+    [[nodiscard]] Accumulator Determinant() const{
+        MATRIX_PROFILE("MatrixView::Determinant()");
+        assert(rows == columns);
+        auto at = [this](int i, int j) { return Accumulator((*this)(i, j)); };
+        if (rows == 1)
+            return at(0, 0);
+        if (rows == 2)
+            return at(0, 0) * at(1, 1) - at(0, 1) * at(1, 0);
+
+        Matrix<Accumulator> factors(rows, columns);
+        for (int i = 0; i < rows; i++)
+            for (int j = 0; j < columns; j++)
+                factors[i][j] = at(i, j);
+        MatrixDetail::WorkspaceLease lease(MatrixDetail::PivotWorkspace());
+        int *pivots = lease.Get<int>(rows);
+        Accumulator det = Accumulator(MatrixDetail::LUFactor(rows, factors.Data(), factors.GetStride(), pivots));
+        for (int i = 0; i < rows; i++)
+            det *= factors[i][i];
+        return det;
+    }
+
+    bool operator==(const MatrixView &other) const{
+        if (rows != other.rows || columns != other.columns)
+            return false;
+        for (int i = 0; i < rows; i++)
+            for (int j = 0; j < columns; j++)
+                if ((*this)(i, j) != other(i, j))
+                    return false;
+        return true;
+    }
+
+    bool operator!=(const MatrixView &other) const{
+        return !(*this == other);
+    }
+
+    void PrintMatrix() const{
+        std::cout << "\nPrinting matrix. Rows: " << rows << " Columns: " << columns <<"\n";
+        for (int i = 0; i < rows; i++) {
+            for (int j = 0; j < columns; j++)
+                std::cout << (*this)(i, j);
+            std::cout << "\n";
+        }
+        std::cout << "\n";
+    }
+};
+
+namespace MatrixDetail {
+    template<typename Type>
+    MatrixView<Type> AsView(const Matrix<Type> &Source){
+        return Source.GetView();
+    }
+
+    template<typename Type>
+    Matrix<Type> Product(const MatrixView<Type> &Left, const MatrixView<Type> &Right){
+        MATRIX_PROFILE("MatrixDetail::Product(const MatrixView<Type> &Left, const MatrixView<Type> &Right)");
+        assert(Left.GetColumns() == Right.GetRows());
+        if (Left.HasExclusions())
+            return Product(Matrix<Type>(Left).GetView(), Right);
+        if (Right.HasExclusions())
+            return Product(Left, Matrix<Type>(Right).GetView());
+
+        Matrix<Type> result(Left.GetRows(), Right.GetColumns());
+        GemmMixed<MatrixAccumulatorT<Type>>(Left.GetRows(), Right.GetColumns(), Left.GetColumns(),
+                    Left.Data(), Left.GetRowStride(), Left.GetColumnStride(),
+                    Right.Data(), Right.GetRowStride(), Right.GetColumnStride(),
+                    result.Data(), result.GetStride());
+        return result;
+    }
+}
@@ -11,5 +11,8 @@ int main() {
     auto S = M1*M;
     auto S1 = M.MultiplyMixed(M1);
     auto d = 5*S*5*S;
+    auto v = Vector<float>{1, 2, 3, 4};
+    auto Sv = S * v;
+    auto StV = S.Transposed() * v;
     return 0;
 }
@@ -0,0 +1,95 @@
+#include <cmath>
+#include <cstdio>
+#include "Matrix.h"
+
+// Element-wise arithmetic against the compound operators it has to agree with
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+    do {                                                                       \
+        if (!(condition)) {                                                    \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                        \
+        }                                                                      \
+    } while (0)
+
+// The scalar is applied at its own width, so an integer matrix is scaled by 0.5 and 2.5, not by 0 and 2
+static void IntegerScalars(){
+    Matrix<int> m({{4, 6}, {8, 10}});
+
+    Matrix<int> half = m * 0.5;
+    CHECK(half == Matrix<int>({{2, 3}, {4, 5}}));
+    Matrix<int> half_left = 0.5 * m;
+    CHECK(half_left == half);
+    Matrix<int> compound = m;
+    compound *= 0.5;
+    CHECK(compound == half);
+
+    Matrix<int> divided = m / 2.5;
+    CHECK(divided == Matrix<int>({{1, 2}, {3, 4}}));
+    compound = m;
+    compound /= 2.5;
+    CHECK(compound == divided);
+
+    Matrix<int> shifted = m + 0.5;
+    compound = m;
+    compound += 0.5;
+    CHECK(shifted == compound);
+}
+
+template<typename Type>
+static Matrix<Type, 5, 5> Tridiagonal(){
+    Matrix<Type, 5, 5> result;
+    for (int i = 0; i < 5; i++) {
+        result(i, i) = Type(2);
+        if (i > 0)
+            result(i, i - 1) = result(i - 1, i) = Type(1);
+    }
+    return result;
+}
+
+// Fixed sizes past the closed forms eliminate in double, not in integer division
+static void FixedIntegerDeterminant(){
+    CHECK(Tridiagonal<int>().Determinant() == 6);
+    CHECK(std::abs(Tridiagonal<double>().Determinant() - 6.0) < 1e-12);
+
+    Matrix<double, 5, 5> product = Matrix<double, 5, 5>::Inverse(Tridiagonal<double>()) * Tridiagonal<double>();
+    for (int i = 0; i < 5; i++)
+        for (int j = 0; j < 5; j++)
+            CHECK(std::abs(product(i, j) - (i == j ? 1.0 : 0.0)) < 1e-12);
+}
+
+// Inverting a singular matrix gives back the input bit for bit, not a round-off copy of it
+static void SingularInverse(){
+    const int n = 6;
+    Matrix<double> singular(n, n);
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++)
+            singular[i][j] = i == n - 1 ? 0.0 : std::sin(0.1 + i * 0.7 + j * 1.3) / 3.0;
+    for (int j = 0; j < n; j++)
+        singular[n - 1][j] = singular[0][j] * 0.3 + singular[2][j] / 7.0;
+    CHECK(std::abs(singular.Determinant()) < 1e-12);
+
+    Matrix<double> inverted = singular;
+    inverted.Inverse();
+    CHECK(inverted == singular);
+
+    Matrix<float> narrow(n, n);
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++)
+            narrow[i][j] = float(singular[i][j]);
+    for (int j = 0; j < n; j++)
+        narrow[n - 1][j] = narrow[1][j];
+    Matrix<float> narrow_inverted = narrow;
+    narrow_inverted.Inverse();
+    CHECK(narrow_inverted == narrow);
+}
+
+int main(){
+    IntegerScalars();
+    FixedIntegerDeterminant();
+    SingularInverse();
+    std::printf("%s\n", failures == 0 ? "passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
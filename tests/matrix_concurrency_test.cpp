@@ -0,0 +1,93 @@
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "Matrix.h"
+
+// Kernels that hold per-thread scratch across a nested Gemm or ParallelFor, called from inside pool work
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+    do {                                                                       \
+        if (!(condition)) {                                                    \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                        \
+        }                                                                      \
+    } while (0)
+
+static Matrix<double> Solvable(int n, unsigned seed){
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+    Matrix<double> result(n, n);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++)
+            result[i][j] = distribution(generator) / double(n);
+        result[i][i] += 1.0;
+    }
+    return result;
+}
+
+static bool IsInverse(const Matrix<double> &A, const Matrix<double> &Inverse){
+    Matrix<double> product = A * Inverse;
+    Matrix<double> identity(A.GetRows(), A.GetColumns());
+    for (int i = 0; i < A.GetRows(); i++)
+        identity[i][i] = 1.0;
+    return product.IsApprox(identity, 1e-9);
+}
+
+// Every body inverts a matrix large enough for LUInvert's Gemm to go parallel, so waiting threads meet other bodies' work
+static void NestedInverse(){
+    const int count = 16, n = 260;
+    std::vector<Matrix<double>> sources, inverses;
+    for (int i = 0; i < count; i++) {
+        sources.push_back(Solvable(n, 1 + i));
+        inverses.push_back(sources.back());
+    }
+    MatrixThreadPool::Instance().ParallelFor(0, count, 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            inverses[i].Inverse();
+    });
+    for (int i = 0; i < count; i++)
+        CHECK(IsInverse(sources[i], inverses[i]));
+}
+
+// Inverse, determinant and 16 bit product nodes run side by side; a node's nested Gemm waits on the pool
+static void AsyncNodes(){
+    const int count = 16, n = 400;
+    MatrixAsync graph;
+    std::vector<Matrix<double>> sources;
+    std::vector<double> determinants;
+    std::vector<MatrixFuture<double>> inverses, dets;
+    for (int i = 0; i < count; i++) {
+        sources.push_back(Solvable(n, 100 + i));
+        determinants.push_back(sources.back().Determinant());
+        MatrixFuture<double> input = graph.Input(sources.back());
+        inverses.push_back(input.Then([](const Matrix<double> &m) { return Matrix<double>::Inverse(m); }));
+        dets.push_back(input.Then([](const Matrix<double> &m) {
+            Matrix<double> det(1, 1);
+            det[0][0] = m.Determinant();
+            return det;
+        }));
+    }
+    Matrix<Float16> half = sources[0].Cast<Float16>();
+    Matrix<Float16> expected = half * half;
+    MatrixFuture<Float16> product = graph.Input(half);
+    MatrixFuture<Float16> squared = product * product;
+
+    for (int i = 0; i < count; i++) {
+        CHECK(IsInverse(sources[i], inverses[i].Get()));
+        CHECK(std::abs(dets[i].Get()[0][0] - determinants[i]) <= 1e-9 * std::abs(determinants[i]));
+    }
+    CHECK(squared.Get() == expected);
+}
+
+int main(){
+    MatrixThreadPool::Instance().Configure(4);
+    for (int round = 0; round < 4; round++) {
+        NestedInverse();
+        AsyncNodes();
+    }
+    std::printf("%s\n", failures == 0 ? "passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}